@@ -0,0 +1,568 @@
+#include "../src/linkedhashmap.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  ifdef _WIN64
+#    define PRI_SIZE_T PRIu64
+#  else
+#    define PRI_SIZE_T PRIu32
+#  endif
+#else
+#  include <time.h>
+#  define PRI_SIZE_T "zu"
+#endif
+
+// Each benchmark is repeated until its measured section has run for at least this long, so that small sizes are measurable
+#define BENCH_MIN_SECONDS 0.05
+
+// Repetition also stops once this much time has passed including setup, which dominates for small sizes
+#define BENCH_MAX_REPEAT_SECONDS 0.5
+
+// Larger sizes are skipped for a distribution once the next size is projected to take longer than this, assuming linear growth
+#define BENCH_SIZE_BUDGET_SECONDS 30.0
+
+#define BENCH_DEFAULT_MAX_SIZE 100000000
+
+#define SHORT_STRING_SIZE 12
+#define LONG_STRING_SIZE 100
+#define COLLISION_KEY_SIZE 16
+
+/// @brief A set of generated keys. The first `size` keys are inserted into maps, and the second `size` keys are never inserted, for measuring misses.
+typedef struct _BenchKeys
+{
+    size_t size;
+    void** keys;
+    size_t* key_sizes;
+    unsigned char* storage;
+} BenchKeys;
+
+/// @brief The state passed to a single benchmark run.
+typedef struct _BenchContext
+{
+    BenchKeys* keys;
+    size_t size;
+    double seconds;
+    size_t ops;
+} BenchContext;
+
+/// @brief A named benchmark.
+typedef struct _Benchmark
+{
+    const char* name;
+    void (*run)(BenchContext*);
+} Benchmark;
+
+/// @brief A named key distribution.
+typedef struct _BenchDistribution
+{
+    const char* name;
+    size_t key_size;
+    void (*generate)(unsigned char*, size_t, uint64_t*);
+} BenchDistribution;
+
+double bench_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+uint64_t bench_random(uint64_t* state)
+{
+    *state += 0x9e3779b97f4a7c15ULL;
+    return linkedhashmap_mix(*state);
+}
+
+void generate_sequential(unsigned char* key, size_t index, uint64_t* state)
+{
+    (void)state;
+
+    uint64_t value = (uint64_t)index;
+    memcpy(key, &value, sizeof(value));
+}
+
+void generate_random(unsigned char* key, size_t index, uint64_t* state)
+{
+    (void)index;
+
+    uint64_t value = bench_random(state);
+    memcpy(key, &value, sizeof(value));
+}
+
+void generate_string(unsigned char* key, size_t key_size, size_t index)
+{
+    // Printable, unique per index, and padded with a fixed prefix like real identifiers
+    memset(key, 'k', key_size);
+
+    for (size_t i = key_size; i > 0 && index > 0; i--)
+    {
+        key[i - 1] = (unsigned char)('a' + index % 26);
+        index /= 26;
+    }
+}
+
+void generate_short_string(unsigned char* key, size_t index, uint64_t* state)
+{
+    (void)state;
+
+    generate_string(key, SHORT_STRING_SIZE, index);
+}
+
+void generate_long_string(unsigned char* key, size_t index, uint64_t* state)
+{
+    (void)state;
+
+    generate_string(key, LONG_STRING_SIZE, index);
+}
+
+uint64_t bench_unmix(uint64_t x, uint64_t m_inverse)
+{
+    x ^= x >> 47;
+    x *= m_inverse;
+    x ^= x >> 47;
+    return x;
+}
+
+void generate_collision(unsigned char* key, size_t index, uint64_t* state)
+{
+    (void)state;
+
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    uint64_t m_inverse = m;
+    uint64_t seed = linkedhashmap_process_seed();
+
+    // Each step of Newton's method doubles the number of correct low bits of the inverse
+    for (int i = 0; i < 6; i++)
+        m_inverse *= 2 - m * m_inverse;
+
+    // The first block is the index, and the second is solved for by running the default hash backwards from a value whose low 32 bits are zero, so every key lands in slot 0 of any table of up to 2^32 slots, the way an attacker who learned the seed would collide them
+    uint64_t first = (uint64_t)index;
+    uint64_t mixed = first * m;
+    mixed ^= mixed >> 47;
+    mixed *= m;
+
+    uint64_t after_first = ((seed ^ ((uint64_t)COLLISION_KEY_SIZE * m)) ^ mixed) * m;
+    uint64_t after_second = bench_unmix((uint64_t)index << 32, m_inverse);
+    uint64_t second = ((after_second * m_inverse) ^ after_first) * m_inverse;
+    second ^= second >> 47;
+    second *= m_inverse;
+
+    memcpy(key, &first, sizeof(first));
+    memcpy(key + sizeof(first), &second, sizeof(second));
+}
+
+BenchKeys* bench_keys_new(BenchDistribution* distribution, size_t size)
+{
+    BenchKeys* keys = (BenchKeys*)malloc(sizeof(BenchKeys));
+    uint64_t state = 0x5eed;
+
+    keys->size = size;
+    keys->keys = (void**)malloc(size * 2 * sizeof(void*));
+    keys->key_sizes = (size_t*)malloc(size * 2 * sizeof(size_t));
+    keys->storage = (unsigned char*)malloc(size * 2 * distribution->key_size);
+
+    for (size_t i = 0; i < size * 2; i++)
+    {
+        keys->keys[i] = keys->storage + i * distribution->key_size;
+        keys->key_sizes[i] = distribution->key_size;
+        distribution->generate(keys->storage + i * distribution->key_size, i, &state);
+    }
+
+    return keys;
+}
+
+void bench_keys_free(BenchKeys* keys)
+{
+    free(keys->keys);
+    free(keys->key_sizes);
+    free(keys->storage);
+    free(keys);
+}
+
+LinkedHashMap* bench_map_new(BenchContext* ctx, size_t offset)
+{
+    LinkedHashMap* map = linkedhashmap_new();
+
+    for (size_t i = offset; i < offset + ctx->size; i++)
+        free(linkedhashmap_set(map, ctx->keys->keys[i], ctx->keys->key_sizes[i], ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    return map;
+}
+
+void bench_set_new(BenchContext* ctx)
+{
+    LinkedHashMap* map = linkedhashmap_new();
+    double start = bench_now();
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_set(map, ctx->keys->keys[i], ctx->keys->key_sizes[i], ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_set_overwrite(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_set(map, ctx->keys->keys[i], ctx->keys->key_sizes[i], ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_clear_refill(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    linkedhashmap_clear(map);
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_set(map, ctx->keys->keys[i], ctx->keys->key_sizes[i], ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_get_hit(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_get(map, ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_get_hit_huge_pages(BenchContext* ctx)
+{
+    LinkedHashMap* map = linkedhashmap_new();
+    linkedhashmap_set_huge_pages(map, true, LINKEDHASHMAP_NUMA_DEFAULT);
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_set(map, ctx->keys->keys[i], ctx->keys->key_sizes[i], ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    double start = bench_now();
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_get(map, ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_small_maps(BenchContext* ctx)
+{
+    // Many maps of a few entries each, which never leave their inline tables
+    size_t per_map = LINKEDHASHMAP_SMALL_SIZE - 2;
+    size_t count = ctx->size / per_map * per_map;
+    double start = bench_now();
+
+    for (size_t i = 0; i < count; i += per_map)
+    {
+        LinkedHashMap* map = linkedhashmap_new();
+
+        for (size_t j = i; j < i + per_map; j++)
+            free(linkedhashmap_set(map, ctx->keys->keys[j], ctx->keys->key_sizes[j], ctx->keys->keys[j], ctx->keys->key_sizes[j]));
+
+        for (size_t j = i; j < i + per_map; j++)
+            free(linkedhashmap_get(map, ctx->keys->keys[j], ctx->keys->key_sizes[j]));
+
+        linkedhashmap_free(map);
+    }
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += count * 2;
+}
+
+void bench_get_miss(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    for (size_t i = ctx->size; i < ctx->size * 2; i++)
+        free(linkedhashmap_get(map, ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_contains(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    size_t found = 0;
+    double start = bench_now();
+
+    for (size_t i = 0; i < ctx->size * 2; i++)
+        found += linkedhashmap_contains(map, ctx->keys->keys[i], ctx->keys->key_sizes[i]);
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size * 2;
+
+    if (found != ctx->size)
+        fprintf(stderr, "contains found %" PRI_SIZE_T " of %" PRI_SIZE_T " keys\n", found, ctx->size);
+
+    linkedhashmap_free(map);
+}
+
+void bench_pop(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    for (size_t i = 0; i < ctx->size; i++)
+        free(linkedhashmap_pop(map, ctx->keys->keys[i], ctx->keys->key_sizes[i]));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_count_entry(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key;
+    (void)value;
+
+    *(size_t*)arg += key_size + value_size;
+}
+
+void bench_iterate(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    size_t total = 0;
+    double start = bench_now();
+
+    linkedhashmap_foreach(map, bench_count_entry, &total);
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_keys(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    free(linkedhashmap_keys(map));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_values(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    free(linkedhashmap_values(map));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_entries(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    free(linkedhashmap_entries(map));
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+void bench_copy(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    LinkedHashMap* map2 = linkedhashmap_copy(map);
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+}
+
+void bench_extend(BenchContext* ctx)
+{
+    // Half of the second map overlaps with the first
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    LinkedHashMap* map2 = bench_map_new(ctx, ctx->size / 2);
+    double start = bench_now();
+
+    linkedhashmap_extend(map, map2);
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+}
+
+void bench_intersect(BenchContext* ctx)
+{
+    // Half of the second map overlaps with the first
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    LinkedHashMap* map2 = bench_map_new(ctx, ctx->size / 2);
+    double start = bench_now();
+
+    LinkedHashMap* map3 = linkedhashmap_intersect(map, map2);
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+    linkedhashmap_free(map3);
+}
+
+void bench_equal(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    LinkedHashMap* map2 = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    if (!linkedhashmap_equal(map, map2))
+        fprintf(stderr, "equal maps compared unequal\n");
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+}
+
+void bench_resize(BenchContext* ctx)
+{
+    LinkedHashMap* map = bench_map_new(ctx, 0);
+    double start = bench_now();
+
+    linkedhashmap_resize_up(map);
+
+    ctx->seconds += bench_now() - start;
+    ctx->ops += ctx->size;
+    linkedhashmap_free(map);
+}
+
+Benchmark benchmarks[] = {
+    { "set_new", bench_set_new },
+    { "set_overwrite", bench_set_overwrite },
+    { "clear_refill", bench_clear_refill },
+    { "get_hit", bench_get_hit },
+    { "get_hit_huge_pages", bench_get_hit_huge_pages },
+    { "small_maps", bench_small_maps },
+    { "get_miss", bench_get_miss },
+    { "contains", bench_contains },
+    { "pop", bench_pop },
+    { "iterate", bench_iterate },
+    { "keys", bench_keys },
+    { "values", bench_values },
+    { "entries", bench_entries },
+    { "copy", bench_copy },
+    { "extend", bench_extend },
+    { "intersect", bench_intersect },
+    { "equal", bench_equal },
+    { "resize", bench_resize },
+};
+
+BenchDistribution distributions[] = {
+    { "sequential_int", sizeof(uint64_t), generate_sequential },
+    { "random_int", sizeof(uint64_t), generate_random },
+    { "short_string", SHORT_STRING_SIZE, generate_short_string },
+    { "long_string", LONG_STRING_SIZE, generate_long_string },
+    { "collision", COLLISION_KEY_SIZE, generate_collision },
+};
+
+size_t sizes[] = { 16, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+int main(int argc, char** argv)
+{
+    size_t max_size = BENCH_DEFAULT_MAX_SIZE;
+    size_t benchmark_count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    size_t distribution_count = sizeof(distributions) / sizeof(distributions[0]);
+    size_t size_count = sizeof(sizes) / sizeof(sizes[0]);
+    bool first = true;
+
+    if (argc > 1)
+        max_size = (size_t)strtoull(argv[1], NULL, 10);
+
+    printf("{\n  \"benchmarks\": [");
+
+    for (size_t d = 0; d < distribution_count; d++)
+    {
+        for (size_t s = 0; s < size_count && sizes[s] <= max_size; s++)
+        {
+            BenchKeys* keys = bench_keys_new(&(distributions[d]), sizes[s]);
+            double size_seconds = 0;
+
+            for (size_t b = 0; b < benchmark_count; b++)
+            {
+                BenchContext ctx;
+                ctx.keys = keys;
+                ctx.size = sizes[s];
+                ctx.seconds = 0;
+                ctx.ops = 0;
+
+                double start = bench_now();
+                size_t repetitions = 0;
+
+                do
+                {
+                    benchmarks[b].run(&ctx);
+                    repetitions++;
+                }
+                while (ctx.seconds < BENCH_MIN_SECONDS && bench_now() - start < BENCH_MAX_REPEAT_SECONDS);
+
+                size_seconds += (bench_now() - start) / (double)repetitions;
+
+                printf(
+                    "%s\n    { \"name\": \"%s\", \"distribution\": \"%s\", \"size\": %" PRI_SIZE_T ", \"ops\": %" PRI_SIZE_T ", \"seconds\": %.9f, \"ns_per_op\": %.3f }",
+                    first ? "" : ",",
+                    benchmarks[b].name,
+                    distributions[d].name,
+                    sizes[s],
+                    ctx.ops,
+                    ctx.seconds,
+                    ctx.seconds * 1e9 / (double)ctx.ops);
+                fflush(stdout);
+                first = false;
+            }
+
+            bench_keys_free(keys);
+
+            // A single run of every benchmark at the next size is projected from a single run at this size
+            if (s + 1 < size_count && size_seconds * (double)sizes[s + 1] / (double)sizes[s] > BENCH_SIZE_BUDGET_SECONDS)
+            {
+                fprintf(stderr, "skipping sizes above %" PRI_SIZE_T " for %s\n", sizes[s], distributions[d].name);
+                break;
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -1,450 +1,4712 @@
+#ifdef _WIN32
+#  define _CRT_RAND_S
+#endif
+
 #include "linkedhashmap.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#  include <io.h>
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  if defined(__linux__) || defined(__APPLE__)
+#    include <sys/random.h>
+#  endif
+#  ifdef __linux__
+#    include <sys/syscall.h>
+#    include <linux/mempolicy.h>
+#  endif
+#endif
+
+#include <errno.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define LINKEDHASHMAP_PREFETCH(address) __builtin_prefetch(address)
+#else
+#  define LINKEDHASHMAP_PREFETCH(address) ((void)(address))
+#endif
+
+#define LINKEDHASHMAP_IS_SMALL(capacity) ((capacity) <= LINKEDHASHMAP_SMALL_SIZE)
+#define LINKEDHASHMAP_MAX_CAPACITY (SIZE_MAX / sizeof(LinkedHashMapNode))
+#define LINKEDHASHMAP_MAX_LENGTH(capacity) (LINKEDHASHMAP_IS_SMALL(capacity) ? (capacity) : (capacity) - ((capacity) >> 3))
+#define LINKEDHASHMAP_NODE(map, index) ((map)->chunks == NULL ? &((map)->nodes[index]) : linkedhashmap_chunk_node((map)->nodes, (map)->chunks, (index)))
+#define LINKEDHASHMAP_WRITE(map, index) ((map)->chunks == NULL ? &((map)->nodes[index]) : linkedhashmap_chunk_write((map), (index)))
+#define LINKEDHASHMAP_JOURNAL(map, ...) do { if ((map)->journal != NULL || (map)->wal != NULL) linkedhashmap_journal_record((map), __VA_ARGS__); } while (0)
+
+#ifdef _WIN32
+#  define LINKEDHASHMAP_WAL_MAINTAIN(map) ((void)0)
+#else
+#  define LINKEDHASHMAP_WAL_MAINTAIN(map) do { if ((map)->wal != NULL && (map)->wal->compact_due) linkedhashmap_wal_compact(map); } while (0)
+#endif
+
+struct _LinkedHashMapShare
+{
+    atomic_size_t refs;
+    _Atomic(LinkedHashMapStorage*) storage;
+};
+
+static size_t linkedhashmap_chunk_length(size_t capacity, size_t chunk)
+{
+    size_t start = chunk * LINKEDHASHMAP_CHUNK_SIZE;
+    return capacity - start < LINKEDHASHMAP_CHUNK_SIZE ? capacity - start : LINKEDHASHMAP_CHUNK_SIZE;
+}
+
+static LinkedHashMapNode* linkedhashmap_chunk_node(LinkedHashMapNode* nodes, LinkedHashMapNode** chunks, size_t index)
+{
+    LinkedHashMapNode* chunk = chunks != NULL ? chunks[index / LINKEDHASHMAP_CHUNK_SIZE] : NULL;
+    return chunk != NULL ? &(chunk[index % LINKEDHASHMAP_CHUNK_SIZE]) : &(nodes[index]);
+}
+
+static LinkedHashMapNode* linkedhashmap_chunk_write(LinkedHashMap* map, size_t index)
+{
+    size_t chunk = index / LINKEDHASHMAP_CHUNK_SIZE;
+
+    // The first write to a chunk of a shared table copies just that chunk, and every later read of it goes to the copy
+    if (map->chunks[chunk] == NULL)
+    {
+        size_t length = linkedhashmap_chunk_length(map->capacity, chunk);
+        map->chunks[chunk] = (LinkedHashMapNode*)malloc(length * sizeof(LinkedHashMapNode));
+        memcpy(map->chunks[chunk], map->nodes + chunk * LINKEDHASHMAP_CHUNK_SIZE, length * sizeof(LinkedHashMapNode));
+    }
+
+    return &(map->chunks[chunk][index % LINKEDHASHMAP_CHUNK_SIZE]);
+}
+
+static void linkedhashmap_chunks_free(LinkedHashMapNode** chunks, size_t capacity)
+{
+    if (chunks == NULL)
+        return;
+
+    for (size_t i = 0; i * LINKEDHASHMAP_CHUNK_SIZE < capacity; i++)
+        free(chunks[i]);
+
+    free(chunks);
+}
+
+static LinkedHashMapNode** linkedhashmap_chunks_copy(LinkedHashMapNode** chunks, size_t capacity)
+{
+    if (chunks == NULL)
+        return NULL;
+
+    size_t count = (capacity + LINKEDHASHMAP_CHUNK_SIZE - 1) / LINKEDHASHMAP_CHUNK_SIZE;
+    LinkedHashMapNode** copy = (LinkedHashMapNode**)calloc(count, sizeof(LinkedHashMapNode*));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (chunks[i] != NULL)
+        {
+            size_t length = linkedhashmap_chunk_length(capacity, i);
+            copy[i] = (LinkedHashMapNode*)malloc(length * sizeof(LinkedHashMapNode));
+            memcpy(copy[i], chunks[i], length * sizeof(LinkedHashMapNode));
+        }
+    }
+
+    return copy;
+}
+
+static void linkedhashmap_chunks_flatten(LinkedHashMap* map)
+{
+    if (map->chunks == NULL)
+        return;
+
+    // Only called once the shared table belongs to this map alone, so the written chunks can go back into it
+    for (size_t i = 0; i * LINKEDHASHMAP_CHUNK_SIZE < map->capacity; i++)
+    {
+        if (map->chunks[i] != NULL)
+            memcpy(map->nodes + i * LINKEDHASHMAP_CHUNK_SIZE, map->chunks[i], linkedhashmap_chunk_length(map->capacity, i) * sizeof(LinkedHashMapNode));
+    }
+
+    linkedhashmap_chunks_free(map->chunks, map->capacity);
+    map->chunks = NULL;
+}
+
+LinkedHashMapNode* linkedhashmap_node(LinkedHashMap* map, size_t index)
+{
+    return LINKEDHASHMAP_NODE(map, index);
+}
+
+#if defined(LINKEDHASHMAP_STATS) || defined(LINKEDHASHMAP_LATENCY) || !defined(_WIN32)
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+static uint64_t linkedhashmap_clock_ns(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+#endif
+
+#ifdef LINKEDHASHMAP_LATENCY
+#  define LINKEDHASHMAP_TIMED(name) name##_untimed
+#else
+#  define LINKEDHASHMAP_TIMED(name) name
+#endif
+
+#ifdef LINKEDHASHMAP_STATS
+
+struct _LinkedHashMapStatsRecorder
+{
+    LinkedHashMapStats stats;
+    size_t sample_rate;
+    size_t sample_counter;
+};
+
+static LinkedHashMapStatsRecorder* linkedhashmap_stats_new(size_t sample_rate)
+{
+    LinkedHashMapStatsRecorder* recorder = (LinkedHashMapStatsRecorder*)calloc(1, sizeof(LinkedHashMapStatsRecorder));
+    recorder->sample_rate = sample_rate;
+    return recorder;
+}
+
+static void linkedhashmap_stats_record_probe(LinkedHashMap* map, bool hit, size_t probe_length)
+{
+    LinkedHashMapStatsRecorder* recorder = map->stats;
+
+    // Only one in every `sample_rate` lookups is recorded
+    if (++recorder->sample_counter < recorder->sample_rate)
+        return;
+
+    recorder->sample_counter = 0;
+    size_t bucket = 0;
+
+    while ((probe_length >>= 1) != 0 && bucket < LINKEDHASHMAP_STATS_PROBE_BUCKETS - 1)
+        bucket++;
+
+    if (hit)
+        recorder->stats.hit_probe_lengths[bucket]++;
+    else
+        recorder->stats.miss_probe_lengths[bucket]++;
+}
+
+static void linkedhashmap_stats_record_entry(LinkedHashMap* map)
+{
+    map->stats->stats.entries_allocated++;
+}
+
+#else
+#  define linkedhashmap_stats_record_probe(map, hit, probe_length) ((void)(map))
+#  define linkedhashmap_stats_record_entry(map) ((void)(map))
+#endif
 
 LinkedHashMap* linkedhashmap_new(void)
 {
-    return linkedhashmap_new_with_capacity(LINKEDHASHMAP_MIN_SIZE);
+    return linkedhashmap_new_with_capacity(0);
 }
 
 LinkedHashMap* linkedhashmap_new_with_capacity(size_t capacity)
 {
-    if (capacity < LINKEDHASHMAP_MIN_SIZE)
+    LinkedHashMap* map = (LinkedHashMap*)malloc(sizeof(LinkedHashMap));
+    linkedhashmap_init(map, capacity);
+    return map;
+}
+
+void linkedhashmap_init(LinkedHashMap* map, size_t capacity)
+{
+    linkedhashmap_init_with_buffer(map, NULL, capacity);
+}
+
+static void linkedhashmap_hash_init(LinkedHashMap* map)
+{
+    // The seed and SipHash key share their memory with the inline table, so they are set whenever the map moves to a hashed table
+    map->hash_seed = linkedhashmap_process_seed();
+
+    if (map->strong_hash)
+    {
+        map->strong_hash_key[0] = linkedhashmap_random_u64();
+        map->strong_hash_key[1] = linkedhashmap_random_u64();
+    }
+}
+
+void linkedhashmap_init_with_buffer(LinkedHashMap* map, LinkedHashMapNode* nodes, size_t capacity)
+{
+    // A buffer no larger than the inline table would gain nothing over it
+    if (LINKEDHASHMAP_IS_SMALL(capacity))
+    {
+        nodes = NULL;
+        capacity = LINKEDHASHMAP_SMALL_SIZE;
+    }
+    else if (nodes == NULL && capacity < LINKEDHASHMAP_MIN_SIZE)
         capacity = LINKEDHASHMAP_MIN_SIZE;
 
-    LinkedHashMap* map = (LinkedHashMap*)malloc(sizeof(LinkedHashMap));
+    map->huge_pages = false;
+    map->numa_node = LINKEDHASHMAP_NUMA_DEFAULT;
     map->length = 0;
     map->capacity = capacity;
-    map->nodes = (LinkedHashMapNode*)malloc(capacity * sizeof(LinkedHashMapNode));
-    map->head = NULL;
-    map->tail = NULL;
+
+    if (nodes != NULL)
+    {
+        map->nodes = nodes;
+        map->nodes_mapped = false;
+        map->nodes_owned = false;
+    }
+    else
+        map->nodes = linkedhashmap_nodes_alloc(map, capacity);
+
+    map->chunks = NULL;
+    map->head = LINKEDHASHMAP_NO_NODE;
+    map->tail = LINKEDHASHMAP_NO_NODE;
+    map->digests_enabled = false;
+    map->digest = 0;
+    map->order_digest = 0;
+    map->storage = NULL;
+    map->owned_storage = NULL;
+    map->storage_share = NULL;
+    map->strong_hash = false;
+    map->hash_flooded = false;
+    map->resize_threads = 1;
+    map->share = NULL;
+    map->journal = NULL;
+    map->wal = NULL;
+
+    map->latency = NULL;
+
+#ifdef LINKEDHASHMAP_STATS
+    map->stats = linkedhashmap_stats_new(1);
+#else
+    map->stats = NULL;
+#endif
 
     for (size_t i = 0; i < map->capacity; i++)
         map->nodes[i].is_allocated = false;
 
+    if (!LINKEDHASHMAP_IS_SMALL(map->capacity))
+        linkedhashmap_hash_init(map);
+}
+
+uint64_t linkedhashmap_random_u64(void)
+{
+    uint64_t value = 0;
+
+#if defined(_WIN32)
+    unsigned int half;
+
+    if (rand_s(&half) == 0)
+        value = half;
+
+    if (rand_s(&half) == 0)
+        value = (value << 32) | half;
+#elif defined(__linux__)
+    if (getrandom(&value, sizeof(value), 0) == (ssize_t)sizeof(value))
+        return value;
+#elif defined(__APPLE__)
+    if (getentropy(&value, sizeof(value)) == 0)
+        return value;
+#else
+    int fd = open("/dev/urandom", O_RDONLY);
+
+    if (fd >= 0)
+    {
+        ssize_t read_size = read(fd, &value, sizeof(value));
+        close(fd);
+
+        if (read_size == (ssize_t)sizeof(value))
+            return value;
+    }
+#endif
+
+    // If the system source is unavailable, fall back to something that at least differs between processes and calls
+    static atomic_uint_fast64_t counter = 0;
+    uint64_t local;
+    return linkedhashmap_mix(value ^ (uint64_t)(uintptr_t)&local ^ (uint64_t)atomic_fetch_add(&counter, 1) ^ ((uint64_t)time(NULL) << 20));
+}
+
+uint64_t linkedhashmap_process_seed(void)
+{
+    static atomic_uint_fast64_t seed = 0;
+    uint_fast64_t current = atomic_load(&seed);
+
+    if (current != 0)
+        return (uint64_t)current;
+
+    // Racing threads may each draw a seed, but only the first one to be published is ever used
+    uint_fast64_t candidate = linkedhashmap_random_u64() | 1;
+    atomic_compare_exchange_strong(&seed, &current, candidate);
+    return (uint64_t)atomic_load(&seed);
+}
+
+#define LINKEDHASHMAP_SIPROUND(v0, v1, v2, v3) \
+    do \
+    { \
+        v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+        v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+        v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+        v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+    } while (0)
+
+uint64_t linkedhashmap_siphash(const void* key, size_t key_size, uint64_t k0, uint64_t k1)
+{
+    const unsigned char* data = (const unsigned char*)key;
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    uint64_t last = (uint64_t)key_size << 56;
+    uint64_t m;
+
+    while (key_size >= 8)
+    {
+        m = 0;
+
+        for (size_t i = 0; i < 8; i++)
+            m |= (uint64_t)data[i] << (i * 8);
+
+        v3 ^= m;
+        LINKEDHASHMAP_SIPROUND(v0, v1, v2, v3);
+        LINKEDHASHMAP_SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+        data += 8;
+        key_size -= 8;
+    }
+
+    for (size_t i = 0; i < key_size; i++)
+        last |= (uint64_t)data[i] << (i * 8);
+
+    v3 ^= last;
+    LINKEDHASHMAP_SIPROUND(v0, v1, v2, v3);
+    LINKEDHASHMAP_SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+
+    for (int i = 0; i < 4; i++)
+        LINKEDHASHMAP_SIPROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint64_t linkedhashmap_hash_key(LinkedHashMap* map, void* key, size_t key_size)
+{
+    if (map->strong_hash)
+        return linkedhashmap_siphash(key, key_size, map->strong_hash_key[0], map->strong_hash_key[1]);
+
+    return linkedhashmap_hash_bytes(key, key_size, map->hash_seed);
+}
+
+size_t linkedhashmap_hash(LinkedHashMap* map, void* key, size_t key_size)
+{
+    return (size_t)(linkedhashmap_hash_key(map, key, key_size) % map->capacity);
+}
+
+uint64_t linkedhashmap_hash_bytes(const void* key, size_t key_size, uint64_t seed)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const unsigned char* data = (const unsigned char*)key;
+    uint64_t hashvalue = seed ^ ((uint64_t)key_size * m);
+    uint64_t k;
+
+    while (key_size >= 8)
+    {
+        memcpy(&k, data, sizeof(k));
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        hashvalue ^= k;
+        hashvalue *= m;
+        data += 8;
+        key_size -= 8;
+    }
+
+    if (key_size > 0)
+    {
+        for (size_t i = 0; i < key_size; i++)
+            hashvalue ^= (uint64_t)data[i] << (i * 8);
+
+        hashvalue *= m;
+    }
+
+    hashvalue ^= hashvalue >> 47;
+    hashvalue *= m;
+    hashvalue ^= hashvalue >> 47;
+
+    return hashvalue;
+}
+
+uint64_t linkedhashmap_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+bool linkedhashmap_mem_equal(void* p1, size_t size1, void* p2, size_t size2)
+{
+    if (size1 != size2)
+        return false;
+
+    return memcmp(p1, p2, size1) == 0;
+}
+
+uint64_t linkedhashmap_key_hash(void* key, size_t key_size)
+{
+    return linkedhashmap_hash_bytes(key, key_size, linkedhashmap_process_seed());
+}
+
+uint64_t linkedhashmap_resolve_hash(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash)
+{
+    // Precomputed hashes use the process seed, which a map stops using once it switches to its own SipHash key
+    if (!LINKEDHASHMAP_IS_SMALL(map->capacity) && (map->strong_hash || map->hash_seed != linkedhashmap_process_seed()))
+        return linkedhashmap_hash_key(map, key, key_size);
+
+    return hash;
+}
+
+size_t linkedhashmap_find_slot_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash, bool* found)
+{
+    // The inline table is kept dense, so it is searched by comparing every key in it, and the hash goes unused
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity))
+    {
+        for (size_t i = 0; i < map->length; i++)
+        {
+            if (linkedhashmap_mem_equal(key, key_size, map->nodes[i].key, map->nodes[i].key_size))
+            {
+                linkedhashmap_stats_record_probe(map, true, i + 1);
+                *found = true;
+                return i;
+            }
+        }
+
+        linkedhashmap_stats_record_probe(map, false, map->length);
+        *found = false;
+        return map->length < map->capacity ? map->length : ~(size_t)0;
+    }
+
+    size_t hashvalue = (size_t)(hash % map->capacity);
+    size_t current;
+
+    // Deletions shift entries back to close gaps, so a probe sequence never has an empty slot before the key it leads to
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        current = (hashvalue + i) % map->capacity;
+        LinkedHashMapNode* node = LINKEDHASHMAP_NODE(map, current);
+
+        if (!node->is_allocated)
+        {
+            linkedhashmap_stats_record_probe(map, false, i + 1);
+            *found = false;
+            return current;
+        }
+
+        if (linkedhashmap_mem_equal(key, key_size, node->key, node->key_size))
+        {
+            linkedhashmap_stats_record_probe(map, true, i + 1);
+            *found = true;
+            return current;
+        }
+    }
+
+    linkedhashmap_stats_record_probe(map, false, map->capacity);
+    *found = false;
+    return ~0;
+}
+
+static uint64_t linkedhashmap_lookup_hash(LinkedHashMap* map, void* key, size_t key_size)
+{
+    return LINKEDHASHMAP_IS_SMALL(map->capacity) ? 0 : linkedhashmap_hash_key(map, key, key_size);
+}
+
+size_t linkedhashmap_find_slot(LinkedHashMap* map, void* key, size_t key_size, bool* found)
+{
+    return linkedhashmap_find_slot_hashed(map, key, key_size, linkedhashmap_lookup_hash(map, key, key_size), found);
+}
+
+size_t linkedhashmap_find_key(LinkedHashMap* map, void* key, size_t key_size)
+{
+    bool found;
+    size_t index = linkedhashmap_find_slot(map, key, key_size, &found);
+    return found ? index : ~(size_t)0;
+}
+
+uint64_t linkedhashmap_entry_digest(LinkedHashMapNode* node)
+{
+    if (node == NULL)
+        return 0;
+
+    uint64_t key_hash = linkedhashmap_hash_bytes(node->key, node->key_size, 0);
+    uint64_t value_hash = linkedhashmap_hash_bytes(node->value, node->value_size, key_hash);
+    return linkedhashmap_mix(key_hash ^ linkedhashmap_mix(value_hash));
+}
+
+static uint64_t linkedhashmap_slot_digest(LinkedHashMap* map, size_t index)
+{
+    return index != LINKEDHASHMAP_NO_NODE ? linkedhashmap_entry_digest(LINKEDHASHMAP_NODE(map, index)) : 0;
+}
+
+uint64_t linkedhashmap_order_link_digest(uint64_t prev_digest, uint64_t next_digest)
+{
+    // Asymmetric, so that swapping two neighbors changes the result
+    return linkedhashmap_mix(prev_digest ^ linkedhashmap_mix(next_digest + 0x9e3779b97f4a7c15ULL));
+}
+
+void linkedhashmap_digest_link(LinkedHashMap* map, LinkedHashMapNode* node)
+{
+    if (!map->digests_enabled)
+        return;
+
+    uint64_t prev_digest = linkedhashmap_slot_digest(map, node->prev);
+    uint64_t next_digest = linkedhashmap_slot_digest(map, node->next);
+    uint64_t node_digest = linkedhashmap_entry_digest(node);
+
+    map->digest += node_digest;
+    map->order_digest -= linkedhashmap_order_link_digest(prev_digest, next_digest);
+    map->order_digest += linkedhashmap_order_link_digest(prev_digest, node_digest);
+    map->order_digest += linkedhashmap_order_link_digest(node_digest, next_digest);
+}
+
+void linkedhashmap_digest_unlink(LinkedHashMap* map, LinkedHashMapNode* node)
+{
+    if (!map->digests_enabled)
+        return;
+
+    uint64_t prev_digest = linkedhashmap_slot_digest(map, node->prev);
+    uint64_t next_digest = linkedhashmap_slot_digest(map, node->next);
+    uint64_t node_digest = linkedhashmap_entry_digest(node);
+
+    map->digest -= node_digest;
+    map->order_digest -= linkedhashmap_order_link_digest(prev_digest, node_digest);
+    map->order_digest -= linkedhashmap_order_link_digest(node_digest, next_digest);
+    map->order_digest += linkedhashmap_order_link_digest(prev_digest, next_digest);
+}
+
+void linkedhashmap_enable_digests(LinkedHashMap* map)
+{
+    size_t index = map->head;
+    uint64_t prev_digest = 0;
+    uint64_t current_digest;
+
+    map->digests_enabled = true;
+    map->digest = 0;
+    map->order_digest = 0;
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        current_digest = linkedhashmap_entry_digest(current);
+        map->digest += current_digest;
+        map->order_digest += linkedhashmap_order_link_digest(prev_digest, current_digest);
+        prev_digest = current_digest;
+        index = current->next;
+    }
+
+    map->order_digest += linkedhashmap_order_link_digest(prev_digest, 0);
+}
+
+void linkedhashmap_disable_digests(LinkedHashMap* map)
+{
+    map->digests_enabled = false;
+    map->digest = 0;
+    map->order_digest = 0;
+}
+
+uint64_t linkedhashmap_digest(LinkedHashMap* map)
+{
+    return map->digest;
+}
+
+uint64_t linkedhashmap_order_digest(LinkedHashMap* map)
+{
+    return map->order_digest;
+}
+
+size_t linkedhashmap_length(LinkedHashMap* map)
+{
+    return map->length;
+}
+
+bool linkedhashmap_is_empty(LinkedHashMap* map)
+{
+    return map->length == 0;
+}
+
+LinkedHashMapKey* linkedhashmap_keys(LinkedHashMap* map)
+{
+    LinkedHashMapKey* map_keys = (LinkedHashMapKey*)malloc(map->length * sizeof(LinkedHashMapKey));
+    size_t found = 0;
+    size_t index = map->head;
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        map_keys[found].key = current->key;
+        map_keys[found++].key_size = current->key_size;
+        index = current->next;
+    }
+
+    return map_keys;
+}
+
+LinkedHashMapValue* linkedhashmap_values(LinkedHashMap* map)
+{
+    LinkedHashMapValue* map_values = (LinkedHashMapValue*)malloc(map->length * sizeof(LinkedHashMapValue));
+    size_t found = 0;
+    size_t index = map->head;
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        map_values[found].value = current->value;
+        map_values[found++].value_size = current->value_size;
+        index = current->next;
+    }
+
+    return map_values;
+}
+
+LinkedHashMapEntry* linkedhashmap_entries(LinkedHashMap* map)
+{
+    LinkedHashMapEntry* map_entries = (LinkedHashMapEntry*)malloc(map->length * sizeof(LinkedHashMapEntry));
+    size_t found = 0;
+    size_t index = map->head;
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        map_entries[found].key = current->key;
+        map_entries[found].key_size = current->key_size;
+        map_entries[found].value = current->value;
+        map_entries[found++].value_size = current->value_size;
+        index = current->next;
+    }
+
+    return map_entries;
+}
+
+static size_t linkedhashmap_flood_threshold(size_t capacity, size_t length)
+{
+    if (length <= (capacity >> 1))
+        return LINKEDHASHMAP_FLOOD_PROBE_LENGTH;
+
+    // Probe sequences of random keys grow with the square of `1 / (1 - load)`, so the threshold does too, from its value at half full
+    double scale = (double)capacity / (double)(2 * (capacity - length));
+    return (size_t)((double)LINKEDHASHMAP_FLOOD_PROBE_LENGTH * scale * scale);
+}
+
+LinkedHashMapNode* linkedhashmap_insert_at(LinkedHashMap* map, size_t index, size_t home, void* key, size_t key_size, void* value, size_t value_size)
+{
+    LinkedHashMapNode* node = LINKEDHASHMAP_WRITE(map, index);
+    size_t probe_length = (index + map->capacity - home) % map->capacity;
+
+    // A probe sequence much longer than the load of the table explains is very unlikely unless the keys were chosen to collide
+    if (probe_length >= LINKEDHASHMAP_FLOOD_PROBE_LENGTH && !map->strong_hash && probe_length >= linkedhashmap_flood_threshold(map->capacity, map->length))
+        map->hash_flooded = true;
+
+    node->key = key;
+    node->key_size = key_size;
+    node->value = value;
+    node->value_size = value_size;
+    node->is_allocated = true;
+    node->prev = map->tail;
+    node->next = LINKEDHASHMAP_NO_NODE;
+
+    if (map->length == 0)
+        map->head = index;
+    else
+        LINKEDHASHMAP_WRITE(map, map->tail)->next = index;
+
+    map->tail = index;
+    map->length++;
+    return node;
+}
+
+LinkedHashMapNode* linkedhashmap_insert_new(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size)
+{
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity))
+        return map->length < map->capacity ? linkedhashmap_insert_at(map, map->length, map->length, key, key_size, value, value_size) : NULL;
+
+    size_t hashvalue = linkedhashmap_hash(map, key, key_size);
+    size_t current;
+
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        current = (hashvalue + i) % map->capacity;
+
+        if (!LINKEDHASHMAP_NODE(map, current)->is_allocated)
+            return linkedhashmap_insert_at(map, current, hashvalue, key, key_size, value, value_size);
+    }
+
+    return NULL;
+}
+
+LinkedHashMapNode* linkedhashmap_insert_missing(LinkedHashMap* map, size_t index, uint64_t hash, void* key, size_t key_size, void* value, size_t value_size)
+{
+    LinkedHashMapNode* node;
+
+    if (index != ~(size_t)0 && map->length < LINKEDHASHMAP_MAX_LENGTH(map->capacity))
+        node = linkedhashmap_insert_at(map, index, (size_t)(hash % map->capacity), key, key_size, value, value_size);
+    else
+    {
+        // Hashed tables grow once they are seven eighths full, so that a miss never has to probe far for a free slot
+        while (map->length >= LINKEDHASHMAP_MAX_LENGTH(map->capacity))
+            linkedhashmap_resize_up(map);
+
+        // The key is already known to be missing, so there is no need to look it up again after resizing
+        node = linkedhashmap_insert_new(map, key, key_size, value, value_size);
+    }
+
+    linkedhashmap_digest_link(map, node);
+    return node;
+}
+
+void linkedhashmap_move_node(LinkedHashMap* map, size_t from, size_t to)
+{
+    LinkedHashMapNode* node = LINKEDHASHMAP_WRITE(map, to);
+
+    *node = *LINKEDHASHMAP_NODE(map, from);
+    LINKEDHASHMAP_WRITE(map, from)->is_allocated = false;
+
+    if (node->prev != LINKEDHASHMAP_NO_NODE)
+        LINKEDHASHMAP_WRITE(map, node->prev)->next = to;
+    else
+        map->head = to;
+
+    if (node->next != LINKEDHASHMAP_NO_NODE)
+        LINKEDHASHMAP_WRITE(map, node->next)->prev = to;
+    else
+        map->tail = to;
+}
+
+void linkedhashmap_remove_at(LinkedHashMap* map, size_t index)
+{
+    size_t hole = index;
+    size_t current;
+
+    LINKEDHASHMAP_WRITE(map, index)->is_allocated = false;
+    map->length--;
+
+    // The inline table is kept dense by moving its last entry into the hole
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity))
+    {
+        if (index != map->length)
+            linkedhashmap_move_node(map, map->length, index);
+
+        return;
+    }
+
+    // Shift later entries of the cluster back into the hole, unless that would move them before their home slot
+    for (size_t i = 1; i < map->capacity; i++)
+    {
+        current = (index + i) % map->capacity;
+        LinkedHashMapNode* node = LINKEDHASHMAP_NODE(map, current);
+
+        if (!node->is_allocated)
+            break;
+
+        size_t home = linkedhashmap_hash(map, node->key, node->key_size);
+
+        if ((current + map->capacity - home) % map->capacity >= (current + map->capacity - hole) % map->capacity)
+        {
+            linkedhashmap_move_node(map, current, hole);
+            hole = current;
+        }
+    }
+}
+
+static void linkedhashmap_copy_nodes(LinkedHashMapNode* nodes, LinkedHashMapNode* old_nodes, LinkedHashMapNode** old_chunks, size_t capacity)
+{
+    // The table layout depends only on the capacity and hash state, and the order links hold slots, so the table can be duplicated as-is, with any chunks written since it was shared laid over it
+    memcpy(nodes, old_nodes, capacity * sizeof(LinkedHashMapNode));
+
+    if (old_chunks == NULL)
+        return;
+
+    for (size_t i = 0; i * LINKEDHASHMAP_CHUNK_SIZE < capacity; i++)
+    {
+        if (old_chunks[i] != NULL)
+            memcpy(nodes + i * LINKEDHASHMAP_CHUNK_SIZE, old_chunks[i], linkedhashmap_chunk_length(capacity, i) * sizeof(LinkedHashMapNode));
+    }
+}
+
+static void linkedhashmap_rebuild(LinkedHashMap* map, size_t new_size, const unsigned char* removed)
+{
+    LinkedHashMapNode* old_nodes = map->nodes;
+    LinkedHashMapNode** old_chunks = map->chunks;
+    size_t old_capacity = map->capacity;
+    bool old_mapped = map->nodes_mapped;
+    bool old_owned = map->nodes_owned;
+    size_t index = map->head;
+    LinkedHashMapNode small_nodes[LINKEDHASHMAP_SMALL_SIZE];
+
+    // The inline table may be rebuilt into itself, so its entries are read from a copy
+    if (old_nodes == map->small_nodes)
+    {
+        memcpy(small_nodes, old_nodes, old_capacity * sizeof(LinkedHashMapNode));
+        old_nodes = small_nodes;
+    }
+
+    map->length = 0;
+    map->capacity = new_size;
+    map->nodes = linkedhashmap_nodes_alloc(map, new_size);
+    map->chunks = NULL;
+    map->head = LINKEDHASHMAP_NO_NODE;
+    map->tail = LINKEDHASHMAP_NO_NODE;
+
+    for (size_t i = 0; i < map->capacity; i++)
+        map->nodes[i].is_allocated = false;
+
+    if (old_nodes == small_nodes && !LINKEDHASHMAP_IS_SMALL(new_size))
+        linkedhashmap_hash_init(map);
+
+    // Keys are already known to be unique, so each node goes straight into the first free slot of its probe sequence
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = linkedhashmap_chunk_node(old_nodes, old_chunks, index);
+
+        if (removed == NULL || !((removed[index >> 3] >> (index & 7)) & 1))
+            linkedhashmap_insert_new(map, current->key, current->key_size, current->value, current->value_size);
+
+        index = current->next;
+    }
+
+    // The old table is only read here, so a table shared with a snapshot can be left to it rather than copied first
+    linkedhashmap_chunks_free(old_chunks, old_capacity);
+
+    if (!linkedhashmap_release_share(map) && old_owned)
+        linkedhashmap_nodes_free(old_nodes, old_capacity, old_mapped);
+}
+
+void LINKEDHASHMAP_TIMED(linkedhashmap_resize)(LinkedHashMap* map, size_t new_size)
+{
+    size_t nthreads = linkedhashmap_thread_count(map->resize_threads);
+
+    if (nthreads > 1 && map->length >= LINKEDHASHMAP_PARALLEL_RESIZE_MIN_LENGTH)
+        linkedhashmap_resize_parallel(map, new_size, nthreads);
+    else
+        linkedhashmap_rebuild(map, new_size, NULL);
+}
+
+void linkedhashmap_use_strong_hash(LinkedHashMap* map)
+{
+    map->hash_flooded = false;
+
+    if (map->strong_hash)
+        return;
+
+    map->strong_hash = true;
+
+    // A map in its inline table draws its key once it moves to a hashed table
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity))
+        return;
+
+    map->strong_hash_key[0] = linkedhashmap_random_u64();
+    map->strong_hash_key[1] = linkedhashmap_random_u64();
+    linkedhashmap_resize(map, map->capacity);
+}
+
+void linkedhashmap_set_resize_threads(LinkedHashMap* map, size_t nthreads)
+{
+    map->resize_threads = nthreads;
+}
+
+#ifdef __linux__
+
+static void* linkedhashmap_map_huge_pages(size_t size, int numa_node)
+{
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (data == MAP_FAILED)
+    {
+        // Without reserved huge pages, the mapping is made one huge page larger, so it can be trimmed to start on a huge page boundary
+        unsigned char* raw = (unsigned char*)mmap(NULL, size + LINKEDHASHMAP_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (raw == MAP_FAILED)
+            return NULL;
+
+        size_t lead = (LINKEDHASHMAP_HUGE_PAGE_SIZE - (uintptr_t)raw % LINKEDHASHMAP_HUGE_PAGE_SIZE) % LINKEDHASHMAP_HUGE_PAGE_SIZE;
+
+        if (lead > 0)
+            munmap(raw, lead);
+
+        munmap(raw + lead + size, LINKEDHASHMAP_HUGE_PAGE_SIZE - lead);
+        data = raw + lead;
+
+#ifdef MADV_HUGEPAGE
+        madvise(data, size, MADV_HUGEPAGE);
+#endif
+    }
+
+#ifdef SYS_mbind
+    // The policy is set before any page is touched, so every page is placed by it. Kernels without NUMA support reject it, which leaves the default placement
+    if (numa_node == LINKEDHASHMAP_NUMA_INTERLEAVE)
+    {
+        unsigned long mask = ~0UL;
+        syscall(SYS_mbind, data, size, MPOL_INTERLEAVE, &mask, sizeof(mask) * 8 + 1, 0);
+    }
+    else if (numa_node >= 0)
+    {
+        size_t word_bits = sizeof(unsigned long) * 8;
+        size_t words = (size_t)numa_node / word_bits + 1;
+        unsigned long* mask = (unsigned long*)calloc(words, sizeof(unsigned long));
+
+        mask[numa_node / word_bits] = 1UL << (numa_node % word_bits);
+        syscall(SYS_mbind, data, size, MPOL_BIND, mask, (unsigned long)numa_node + 2, 0);
+        free(mask);
+    }
+#else
+    (void)numa_node;
+#endif
+
+    return data;
+}
+
+#endif
+
+LinkedHashMapNode* linkedhashmap_nodes_alloc(LinkedHashMap* map, size_t capacity)
+{
+    map->nodes_mapped = false;
+    map->nodes_owned = true;
+
+    if (LINKEDHASHMAP_IS_SMALL(capacity))
+        return map->small_nodes;
+
+#ifdef __linux__
+    size_t size = capacity * sizeof(LinkedHashMapNode);
+
+    // Smaller tables wouldn't fill a single huge page
+    if (map->huge_pages && size >= LINKEDHASHMAP_HUGE_PAGE_SIZE)
+    {
+        void* data = linkedhashmap_map_huge_pages((size + LINKEDHASHMAP_HUGE_PAGE_SIZE - 1) & ~(LINKEDHASHMAP_HUGE_PAGE_SIZE - 1), map->numa_node);
+
+        if (data != NULL)
+        {
+            map->nodes_mapped = true;
+            return (LinkedHashMapNode*)data;
+        }
+    }
+#endif
+
+    return (LinkedHashMapNode*)malloc(capacity * sizeof(LinkedHashMapNode));
+}
+
+void linkedhashmap_nodes_free(LinkedHashMapNode* nodes, size_t capacity, bool mapped)
+{
+    if (LINKEDHASHMAP_IS_SMALL(capacity))
+        return;
+
+#ifdef __linux__
+    if (mapped)
+    {
+        size_t size = capacity * sizeof(LinkedHashMapNode);
+        munmap(nodes, (size + LINKEDHASHMAP_HUGE_PAGE_SIZE - 1) & ~(LINKEDHASHMAP_HUGE_PAGE_SIZE - 1));
+        return;
+    }
+#else
+    (void)capacity;
+    (void)mapped;
+#endif
+
+    free(nodes);
+}
+
+void linkedhashmap_set_huge_pages(LinkedHashMap* map, bool enabled, int numa_node)
+{
+    LinkedHashMapNode* old_nodes = map->nodes;
+    bool old_mapped = map->nodes_mapped;
+    bool old_owned = map->nodes_owned;
+
+    map->huge_pages = enabled;
+    map->numa_node = numa_node;
+
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity))
+        return;
+
+    // The layout doesn't change, so the table is moved without rehashing
+    map->nodes = linkedhashmap_nodes_alloc(map, map->capacity);
+    linkedhashmap_copy_nodes(map->nodes, old_nodes, map->chunks, map->capacity);
+    linkedhashmap_chunks_free(map->chunks, map->capacity);
+    map->chunks = NULL;
+
+    if (!linkedhashmap_release_share(map) && old_owned)
+        linkedhashmap_nodes_free(old_nodes, map->capacity, old_mapped);
+}
+
+void linkedhashmap_resize_up(LinkedHashMap* map)
+{
+    size_t new_size = map->capacity << 1;
+
+#ifdef LINKEDHASHMAP_STATS
+    uint64_t start = linkedhashmap_clock_ns();
+    linkedhashmap_resize(map, new_size);
+    map->stats->stats.resize_up_count++;
+    map->stats->stats.resize_up_seconds += (double)(linkedhashmap_clock_ns() - start) * 1e-9;
+#else
+    linkedhashmap_resize(map, new_size);
+#endif
+}
+
+static size_t linkedhashmap_shrink_size(size_t capacity, size_t length)
+{
+    // Halving a table that is a quarter full leaves it half full, well short of where it grows again
+    while (length <= (capacity >> 2) && capacity > LINKEDHASHMAP_MIN_SIZE)
+        capacity = (capacity >> 1) < LINKEDHASHMAP_MIN_SIZE ? LINKEDHASHMAP_MIN_SIZE : capacity >> 1;
+
+    // The smallest hashed table only goes back to the inline table once half of that would be empty, so that a map hovering around the threshold isn't moved back and forth on every change
+    if (!LINKEDHASHMAP_IS_SMALL(capacity) && capacity <= LINKEDHASHMAP_MIN_SIZE && length <= (LINKEDHASHMAP_SMALL_SIZE >> 1))
+        capacity = LINKEDHASHMAP_SMALL_SIZE;
+
+    return capacity;
+}
+
+static size_t linkedhashmap_fit_size(size_t length)
+{
+    if (LINKEDHASHMAP_IS_SMALL(length))
+        return LINKEDHASHMAP_SMALL_SIZE;
+
+    // A miss probes up to the next free slot, so a hashed table is left at least a quarter empty rather than packed full
+    size_t capacity = LINKEDHASHMAP_MIN_SIZE;
+
+    while (capacity - (capacity >> 2) < length)
+    {
+        // No table could hold that many entries, and doubling any further would wrap around
+        if (capacity > (LINKEDHASHMAP_MAX_CAPACITY >> 1))
+            return 0;
+
+        capacity <<= 1;
+    }
+
+    return capacity;
+}
+
+void linkedhashmap_resize_down(LinkedHashMap* map)
+{
+    size_t new_size = map->capacity >> 1;
+
+    if (map->capacity <= LINKEDHASHMAP_MIN_SIZE)
+        new_size = LINKEDHASHMAP_SMALL_SIZE;
+    else if (new_size < LINKEDHASHMAP_MIN_SIZE)
+        new_size = LINKEDHASHMAP_MIN_SIZE;
+
+#ifdef LINKEDHASHMAP_STATS
+    uint64_t start = linkedhashmap_clock_ns();
+    linkedhashmap_resize(map, new_size);
+    map->stats->stats.resize_down_count++;
+    map->stats->stats.resize_down_seconds += (double)(linkedhashmap_clock_ns() - start) * 1e-9;
+#else
+    linkedhashmap_resize(map, new_size);
+#endif
+}
+
+bool linkedhashmap_reserve(LinkedHashMap* map, size_t capacity)
+{
+    size_t new_size = linkedhashmap_fit_size(capacity);
+
+    if (new_size == 0)
+        return false;
+
+    if (new_size > map->capacity)
+        linkedhashmap_resize(map, new_size);
+
+    return true;
+}
+
+void linkedhashmap_shrink_to_fit(LinkedHashMap* map)
+{
+    size_t new_size = linkedhashmap_fit_size(map->length);
+
+    if (new_size < map->capacity)
+        linkedhashmap_resize(map, new_size);
+}
+
+LinkedHashMapEntry* linkedhashmap_entry_new(LinkedHashMap* map, LinkedHashMapNode* node)
+{
+    LinkedHashMapEntry* res = (LinkedHashMapEntry*)malloc(sizeof(LinkedHashMapEntry));
+    res->key = node->key;
+    res->key_size = node->key_size;
+    res->value = node->value;
+    res->value_size = node->value_size;
+    linkedhashmap_stats_record_entry(map);
+    return res;
+}
+
+static LinkedHashMapEntry* linkedhashmap_get_with_hash(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash)
+{
+    bool found;
+    size_t index = linkedhashmap_find_slot_hashed(map, key, key_size, hash, &found);
+
+    if (!found)
+        return NULL;
+
+    return linkedhashmap_entry_new(map, LINKEDHASHMAP_NODE(map, index));
+}
+
+LinkedHashMapEntry* LINKEDHASHMAP_TIMED(linkedhashmap_get)(LinkedHashMap* map, void* key, size_t key_size)
+{
+    return linkedhashmap_get_with_hash(map, key, key_size, linkedhashmap_lookup_hash(map, key, key_size));
+}
+
+LinkedHashMapEntry* linkedhashmap_get_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash)
+{
+    return linkedhashmap_get_with_hash(map, key, key_size, linkedhashmap_resolve_hash(map, key, key_size, hash));
+}
+
+LinkedHashMapEntry* linkedhashmap_get_by_index(LinkedHashMap* map, size_t index)
+{
+    size_t current = map->head;
+
+    for (size_t i = 0; i < index && current != LINKEDHASHMAP_NO_NODE; i++)
+        current = LINKEDHASHMAP_NODE(map, current)->next;
+
+    if (current == LINKEDHASHMAP_NO_NODE)
+        return NULL;
+
+    return linkedhashmap_entry_new(map, LINKEDHASHMAP_NODE(map, current));
+}
+
+size_t linkedhashmap_get_index(LinkedHashMap* map, void* key, size_t key_size)
+{
+    size_t index = map->head;
+
+    for (size_t i = 0; index != LINKEDHASHMAP_NO_NODE; i++)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+
+        if (linkedhashmap_mem_equal(current->key, current->key_size, key, key_size))
+            return i;
+
+        index = current->next;
+    }
+
+    return ~0;
+}
+
+static LinkedHashMapEntry* linkedhashmap_set_with_hash(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size, uint64_t hash)
+{
+    LINKEDHASHMAP_WAL_MAINTAIN(map);
+
+    bool found;
+    size_t existing_index = linkedhashmap_find_slot_hashed(map, key, key_size, hash, &found);
+
+    linkedhashmap_unshare(map);
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_SET, NULL, 0, key, key_size, value, value_size);
+
+    if (!found)
+    {
+        linkedhashmap_insert_missing(map, existing_index, hash, key, key_size, value, value_size);
+
+        if (map->hash_flooded)
+            linkedhashmap_use_strong_hash(map);
+
+        return NULL;
+    }
+    else
+    {
+        LinkedHashMapNode* node = LINKEDHASHMAP_WRITE(map, existing_index);
+        LinkedHashMapEntry* res = linkedhashmap_entry_new(map, node);
+
+        linkedhashmap_digest_unlink(map, node);
+        node->value = value;
+        node->value_size = value_size;
+        linkedhashmap_digest_link(map, node);
+
+        return res;
+    }
+}
+
+LinkedHashMapEntry* LINKEDHASHMAP_TIMED(linkedhashmap_set)(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size)
+{
+    return linkedhashmap_set_with_hash(map, key, key_size, value, value_size, linkedhashmap_lookup_hash(map, key, key_size));
+}
+
+LinkedHashMapEntry* linkedhashmap_set_hashed(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size, uint64_t hash)
+{
+    return linkedhashmap_set_with_hash(map, key, key_size, value, value_size, linkedhashmap_resolve_hash(map, key, key_size, hash));
+}
+
+void** linkedhashmap_entry(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size, bool* inserted)
+{
+    if (inserted != NULL)
+        *inserted = false;
+
+    // The caller writes through the pointer after the change would be recorded, so a journal, log or digest would only ever see the value passed in here
+    if (map->digests_enabled || map->journal != NULL || map->wal != NULL)
+        return NULL;
+
+    LINKEDHASHMAP_WAL_MAINTAIN(map);
+
+    uint64_t hash = linkedhashmap_lookup_hash(map, key, key_size);
+    bool found;
+    size_t index = linkedhashmap_find_slot_hashed(map, key, key_size, hash, &found);
+
+    // The caller may write through the returned pointer, so the node has to be private even if the key exists
+    linkedhashmap_unshare(map);
+
+    if (inserted != NULL)
+        *inserted = !found;
+
+    if (found)
+        return &(LINKEDHASHMAP_WRITE(map, index)->value);
+
+    LinkedHashMapNode* node = linkedhashmap_insert_missing(map, index, hash, key, key_size, value, value_size);
+
+    // Switching hashes moves every node, so the new one has to be found again
+    if (map->hash_flooded)
+    {
+        linkedhashmap_use_strong_hash(map);
+        node = LINKEDHASHMAP_WRITE(map, linkedhashmap_find_key(map, key, key_size));
+    }
+
+    return &(node->value);
+}
+
+bool linkedhashmap_upsert(LinkedHashMap* map, void* key, size_t key_size, void (*fn)(void*, size_t, void**, size_t*, bool, void*), void* arg)
+{
+    LINKEDHASHMAP_WAL_MAINTAIN(map);
+
+    uint64_t hash = linkedhashmap_lookup_hash(map, key, key_size);
+    bool found;
+    size_t index = linkedhashmap_find_slot_hashed(map, key, key_size, hash, &found);
+    LinkedHashMapNode* node;
+
+    linkedhashmap_unshare(map);
+
+    if (found)
+    {
+        node = LINKEDHASHMAP_WRITE(map, index);
+        linkedhashmap_digest_unlink(map, node);
+        (*fn)(node->key, node->key_size, &(node->value), &(node->value_size), false, arg);
+        linkedhashmap_digest_link(map, node);
+        LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_SET, NULL, 0, node->key, node->key_size, node->value, node->value_size);
+        return false;
+    }
+
+    void* value = NULL;
+    size_t value_size = 0;
+
+    // The new value is produced before the entry is placed, so the digests only ever see the final value
+    (*fn)(key, key_size, &value, &value_size, true, arg);
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_SET, NULL, 0, key, key_size, value, value_size);
+    linkedhashmap_insert_missing(map, index, hash, key, key_size, value, value_size);
+
+    if (map->hash_flooded)
+        linkedhashmap_use_strong_hash(map);
+
+    return true;
+}
+
+void linkedhashmap_extend(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    size_t index = map2->head;
+
+    linkedhashmap_reserve(map1, map1->length + map2->length);
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map2, index);
+        LinkedHashMapEntry* res = linkedhashmap_set(map1, current->key, current->key_size, current->value, current->value_size);
+
+        if (res != NULL)
+            free(res);
+
+        index = current->next;
+    }
+}
+
+static size_t linkedhashmap_mark_shared(LinkedHashMap* map1, LinkedHashMap* map2, unsigned char* marks1, unsigned char* marks2)
+{
+    LinkedHashMapNode* batch[LINKEDHASHMAP_PROBE_BATCH];
+    size_t slots[LINKEDHASHMAP_PROBE_BATCH];
+    uint64_t hashes[LINKEDHASHMAP_PROBE_BATCH];
+    size_t shared = 0;
+
+    // Only the smaller map is walked, probing the larger one
+    if (map1->length > map2->length)
+    {
+        LinkedHashMap* map = map1;
+        unsigned char* marks = marks1;
+        map1 = map2;
+        map2 = map;
+        marks1 = marks2;
+        marks2 = marks;
+    }
+
+    size_t current = map1->head;
+
+    while (current != LINKEDHASHMAP_NO_NODE)
+    {
+        size_t count = 0;
+
+        // Every key of a batch is hashed and its home slot prefetched before any of them is probed, so that their cache misses overlap
+        for (; current != LINKEDHASHMAP_NO_NODE && count < LINKEDHASHMAP_PROBE_BATCH; current = batch[count++]->next)
+        {
+            batch[count] = LINKEDHASHMAP_NODE(map1, current);
+            slots[count] = current;
+            hashes[count] = linkedhashmap_lookup_hash(map2, batch[count]->key, batch[count]->key_size);
+            LINKEDHASHMAP_PREFETCH(LINKEDHASHMAP_NODE(map2, hashes[count] % map2->capacity));
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            bool found;
+            size_t index = linkedhashmap_find_slot_hashed(map2, batch[i]->key, batch[i]->key_size, hashes[i], &found);
+
+            if (!found)
+                continue;
+
+            if (marks1 != NULL)
+                marks1[slots[i]] = 1;
+
+            if (marks2 != NULL)
+                marks2[index] = 1;
+
+            shared++;
+        }
+    }
+
+    return shared;
+}
+
+static void linkedhashmap_append_marked(LinkedHashMap* result, LinkedHashMap* map, unsigned char* marks, bool marked)
+{
+    // The result is new, so the keys are known to be missing from it
+    for (size_t index = map->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map, index)->next)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+
+        if ((marks[index] != 0) == marked)
+            linkedhashmap_insert_missing(result, ~(size_t)0, 0, current->key, current->key_size, current->value, current->value_size);
+    }
+
+    if (result->hash_flooded)
+        linkedhashmap_use_strong_hash(result);
+}
+
+LinkedHashMap* linkedhashmap_intersect(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    unsigned char* marks = (unsigned char*)calloc(map1->capacity, 1);
+    LinkedHashMap* result = linkedhashmap_new_with_capacity(linkedhashmap_fit_size(linkedhashmap_mark_shared(map1, map2, marks, NULL)));
+
+    linkedhashmap_append_marked(result, map1, marks, true);
+    free(marks);
+    return result;
+}
+
+LinkedHashMap* linkedhashmap_difference(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    unsigned char* marks = (unsigned char*)calloc(map1->capacity, 1);
+    LinkedHashMap* result = linkedhashmap_new_with_capacity(linkedhashmap_fit_size(map1->length - linkedhashmap_mark_shared(map1, map2, marks, NULL)));
+
+    linkedhashmap_append_marked(result, map1, marks, false);
+    free(marks);
+    return result;
+}
+
+LinkedHashMap* linkedhashmap_symmetric_difference(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    unsigned char* marks1 = (unsigned char*)calloc(map1->capacity, 1);
+    unsigned char* marks2 = (unsigned char*)calloc(map2->capacity, 1);
+    size_t shared = linkedhashmap_mark_shared(map1, map2, marks1, marks2);
+    LinkedHashMap* result = linkedhashmap_new_with_capacity(linkedhashmap_fit_size(map1->length + map2->length - 2 * shared));
+
+    linkedhashmap_append_marked(result, map1, marks1, false);
+    linkedhashmap_append_marked(result, map2, marks2, false);
+    free(marks1);
+    free(marks2);
+    return result;
+}
+
+void linkedhashmap_union_into(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    unsigned char* marks = (unsigned char*)calloc(map2->capacity, 1);
+    size_t shared = linkedhashmap_mark_shared(map1, map2, NULL, marks);
+
+    linkedhashmap_reserve(map1, map1->length + map2->length - shared);
+
+    for (size_t index = map2->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map2, index)->next)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map2, index);
+
+        if (!marks[index])
+            linkedhashmap_set(map1, current->key, current->key_size, current->value, current->value_size);
+    }
+
+    free(marks);
+}
+
+static LinkedHashMapEntry* linkedhashmap_pop_with_hash(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash)
+{
+    LINKEDHASHMAP_WAL_MAINTAIN(map);
+
+    bool found;
+    size_t index = linkedhashmap_find_slot_hashed(map, key, key_size, hash, &found);
+
+    if (!found)
+        return NULL;
+
+    linkedhashmap_unshare(map);
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_POP, NULL, 0, key, key_size, NULL, 0);
+
+    LinkedHashMapNode* node = LINKEDHASHMAP_NODE(map, index);
+    LinkedHashMapEntry* res = linkedhashmap_entry_new(map, node);
+
+    linkedhashmap_order_unlink(map, node);
+    linkedhashmap_remove_at(map, index);
+
+    if (linkedhashmap_shrink_size(map->capacity, map->length) < map->capacity)
+        linkedhashmap_resize_down(map);
+
+    return res;
+}
+
+LinkedHashMapEntry* LINKEDHASHMAP_TIMED(linkedhashmap_pop)(LinkedHashMap* map, void* key, size_t key_size)
+{
+    return linkedhashmap_pop_with_hash(map, key, key_size, linkedhashmap_lookup_hash(map, key, key_size));
+}
+
+LinkedHashMapEntry* linkedhashmap_pop_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash)
+{
+    return linkedhashmap_pop_with_hash(map, key, key_size, linkedhashmap_resolve_hash(map, key, key_size, hash));
+}
+
+void linkedhashmap_order_unlink(LinkedHashMap* map, LinkedHashMapNode* node)
+{
+    linkedhashmap_digest_unlink(map, node);
+
+    if (node->prev != LINKEDHASHMAP_NO_NODE)
+        LINKEDHASHMAP_WRITE(map, node->prev)->next = node->next;
+    else
+        map->head = node->next;
+
+    if (node->next != LINKEDHASHMAP_NO_NODE)
+        LINKEDHASHMAP_WRITE(map, node->next)->prev = node->prev;
+    else
+        map->tail = node->prev;
+}
+
+void linkedhashmap_order_link_after(LinkedHashMap* map, size_t index, size_t anchor)
+{
+    LinkedHashMapNode* node = LINKEDHASHMAP_WRITE(map, index);
+
+    node->prev = anchor;
+    node->next = anchor != LINKEDHASHMAP_NO_NODE ? LINKEDHASHMAP_NODE(map, anchor)->next : map->head;
+
+    if (node->prev != LINKEDHASHMAP_NO_NODE)
+        LINKEDHASHMAP_WRITE(map, node->prev)->next = index;
+    else
+        map->head = index;
+
+    if (node->next != LINKEDHASHMAP_NO_NODE)
+        LINKEDHASHMAP_WRITE(map, node->next)->prev = index;
+    else
+        map->tail = index;
+
+    linkedhashmap_digest_link(map, node);
+}
+
+bool linkedhashmap_move_to_end(LinkedHashMap* map, void* key, size_t key_size)
+{
+    size_t index = linkedhashmap_find_key(map, key, key_size);
+
+    if (index == ~(size_t)0)
+        return false;
+
+    linkedhashmap_unshare(map);
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_MOVE_TO_END, NULL, 0, key, key_size, NULL, 0);
+
+    if (index != map->tail)
+    {
+        linkedhashmap_order_unlink(map, LINKEDHASHMAP_NODE(map, index));
+        linkedhashmap_order_link_after(map, index, map->tail);
+    }
+
+    return true;
+}
+
+bool linkedhashmap_move_to_front(LinkedHashMap* map, void* key, size_t key_size)
+{
+    size_t index = linkedhashmap_find_key(map, key, key_size);
+
+    if (index == ~(size_t)0)
+        return false;
+
+    linkedhashmap_unshare(map);
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_MOVE_TO_FRONT, NULL, 0, key, key_size, NULL, 0);
+
+    if (index != map->head)
+    {
+        linkedhashmap_order_unlink(map, LINKEDHASHMAP_NODE(map, index));
+        linkedhashmap_order_link_after(map, index, LINKEDHASHMAP_NO_NODE);
+    }
+
+    return true;
+}
+
+static bool linkedhashmap_insert_relative(LinkedHashMap* map, void* anchor_key, size_t anchor_key_size, void* key, size_t key_size, void* value, size_t value_size, bool before)
+{
+    size_t anchor_index = linkedhashmap_find_key(map, anchor_key, anchor_key_size);
+
+    if (anchor_index == ~(size_t)0)
+        return false;
+
+    linkedhashmap_unshare(map);
+    LINKEDHASHMAP_JOURNAL(map, before ? LINKEDHASHMAP_JOURNAL_INSERT_BEFORE : LINKEDHASHMAP_JOURNAL_INSERT_AFTER, anchor_key, anchor_key_size, key, key_size, value, value_size);
+
+    size_t existing_index = linkedhashmap_find_key(map, key, key_size);
+    LinkedHashMapNode* node;
+
+    if (existing_index == anchor_index)
+    {
+        // Placing an entry next to itself leaves it where it is
+        node = LINKEDHASHMAP_WRITE(map, existing_index);
+        linkedhashmap_digest_unlink(map, node);
+        node->value = value;
+        node->value_size = value_size;
+        linkedhashmap_digest_link(map, node);
+        return true;
+    }
+
+    if (existing_index != ~(size_t)0)
+    {
+        node = LINKEDHASHMAP_WRITE(map, existing_index);
+        linkedhashmap_order_unlink(map, node);
+        node->value = value;
+        node->value_size = value_size;
+    }
+    else
+    {
+        // Resizing moves every node, so the anchor has to be found again afterwards
+        if (map->length >= LINKEDHASHMAP_MAX_LENGTH(map->capacity))
+        {
+            linkedhashmap_resize_up(map);
+            anchor_index = linkedhashmap_find_key(map, anchor_key, anchor_key_size);
+        }
+
+        node = linkedhashmap_insert_missing(map, ~(size_t)0, 0, key, key_size, value, value_size);
+        existing_index = map->tail;
+        linkedhashmap_order_unlink(map, node);
+    }
+
+    linkedhashmap_order_link_after(map, existing_index, before ? LINKEDHASHMAP_NODE(map, anchor_index)->prev : anchor_index);
+
+    if (map->hash_flooded)
+        linkedhashmap_use_strong_hash(map);
+
+    return true;
+}
+
+bool linkedhashmap_insert_before(LinkedHashMap* map, void* anchor_key, size_t anchor_key_size, void* key, size_t key_size, void* value, size_t value_size)
+{
+    return linkedhashmap_insert_relative(map, anchor_key, anchor_key_size, key, key_size, value, value_size, true);
+}
+
+bool linkedhashmap_insert_after(LinkedHashMap* map, void* anchor_key, size_t anchor_key_size, void* key, size_t key_size, void* value, size_t value_size)
+{
+    return linkedhashmap_insert_relative(map, anchor_key, anchor_key_size, key, key_size, value, value_size, false);
+}
+
+static bool linkedhashmap_peek_node(LinkedHashMap* map, size_t index, LinkedHashMapEntry* entry)
+{
+    if (index == LINKEDHASHMAP_NO_NODE)
+        return false;
+
+    LinkedHashMapNode* node = LINKEDHASHMAP_NODE(map, index);
+
+    if (entry != NULL)
+    {
+        entry->key = node->key;
+        entry->key_size = node->key_size;
+        entry->value = node->value;
+        entry->value_size = node->value_size;
+    }
+
+    return true;
+}
+
+static bool linkedhashmap_remove_node(LinkedHashMap* map, size_t index, LinkedHashMapEntry* entry)
+{
+    LINKEDHASHMAP_WAL_MAINTAIN(map);
+
+    if (!linkedhashmap_peek_node(map, index, entry))
+        return false;
+
+    LinkedHashMapNode* node = LINKEDHASHMAP_NODE(map, index);
+
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_POP, NULL, 0, node->key, node->key_size, NULL, 0);
+    linkedhashmap_unshare(map);
+    node = LINKEDHASHMAP_NODE(map, index);
+
+    linkedhashmap_order_unlink(map, node);
+    linkedhashmap_remove_at(map, index);
+    return true;
+}
+
+bool linkedhashmap_pop_front(LinkedHashMap* map, LinkedHashMapEntry* entry)
+{
+    return linkedhashmap_remove_node(map, map->head, entry);
+}
+
+bool linkedhashmap_pop_back(LinkedHashMap* map, LinkedHashMapEntry* entry)
+{
+    return linkedhashmap_remove_node(map, map->tail, entry);
+}
+
+bool linkedhashmap_peek_front(LinkedHashMap* map, LinkedHashMapEntry* entry)
+{
+    return linkedhashmap_peek_node(map, map->head, entry);
+}
+
+bool linkedhashmap_peek_back(LinkedHashMap* map, LinkedHashMapEntry* entry)
+{
+    return linkedhashmap_peek_node(map, map->tail, entry);
+}
+
+size_t linkedhashmap_drain_front(LinkedHashMap* map, LinkedHashMapEntry* entries, size_t count)
+{
+    size_t drained = 0;
+
+    while (drained < count && linkedhashmap_remove_node(map, map->head, entries != NULL ? &(entries[drained]) : NULL))
+        drained++;
+
+    return drained;
+}
+
+static size_t linkedhashmap_remove_marked(LinkedHashMap* map, unsigned char* removed, size_t count)
+{
+    if (count == 0)
+    {
+        free(removed);
+        return 0;
+    }
+
+    // Shrink as far as the same number of pops would have, but in a single step
+    size_t new_size = linkedhashmap_shrink_size(map->capacity, map->length - count);
+
+#ifdef LINKEDHASHMAP_STATS
+    uint64_t start = linkedhashmap_clock_ns();
+    linkedhashmap_rebuild(map, new_size, removed);
+
+    if (new_size < map->capacity)
+    {
+        map->stats->stats.resize_down_count++;
+        map->stats->stats.resize_down_seconds += (double)(linkedhashmap_clock_ns() - start) * 1e-9;
+    }
+#else
+    linkedhashmap_rebuild(map, new_size, removed);
+#endif
+
+    if (map->digests_enabled)
+        linkedhashmap_enable_digests(map);
+
+    free(removed);
+    return count;
+}
+
+size_t linkedhashmap_retain(LinkedHashMap* map, bool (*pred)(void*, size_t, void*, size_t, void*), void* arg)
+{
+    unsigned char* removed = (unsigned char*)calloc((map->capacity + 7) >> 3, 1);
+    size_t count = 0;
+
+    for (size_t index = map->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map, index)->next)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+
+        if (!(*pred)(current->key, current->key_size, current->value, current->value_size, arg))
+        {
+            removed[index >> 3] |= (unsigned char)(1 << (index & 7));
+            count++;
+            LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_POP, NULL, 0, current->key, current->key_size, NULL, 0);
+        }
+    }
+
+    return linkedhashmap_remove_marked(map, removed, count);
+}
+
+size_t linkedhashmap_remove_range(LinkedHashMap* map, size_t start_index, size_t count)
+{
+    unsigned char* removed = (unsigned char*)calloc((map->capacity + 7) >> 3, 1);
+    size_t index = map->head;
+    size_t removed_count = 0;
+
+    for (size_t i = 0; i < start_index && index != LINKEDHASHMAP_NO_NODE; i++)
+        index = LINKEDHASHMAP_NODE(map, index)->next;
+
+    for (; removed_count < count && index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map, index)->next)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        removed[index >> 3] |= (unsigned char)(1 << (index & 7));
+        removed_count++;
+        LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_POP, NULL, 0, current->key, current->key_size, NULL, 0);
+    }
+
+    return linkedhashmap_remove_marked(map, removed, removed_count);
+}
+
+void linkedhashmap_delete(LinkedHashMap* map, void* key, size_t key_size)
+{
+    LinkedHashMapEntry* res = linkedhashmap_pop(map, key, key_size);
+
+    if (res != NULL)
+        free(res);
+}
+
+bool linkedhashmap_contains(LinkedHashMap* map, void* key, size_t key_size)
+{
+    return linkedhashmap_find_key(map, key, key_size) != ~(size_t)0;
+}
+
+bool linkedhashmap_contains_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash)
+{
+    bool found;
+    linkedhashmap_find_slot_hashed(map, key, key_size, linkedhashmap_resolve_hash(map, key, key_size, hash), &found);
+    return found;
+}
+
+bool linkedhashmap_equal(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    if (map1->length != map2->length)
+        return false;
+
+    if (map1->digests_enabled && map2->digests_enabled && map1->digest != map2->digest)
+        return false;
+
+    for (size_t i = 0; i < map1->capacity; i++)
+    {
+        LinkedHashMapNode* node = LINKEDHASHMAP_NODE(map1, i);
+
+        if (node->is_allocated)
+        {
+            size_t index = linkedhashmap_find_key(map2, node->key, node->key_size);
+
+            if (index == ~(size_t)0
+                || !linkedhashmap_mem_equal(node->value, node->value_size, LINKEDHASHMAP_NODE(map2, index)->value, LINKEDHASHMAP_NODE(map2, index)->value_size))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool linkedhashmap_equal_with_insertion_order(LinkedHashMap* map1, LinkedHashMap* map2)
+{
+    if (map1->length != map2->length)
+        return false;
+
+    if (map1->digests_enabled && map2->digests_enabled
+        && (map1->digest != map2->digest || map1->order_digest != map2->order_digest))
+        return false;
+
+    size_t index1 = map1->head;
+    size_t index2 = map2->head;
+
+    while (index1 != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current1 = LINKEDHASHMAP_NODE(map1, index1);
+        LinkedHashMapNode* current2 = LINKEDHASHMAP_NODE(map2, index2);
+
+        if (!linkedhashmap_mem_equal(current1->key, current1->key_size, current2->key, current2->key_size)
+            || !linkedhashmap_mem_equal(current1->value, current1->value_size, current2->value, current2->value_size))
+            return false;
+
+        index1 = current1->next;
+        index2 = current2->next;
+    }
+
+    return true;
+}
+
+static void linkedhashmap_diff_mark_moved(size_t* positions, size_t* common, size_t count, size_t* tails, size_t* previous)
+{
+    size_t length = 0;
+
+    // Find the longest run of shared keys whose positions in the second map increase in the order of the first map
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t position = positions[common[i]];
+        size_t low = 0;
+        size_t high = length;
+
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+
+            if (positions[common[tails[middle]]] < position)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        previous[i] = low > 0 ? tails[low - 1] : ~(size_t)0;
+        tails[low] = i;
+
+        if (low == length)
+            length++;
+    }
+
+    // Shared keys are marked `~1` if they keep their place, and `~0` if they have to move
+    for (size_t i = 0; i < count; i++)
+        positions[common[i]] = ~(size_t)0;
+
+    for (size_t i = length > 0 ? tails[length - 1] : ~(size_t)0; i != ~(size_t)0; i = previous[i])
+        positions[common[i]] = ~(size_t)1;
+}
+
+void linkedhashmap_diff(LinkedHashMap* map1, LinkedHashMap* map2, void (*on_added)(void*, size_t, void*, size_t, void*), void (*on_removed)(void*, size_t, void*, size_t, void*), void (*on_changed)(void*, size_t, void*, size_t, void*, size_t, void*), void (*on_moved)(void*, size_t, void*, size_t, void*), void* arg)
+{
+    size_t common_capacity = map1->length < map2->length ? map1->length : map2->length;
+    size_t* positions = NULL;
+    size_t* common = NULL;
+    size_t common_count = 0;
+
+    // Order changes need the position of every entry of the second map, indexed by slot
+    if (on_moved != NULL)
+    {
+        positions = (size_t*)malloc((map2->capacity + 3 * common_capacity) * sizeof(size_t));
+        common = positions + map2->capacity;
+        size_t position = 0;
+
+        for (size_t index = map2->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map2, index)->next)
+            positions[index] = position++;
+    }
+
+    for (size_t slot = map1->head; slot != LINKEDHASHMAP_NO_NODE; slot = LINKEDHASHMAP_NODE(map1, slot)->next)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map1, slot);
+        size_t index = linkedhashmap_find_key(map2, current->key, current->key_size);
+
+        if (index == ~(size_t)0)
+        {
+            if (on_removed != NULL)
+                on_removed(current->key, current->key_size, current->value, current->value_size, arg);
+
+            continue;
+        }
+
+        LinkedHashMapNode* other = LINKEDHASHMAP_NODE(map2, index);
+
+        if (on_changed != NULL && !linkedhashmap_mem_equal(current->value, current->value_size, other->value, other->value_size))
+            on_changed(current->key, current->key_size, current->value, current->value_size, other->value, other->value_size, arg);
+
+        if (positions != NULL)
+            common[common_count++] = index;
+    }
+
+    if (positions != NULL)
+        linkedhashmap_diff_mark_moved(positions, common, common_count, common + common_capacity, common + 2 * common_capacity);
+    else if (on_added == NULL)
+        return;
+
+    for (size_t index = map2->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map2, index)->next)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map2, index);
+
+        // Once shared keys are marked, anything left unmarked is new without having to look it up
+        bool added = positions != NULL
+            ? positions[index] < ~(size_t)1
+            : linkedhashmap_find_key(map1, current->key, current->key_size) == ~(size_t)0;
+
+        if (added)
+        {
+            if (on_added != NULL)
+                on_added(current->key, current->key_size, current->value, current->value_size, arg);
+        }
+        else if (positions != NULL && positions[index] == ~(size_t)0)
+            on_moved(current->key, current->key_size, current->value, current->value_size, arg);
+    }
+
+    free(positions);
+}
+
+void linkedhashmap_clear(LinkedHashMap* map)
+{
+    LINKEDHASHMAP_JOURNAL(map, LINKEDHASHMAP_JOURNAL_CLEAR, NULL, 0, NULL, 0, NULL, 0);
+
+    // A table shared with a snapshot is left to it, and replaced with an empty one of the same size
+    if (linkedhashmap_release_share(map))
+    {
+        linkedhashmap_chunks_free(map->chunks, map->capacity);
+        map->chunks = NULL;
+        map->nodes = linkedhashmap_nodes_alloc(map, map->capacity);
+
+        for (size_t i = 0; i < map->capacity; i++)
+            map->nodes[i].is_allocated = false;
+    }
+    else
+    {
+        linkedhashmap_chunks_flatten(map);
+
+        // Only the slots in use need to be freed, and the order links lead straight to them
+        for (size_t index = map->head; index != LINKEDHASHMAP_NO_NODE; index = map->nodes[index].next)
+            map->nodes[index].is_allocated = false;
+    }
+
+    map->length = 0;
+    map->head = LINKEDHASHMAP_NO_NODE;
+    map->tail = LINKEDHASHMAP_NO_NODE;
+
+    if (map->digests_enabled)
+        linkedhashmap_enable_digests(map);
+}
+
+static LinkedHashMapShare* linkedhashmap_storage_lend(LinkedHashMap* map)
+{
+    if (map->storage == NULL && map->owned_storage == NULL && map->storage_share == NULL)
+        return NULL;
+
+    // Copies and snapshots point at the keys and values the map owns, so while any of them is alive nothing it owns is freed early
+    if (map->storage_share == NULL)
+    {
+        map->storage_share = (LinkedHashMapShare*)malloc(sizeof(LinkedHashMapShare));
+        atomic_init(&(map->storage_share->refs), 1);
+        atomic_init(&(map->storage_share->storage), NULL);
+    }
+
+    atomic_fetch_add(&(map->storage_share->refs), 1);
+    return map->storage_share;
+}
+
+LinkedHashMap* linkedhashmap_copy(LinkedHashMap* map)
+{
+    LinkedHashMap* new_map = (LinkedHashMap*)malloc(sizeof(LinkedHashMap));
+    new_map->length = map->length;
+    new_map->capacity = map->capacity;
+    new_map->huge_pages = map->huge_pages;
+    new_map->numa_node = map->numa_node;
+    new_map->nodes = linkedhashmap_nodes_alloc(new_map, map->capacity);
+    new_map->chunks = NULL;
+    new_map->head = map->head;
+    new_map->tail = map->tail;
+    new_map->digests_enabled = map->digests_enabled;
+    new_map->digest = map->digest;
+    new_map->order_digest = map->order_digest;
+    new_map->storage = NULL;
+    new_map->owned_storage = NULL;
+    new_map->storage_share = linkedhashmap_storage_lend(map);
+    new_map->strong_hash = map->strong_hash;
+    new_map->hash_flooded = false;
+
+    if (!LINKEDHASHMAP_IS_SMALL(map->capacity))
+    {
+        new_map->hash_seed = map->hash_seed;
+        new_map->strong_hash_key[0] = map->strong_hash_key[0];
+        new_map->strong_hash_key[1] = map->strong_hash_key[1];
+    }
+
+    new_map->resize_threads = map->resize_threads;
+    new_map->share = NULL;
+    new_map->journal = NULL;
+    new_map->wal = NULL;
+
+    new_map->latency = NULL;
+
+#ifdef LINKEDHASHMAP_STATS
+    new_map->stats = linkedhashmap_stats_new(map->stats->sample_rate);
+#else
+    new_map->stats = NULL;
+#endif
+
+    linkedhashmap_copy_nodes(new_map->nodes, map->nodes, map->chunks, map->capacity);
+    return new_map;
+}
+
+static void linkedhashmap_materialize(LinkedHashMap* map)
+{
+    if (map->share == NULL)
+        return;
+
+    // Once every snapshot is gone the table belongs to this map alone, and nothing else can take a new reference to it
+    if (atomic_load(&(map->share->refs)) == 1)
+    {
+        linkedhashmap_chunks_flatten(map);
+        free(map->share);
+        map->share = NULL;
+        return;
+    }
+
+    LinkedHashMapNode* old_nodes = map->nodes;
+    bool old_mapped = map->nodes_mapped;
+
+    map->nodes = linkedhashmap_nodes_alloc(map, map->capacity);
+    linkedhashmap_copy_nodes(map->nodes, old_nodes, map->chunks, map->capacity);
+    linkedhashmap_chunks_free(map->chunks, map->capacity);
+    map->chunks = NULL;
+
+    // The last snapshot may have been freed while the table was being copied
+    if (!linkedhashmap_release_share(map))
+        linkedhashmap_nodes_free(old_nodes, map->capacity, old_mapped);
+}
+
+LinkedHashMap* linkedhashmap_snapshot(LinkedHashMap* map)
+{
+    // An inline table can't be shared, but is no larger than the map itself, and a buffer supplied by the caller may not outlive the map
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity) || !map->nodes_owned)
+        return linkedhashmap_copy(map);
+
+    // A table no longer shared with anything takes back the chunks written to it, so that the new snapshot has as few as possible to copy
+    if (map->share != NULL && atomic_load(&(map->share->refs)) == 1)
+        linkedhashmap_materialize(map);
+
+    if (map->share == NULL)
+    {
+        map->share = (LinkedHashMapShare*)malloc(sizeof(LinkedHashMapShare));
+        atomic_init(&(map->share->refs), 1);
+        atomic_init(&(map->share->storage), NULL);
+    }
+
+    atomic_fetch_add(&(map->share->refs), 1);
+
+    LinkedHashMap* snapshot = (LinkedHashMap*)malloc(sizeof(LinkedHashMap));
+    *snapshot = *map;
+    snapshot->chunks = linkedhashmap_chunks_copy(map->chunks, map->capacity);
+    snapshot->storage = NULL;
+    snapshot->owned_storage = NULL;
+    snapshot->storage_share = linkedhashmap_storage_lend(map);
+    snapshot->journal = NULL;
+    snapshot->wal = NULL;
+    snapshot->hash_flooded = false;
+
+    snapshot->latency = NULL;
+
+#ifdef LINKEDHASHMAP_STATS
+    snapshot->stats = linkedhashmap_stats_new(map->stats->sample_rate);
+#else
+    snapshot->stats = NULL;
+#endif
+
+    return snapshot;
+}
+
+void linkedhashmap_unshare(LinkedHashMap* map)
+{
+    if (map->share == NULL)
+        return;
+
+    if (atomic_load(&(map->share->refs)) == 1)
+    {
+        linkedhashmap_materialize(map);
+        return;
+    }
+
+    // While the table is shared, each write copies only the chunk it lands in, so the rest stays shared
+    if (map->chunks == NULL)
+        map->chunks = (LinkedHashMapNode**)calloc((map->capacity + LINKEDHASHMAP_CHUNK_SIZE - 1) / LINKEDHASHMAP_CHUNK_SIZE, sizeof(LinkedHashMapNode*));
+}
+
+bool linkedhashmap_release_share(LinkedHashMap* map)
+{
+    LinkedHashMapShare* share = map->share;
+
+    if (share == NULL)
+        return false;
+
+    map->share = NULL;
+
+    if (atomic_fetch_sub(&(share->refs), 1) > 1)
+        return true;
+
+    free(share);
+    return false;
+}
+
+#ifdef LINKEDHASHMAP_STATS
+
+void linkedhashmap_stats(LinkedHashMap* map, LinkedHashMapStats* stats)
+{
+    *stats = map->stats->stats;
+    stats->load_factor = (double)map->length / (double)map->capacity;
+    stats->node_table_bytes = map->capacity * sizeof(LinkedHashMapNode);
+}
+
+void linkedhashmap_stats_reset(LinkedHashMap* map)
+{
+    memset(&(map->stats->stats), 0, sizeof(LinkedHashMapStats));
+    map->stats->sample_counter = 0;
+}
+
+void linkedhashmap_stats_set_sample_rate(LinkedHashMap* map, size_t sample_rate)
+{
+    map->stats->sample_rate = sample_rate > 0 ? sample_rate : 1;
+    map->stats->sample_counter = 0;
+}
+
+#endif
+
+#ifdef LINKEDHASHMAP_LATENCY
+
+size_t linkedhashmap_latency_bucket(uint64_t nanoseconds)
+{
+    if (nanoseconds < LINKEDHASHMAP_LATENCY_SUB_BUCKETS)
+        return (size_t)nanoseconds;
+
+    // Each power of two is split into linear sub-buckets, bounding the relative error of every bucket
+    size_t exponent = 63;
+
+    while ((nanoseconds >> exponent) == 0)
+        exponent--;
+
+    size_t shift = exponent - LINKEDHASHMAP_LATENCY_SUB_BUCKET_BITS;
+    size_t sub_bucket = (size_t)(nanoseconds >> shift) - LINKEDHASHMAP_LATENCY_SUB_BUCKETS;
+    return LINKEDHASHMAP_LATENCY_SUB_BUCKETS + shift * LINKEDHASHMAP_LATENCY_SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t linkedhashmap_latency_bucket_value(size_t bucket)
+{
+    if (bucket < LINKEDHASHMAP_LATENCY_SUB_BUCKETS)
+        return (uint64_t)bucket;
+
+    size_t shift = (bucket - LINKEDHASHMAP_LATENCY_SUB_BUCKETS) / LINKEDHASHMAP_LATENCY_SUB_BUCKETS;
+    uint64_t sub_bucket = (uint64_t)((bucket - LINKEDHASHMAP_LATENCY_SUB_BUCKETS) % LINKEDHASHMAP_LATENCY_SUB_BUCKETS);
+    return ((LINKEDHASHMAP_LATENCY_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+void linkedhashmap_latency_record(LinkedHashMap* map, int operation, uint64_t start)
+{
+    if (map->latency == NULL)
+        return;
+
+    LinkedHashMapLatency* latency = map->latency;
+    uint64_t nanoseconds = linkedhashmap_clock_ns() - start;
+
+    latency->counts[operation][linkedhashmap_latency_bucket(nanoseconds)]++;
+    latency->totals[operation]++;
+
+    if (nanoseconds > latency->maximums[operation])
+        latency->maximums[operation] = nanoseconds;
+
+    if (latency->callback != NULL && latency->thresholds[operation] > 0 && nanoseconds > latency->thresholds[operation])
+        latency->callback(map, operation, nanoseconds, latency->callback_arg);
+}
+
+void linkedhashmap_latency_enable(LinkedHashMap* map)
+{
+    if (map->latency == NULL)
+        map->latency = (LinkedHashMapLatency*)calloc(1, sizeof(LinkedHashMapLatency));
+}
+
+void linkedhashmap_latency_disable(LinkedHashMap* map)
+{
+    free(map->latency);
+    map->latency = NULL;
+}
+
+void linkedhashmap_latency_reset(LinkedHashMap* map)
+{
+    if (map->latency == NULL)
+        return;
+
+    memset(map->latency->counts, 0, sizeof(map->latency->counts));
+    memset(map->latency->totals, 0, sizeof(map->latency->totals));
+    memset(map->latency->maximums, 0, sizeof(map->latency->maximums));
+}
+
+void linkedhashmap_latency_set_threshold(LinkedHashMap* map, int operation, uint64_t nanoseconds)
+{
+    linkedhashmap_latency_enable(map);
+    map->latency->thresholds[operation] = nanoseconds;
+}
+
+void linkedhashmap_latency_set_callback(LinkedHashMap* map, void (*fn)(LinkedHashMap*, int, uint64_t, void*), void* arg)
+{
+    linkedhashmap_latency_enable(map);
+    map->latency->callback = fn;
+    map->latency->callback_arg = arg;
+}
+
+uint64_t linkedhashmap_latency_count(LinkedHashMap* map, int operation)
+{
+    if (map->latency == NULL)
+        return 0;
+
+    return map->latency->totals[operation];
+}
+
+uint64_t linkedhashmap_latency_max(LinkedHashMap* map, int operation)
+{
+    if (map->latency == NULL)
+        return 0;
+
+    return map->latency->maximums[operation];
+}
+
+uint64_t linkedhashmap_latency_percentile(LinkedHashMap* map, int operation, double percentile)
+{
+    if (map->latency == NULL || map->latency->totals[operation] == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)((double)map->latency->totals[operation] * percentile / 100.0);
+    uint64_t seen = 0;
+
+    if (target == 0)
+        target = 1;
+
+    for (size_t i = 0; i < LINKEDHASHMAP_LATENCY_BUCKETS; i++)
+    {
+        seen += map->latency->counts[operation][i];
+
+        if (seen >= target)
+        {
+            uint64_t value = linkedhashmap_latency_bucket_value(i);
+            return value < map->latency->maximums[operation] ? value : map->latency->maximums[operation];
+        }
+    }
+
+    return map->latency->maximums[operation];
+}
+
+LinkedHashMapEntry* linkedhashmap_set(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size)
+{
+    uint64_t start = linkedhashmap_clock_ns();
+    LinkedHashMapEntry* res = linkedhashmap_set_untimed(map, key, key_size, value, value_size);
+    linkedhashmap_latency_record(map, LINKEDHASHMAP_OP_SET, start);
+    return res;
+}
+
+LinkedHashMapEntry* linkedhashmap_get(LinkedHashMap* map, void* key, size_t key_size)
+{
+    uint64_t start = linkedhashmap_clock_ns();
+    LinkedHashMapEntry* res = linkedhashmap_get_untimed(map, key, key_size);
+    linkedhashmap_latency_record(map, LINKEDHASHMAP_OP_GET, start);
+    return res;
+}
+
+LinkedHashMapEntry* linkedhashmap_pop(LinkedHashMap* map, void* key, size_t key_size)
+{
+    uint64_t start = linkedhashmap_clock_ns();
+    LinkedHashMapEntry* res = linkedhashmap_pop_untimed(map, key, key_size);
+    linkedhashmap_latency_record(map, LINKEDHASHMAP_OP_POP, start);
+    return res;
+}
+
+void linkedhashmap_resize(LinkedHashMap* map, size_t new_size)
+{
+    uint64_t start = linkedhashmap_clock_ns();
+    linkedhashmap_resize_untimed(map, new_size);
+    linkedhashmap_latency_record(map, LINKEDHASHMAP_OP_RESIZE, start);
+}
+
+#endif
+
+void linkedhashmap_foreach(LinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg)
+{
+    size_t index = map->head;
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        (*fn)(current->key, current->key_size, current->value, current->value_size, arg);
+        index = current->next;
+    }
+}
+
+size_t linkedhashmap_thread_count(size_t nthreads)
+{
+    if (nthreads > 0)
+        return nthreads;
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+#endif
+}
+
+typedef struct _LinkedHashMapParallelJob
+{
+    LinkedHashMap* map;
+    size_t chunk_count;
+    size_t* chunk_slots;
+    size_t* chunk_ends;
+    void** chunk_results;
+    bool* chunk_has_result;
+    unsigned char* boundaries;
+    atomic_size_t next_chunk;
+    void (*foreach_fn)(void*, size_t, void*, size_t, void*);
+    void* (*map_fn)(void*, size_t, void*, size_t, void*);
+    void* (*reduce_fn)(void*, void*, void*);
+    void* arg;
+} LinkedHashMapParallelJob;
+
+#define LINKEDHASHMAP_IS_BOUNDARY(job, index) (((job)->boundaries[(index) >> 3] >> ((index) & 7)) & 1)
+
+static void* linkedhashmap_parallel_worker(void* data)
+{
+    LinkedHashMapParallelJob* job = (LinkedHashMapParallelJob*)data;
+    size_t chunk;
+
+    while ((chunk = atomic_fetch_add(&(job->next_chunk), 1)) < job->chunk_count)
+    {
+        size_t index = job->chunk_slots[chunk];
+        void* result = NULL;
+        bool has_result = false;
+
+        // Each chunk runs from its own boundary node up to, but not including, whichever boundary node comes next in insertion order
+        do
+        {
+            LinkedHashMapNode* current = LINKEDHASHMAP_NODE(job->map, index);
+
+            if (job->foreach_fn != NULL)
+                (*job->foreach_fn)(current->key, current->key_size, current->value, current->value_size, job->arg);
+            else
+            {
+                void* mapped = (*job->map_fn)(current->key, current->key_size, current->value, current->value_size, job->arg);
+                result = has_result ? (*job->reduce_fn)(result, mapped, job->arg) : mapped;
+                has_result = true;
+            }
+
+            index = current->next;
+        } while (index != LINKEDHASHMAP_NO_NODE && !LINKEDHASHMAP_IS_BOUNDARY(job, index));
+
+        job->chunk_ends[chunk] = index;
+        job->chunk_results[chunk] = result;
+        job->chunk_has_result[chunk] = has_result;
+    }
+
+    return NULL;
+}
+
+static int linkedhashmap_compare_slots(const void* a, const void* b)
+{
+    size_t slot_a = *(const size_t*)a;
+    size_t slot_b = *(const size_t*)b;
+    return (slot_a > slot_b) - (slot_a < slot_b);
+}
+
+static size_t linkedhashmap_chunk_of(LinkedHashMapParallelJob* job, size_t slot)
+{
+    size_t low = 0;
+    size_t high = job->chunk_count;
+
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (job->chunk_slots[middle] <= slot)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+size_t linkedhashmap_parallel_sample(LinkedHashMap* map, size_t* slots, size_t max_chunks)
+{
+    size_t count = 0;
+
+    // Boundaries are sampled from evenly spaced regions of the table rather than found by walking the order list. Since
+    // slots are independent of insertion order, this splits the order list into chunks of roughly equal expected size.
+    slots[count++] = map->head;
+
+    for (size_t i = 0; i + 1 < max_chunks; i++)
+    {
+        size_t start = i * map->capacity / (max_chunks - 1);
+        size_t end = (i + 1) * map->capacity / (max_chunks - 1);
+
+        // Scanning a sparse region to its end would cost as much as the table is large, so a region that starts with a
+        // run of empty slots is left to the chunk before it
+        if (end - start > LINKEDHASHMAP_PARALLEL_SAMPLE_PROBES)
+            end = start + LINKEDHASHMAP_PARALLEL_SAMPLE_PROBES;
+
+        while (start < end && !LINKEDHASHMAP_NODE(map, start)->is_allocated)
+            start++;
+
+        if (start < end)
+            slots[count++] = start;
+    }
+
+    return count;
+}
+
+static void* linkedhashmap_parallel_run(LinkedHashMapParallelJob* job, size_t nthreads)
+{
+    LinkedHashMap* map = job->map;
+    size_t max_chunks = nthreads * LINKEDHASHMAP_PARALLEL_CHUNKS_PER_THREAD + 1;
+
+    job->chunk_slots = (size_t*)malloc(max_chunks * sizeof(size_t));
+    job->boundaries = (unsigned char*)calloc((map->capacity >> 3) + 1, 1);
+    job->chunk_count = linkedhashmap_parallel_sample(map, job->chunk_slots, max_chunks);
+
+    qsort(job->chunk_slots, job->chunk_count, sizeof(size_t), linkedhashmap_compare_slots);
+
+    size_t unique_count = 0;
+
+    for (size_t i = 0; i < job->chunk_count; i++)
+    {
+        if (unique_count == 0 || job->chunk_slots[unique_count - 1] != job->chunk_slots[i])
+        {
+            job->chunk_slots[unique_count++] = job->chunk_slots[i];
+            job->boundaries[job->chunk_slots[i] >> 3] |= (unsigned char)(1 << (job->chunk_slots[i] & 7));
+        }
+    }
+
+    job->chunk_count = unique_count;
+    job->chunk_ends = (size_t*)malloc(job->chunk_count * sizeof(size_t));
+    job->chunk_results = (void**)malloc(job->chunk_count * sizeof(void*));
+    job->chunk_has_result = (bool*)malloc(job->chunk_count * sizeof(bool));
+    atomic_init(&(job->next_chunk), 0);
+
+    if (nthreads > job->chunk_count)
+        nthreads = job->chunk_count;
+
+    pthread_t* threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+    size_t started = 0;
+
+    for (size_t i = 1; i < nthreads; i++)
+    {
+        if (pthread_create(&(threads[started]), NULL, linkedhashmap_parallel_worker, job) == 0)
+            started++;
+    }
+
+    // The calling thread works through chunks too, and picks up whatever any thread that failed to start would have done
+    linkedhashmap_parallel_worker(job);
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    // Chunks are combined by following each chunk's end to the chunk that starts there, which is insertion order
+    void* result = NULL;
+    bool has_result = false;
+    size_t current = map->head;
+
+    while (current != LINKEDHASHMAP_NO_NODE)
+    {
+        size_t chunk = linkedhashmap_chunk_of(job, current);
+
+        if (job->chunk_has_result[chunk])
+        {
+            result = has_result ? (*job->reduce_fn)(result, job->chunk_results[chunk], job->arg) : job->chunk_results[chunk];
+            has_result = true;
+        }
+
+        current = job->chunk_ends[chunk];
+    }
+
+    free(threads);
+    free(job->chunk_has_result);
+    free(job->chunk_results);
+    free(job->chunk_ends);
+    free(job->boundaries);
+    free(job->chunk_slots);
+    return result;
+}
+
+typedef struct _LinkedHashMapResizeJob
+{
+    LinkedHashMap* map;
+    LinkedHashMapNode* old_nodes;
+    size_t old_capacity;
+    size_t nthreads;
+    size_t index;
+    bool relink;
+} LinkedHashMapResizeJob;
+
+static void* linkedhashmap_resize_worker(void* data)
+{
+    LinkedHashMapResizeJob* job = (LinkedHashMapResizeJob*)data;
+    LinkedHashMap* map = job->map;
+
+    if (!job->relink)
+    {
+        size_t start = job->index * job->old_capacity / job->nthreads;
+        size_t end = (job->index + 1) * job->old_capacity / job->nthreads;
+
+        for (size_t i = start; i < end; i++)
+        {
+            LinkedHashMapNode* old_node = &(job->old_nodes[i]);
+
+            if (!old_node->is_allocated)
+                continue;
+
+            size_t hashvalue = linkedhashmap_hash(map, old_node->key, old_node->key_size);
+            size_t current = hashvalue;
+            size_t probe_length = 0;
+            bool expected = false;
+
+            // Slots are claimed atomically, so threads can place their nodes into any part of the new table at once
+            while (!__atomic_compare_exchange_n(&(map->nodes[current].is_allocated), &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            {
+                expected = false;
+                current = current + 1 < map->capacity ? current + 1 : 0;
+                probe_length++;
+            }
+
+            if (probe_length >= LINKEDHASHMAP_FLOOD_PROBE_LENGTH && !map->strong_hash && probe_length >= linkedhashmap_flood_threshold(map->capacity, map->length))
+                __atomic_store_n(&(map->hash_flooded), true, __ATOMIC_RELAXED);
+
+            LinkedHashMapNode* node = &(map->nodes[current]);
+            node->key = old_node->key;
+            node->key_size = old_node->key_size;
+            node->value = old_node->value;
+            node->value_size = old_node->value_size;
+            node->prev = old_node->prev;
+            node->next = old_node->next;
+
+            // The old node is discarded after this pass, so its next link is reused to record where it moved to
+            old_node->next = current;
+        }
+    }
+    else
+    {
+        size_t start = job->index * map->capacity / job->nthreads;
+        size_t end = (job->index + 1) * map->capacity / job->nthreads;
+
+        for (size_t i = start; i < end; i++)
+        {
+            LinkedHashMapNode* node = &(map->nodes[i]);
+
+            if (!node->is_allocated)
+                continue;
+
+            if (node->prev != LINKEDHASHMAP_NO_NODE)
+                node->prev = job->old_nodes[node->prev].next;
+
+            if (node->next != LINKEDHASHMAP_NO_NODE)
+                node->next = job->old_nodes[node->next].next;
+        }
+    }
+
+    return NULL;
+}
+
+static void linkedhashmap_resize_run(LinkedHashMapResizeJob* jobs, pthread_t* threads, size_t nthreads, bool relink)
+{
+    bool* started = (bool*)malloc(nthreads * sizeof(bool));
+
+    for (size_t i = 0; i < nthreads; i++)
+        jobs[i].relink = relink;
+
+    for (size_t i = 1; i < nthreads; i++)
+        started[i] = pthread_create(&(threads[i]), NULL, linkedhashmap_resize_worker, &(jobs[i])) == 0;
+
+    linkedhashmap_resize_worker(&(jobs[0]));
+
+    // Threads that failed to start leave their part of the table to the calling thread
+    for (size_t i = 1; i < nthreads; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            linkedhashmap_resize_worker(&(jobs[i]));
+    }
+
+    free(started);
+}
+
+void linkedhashmap_resize_parallel(LinkedHashMap* map, size_t new_size, size_t nthreads)
+{
+    // Moved nodes are forwarded through the old table, so it has to be a single private allocation
+    linkedhashmap_materialize(map);
+
+    LinkedHashMapNode* old_nodes = map->nodes;
+    size_t old_capacity = map->capacity;
+    bool old_mapped = map->nodes_mapped;
+    bool old_owned = map->nodes_owned;
+    LinkedHashMapResizeJob* jobs = (LinkedHashMapResizeJob*)malloc(nthreads * sizeof(LinkedHashMapResizeJob));
+    pthread_t* threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+
+    map->capacity = new_size;
+    map->nodes = linkedhashmap_nodes_alloc(map, new_size);
+
+    // Fresh mappings are already zeroed
+    if (!map->nodes_mapped)
+        memset(map->nodes, 0, new_size * sizeof(LinkedHashMapNode));
+
+    for (size_t i = 0; i < nthreads; i++)
+    {
+        jobs[i].map = map;
+        jobs[i].old_nodes = old_nodes;
+        jobs[i].old_capacity = old_capacity;
+        jobs[i].nthreads = nthreads;
+        jobs[i].index = i;
+    }
+
+    // The first pass moves every node into the new table, and the second points the order links at the moved nodes
+    linkedhashmap_resize_run(jobs, threads, nthreads, false);
+    linkedhashmap_resize_run(jobs, threads, nthreads, true);
+
+    map->head = map->head != LINKEDHASHMAP_NO_NODE ? old_nodes[map->head].next : LINKEDHASHMAP_NO_NODE;
+    map->tail = map->tail != LINKEDHASHMAP_NO_NODE ? old_nodes[map->tail].next : LINKEDHASHMAP_NO_NODE;
+
+    free(threads);
+    free(jobs);
+
+    if (old_owned)
+        linkedhashmap_nodes_free(old_nodes, old_capacity, old_mapped);
+}
+
+void linkedhashmap_foreach_parallel(LinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg, size_t nthreads)
+{
+    nthreads = linkedhashmap_thread_count(nthreads);
+
+    if (nthreads == 1 || map->length < LINKEDHASHMAP_PARALLEL_MIN_LENGTH)
+    {
+        linkedhashmap_foreach(map, fn, arg);
+        return;
+    }
+
+    LinkedHashMapParallelJob job;
+    job.map = map;
+    job.foreach_fn = fn;
+    job.map_fn = NULL;
+    job.reduce_fn = NULL;
+    job.arg = arg;
+    linkedhashmap_parallel_run(&job, nthreads);
+}
+
+void* linkedhashmap_map_reduce_parallel(LinkedHashMap* map, void* (*map_fn)(void*, size_t, void*, size_t, void*), void* (*reduce_fn)(void*, void*, void*), void* arg, size_t nthreads)
+{
+    nthreads = linkedhashmap_thread_count(nthreads);
+
+    if (nthreads == 1 || map->length < LINKEDHASHMAP_PARALLEL_MIN_LENGTH)
+    {
+        size_t index = map->head;
+        void* result = NULL;
+
+        while (index != LINKEDHASHMAP_NO_NODE)
+        {
+            LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+            void* mapped = (*map_fn)(current->key, current->key_size, current->value, current->value_size, arg);
+            result = index == map->head ? mapped : (*reduce_fn)(result, mapped, arg);
+            index = current->next;
+        }
+
+        return result;
+    }
+
+    LinkedHashMapParallelJob job;
+    job.map = map;
+    job.foreach_fn = NULL;
+    job.map_fn = map_fn;
+    job.reduce_fn = reduce_fn;
+    job.arg = arg;
+    return linkedhashmap_parallel_run(&job, nthreads);
+}
+
+typedef struct _LinkedHashMapSortJob
+{
+    LinkedHashMapNode** nodes;
+    LinkedHashMapNode** buffer;
+    int (*cmp)(LinkedHashMapNode*, LinkedHashMapNode*, void*);
+    void* arg;
+    size_t start;
+    size_t middle;
+    size_t end;
+} LinkedHashMapSortJob;
+
+static void linkedhashmap_sort_merge(LinkedHashMapSortJob* job, size_t start, size_t middle, size_t end)
+{
+    LinkedHashMapNode** nodes = job->nodes;
+    LinkedHashMapNode** buffer = job->buffer;
+
+    // Runs that are already in order are common when re-sorting a mostly sorted map
+    if (start == middle || middle == end || (*job->cmp)(nodes[middle - 1], nodes[middle], job->arg) <= 0)
+        return;
+
+    // Only the left run is moved out of the way, and ties are taken from it first, which keeps the sort stable
+    memcpy(buffer + start, nodes + start, (middle - start) * sizeof(LinkedHashMapNode*));
+
+    size_t i = start;
+    size_t j = middle;
+    size_t k = start;
+
+    while (i < middle && j < end)
+        nodes[k++] = (*job->cmp)(nodes[j], buffer[i], job->arg) < 0 ? nodes[j++] : buffer[i++];
+
+    while (i < middle)
+        nodes[k++] = buffer[i++];
+}
+
+static void linkedhashmap_sort_range(LinkedHashMapSortJob* job, size_t start, size_t end)
+{
+    LinkedHashMapNode** nodes = job->nodes;
+
+    if (end - start <= LINKEDHASHMAP_SORT_INSERTION_LENGTH)
+    {
+        for (size_t i = start + 1; i < end; i++)
+        {
+            LinkedHashMapNode* node = nodes[i];
+            size_t j = i;
+
+            while (j > start && (*job->cmp)(nodes[j - 1], node, job->arg) > 0)
+            {
+                nodes[j] = nodes[j - 1];
+                j--;
+            }
+
+            nodes[j] = node;
+        }
+
+        return;
+    }
+
+    size_t middle = start + (end - start) / 2;
+
+    linkedhashmap_sort_range(job, start, middle);
+    linkedhashmap_sort_range(job, middle, end);
+    linkedhashmap_sort_merge(job, start, middle, end);
+}
+
+static void* linkedhashmap_sort_worker(void* data)
+{
+    LinkedHashMapSortJob* job = (LinkedHashMapSortJob*)data;
+
+    if (job->middle == ~(size_t)0)
+        linkedhashmap_sort_range(job, job->start, job->end);
+    else
+        linkedhashmap_sort_merge(job, job->start, job->middle, job->end);
+
+    return NULL;
+}
+
+static void linkedhashmap_sort_run(LinkedHashMapSortJob* jobs, size_t count)
+{
+    pthread_t* threads = (pthread_t*)malloc(count * sizeof(pthread_t));
+    bool* started = (bool*)malloc(count * sizeof(bool));
+
+    for (size_t i = 1; i < count; i++)
+        started[i] = pthread_create(&(threads[i]), NULL, linkedhashmap_sort_worker, &(jobs[i])) == 0;
+
+    linkedhashmap_sort_worker(&(jobs[0]));
+
+    // Threads that failed to start leave their run to the calling thread
+    for (size_t i = 1; i < count; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            linkedhashmap_sort_worker(&(jobs[i]));
+    }
+
+    free(started);
+    free(threads);
+}
+
+void linkedhashmap_sort(LinkedHashMap* map, int (*cmp)(LinkedHashMapNode*, LinkedHashMapNode*, void*), void* arg)
+{
+    linkedhashmap_sort_parallel(map, cmp, arg, 1);
+}
+
+void linkedhashmap_sort_parallel(LinkedHashMap* map, int (*cmp)(LinkedHashMapNode*, LinkedHashMapNode*, void*), void* arg, size_t nthreads)
+{
+    LINKEDHASHMAP_WAL_MAINTAIN(map);
+
+    size_t length = map->length;
+
+    if (length < 2)
+        return;
+
+    // Every order link is rewritten, so the table is made private in one go rather than a chunk at a time
+    linkedhashmap_materialize(map);
+
+    LinkedHashMapNode** nodes = (LinkedHashMapNode**)malloc(length * sizeof(LinkedHashMapNode*));
+    LinkedHashMapNode** buffer = (LinkedHashMapNode**)malloc(length * sizeof(LinkedHashMapNode*));
+    size_t current = map->head;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        nodes[i] = &(map->nodes[current]);
+        current = nodes[i]->next;
+    }
+
+    nthreads = length < LINKEDHASHMAP_PARALLEL_MIN_LENGTH ? 1 : linkedhashmap_thread_count(nthreads);
+
+    LinkedHashMapSortJob* jobs = (LinkedHashMapSortJob*)malloc(nthreads * sizeof(LinkedHashMapSortJob));
+
+    for (size_t i = 0; i < nthreads; i++)
+    {
+        jobs[i].nodes = nodes;
+        jobs[i].buffer = buffer;
+        jobs[i].cmp = cmp;
+        jobs[i].arg = arg;
+        jobs[i].start = length * i / nthreads;
+        jobs[i].middle = ~(size_t)0;
+        jobs[i].end = length * (i + 1) / nthreads;
+    }
+
+    // Each thread sorts its own run, then neighbouring runs are merged in pairs until only one is left
+    linkedhashmap_sort_run(jobs, nthreads);
+
+    for (size_t width = 1; width < nthreads; width <<= 1)
+    {
+        size_t count = 0;
+
+        for (size_t i = 0; i + width < nthreads; i += width << 1)
+        {
+            size_t end = i + (width << 1) < nthreads ? i + (width << 1) : nthreads;
+
+            jobs[count].start = length * i / nthreads;
+            jobs[count].middle = length * (i + width) / nthreads;
+            jobs[count].end = length * end / nthreads;
+            count++;
+        }
+
+        linkedhashmap_sort_run(jobs, count);
+    }
+
+    linkedhashmap_order_set(map, nodes, length);
+
+    free(jobs);
+    free(buffer);
+    free(nodes);
+}
+
+void* linkedhashmap_storage_alloc(LinkedHashMap* map, size_t size)
+{
+    LinkedHashMapStorage* storage = (LinkedHashMapStorage*)malloc(sizeof(LinkedHashMapStorage));
+
+    if (storage == NULL)
+        return NULL;
+
+    storage->data = malloc(size > 0 ? size : 1);
+
+    if (storage->data == NULL)
+    {
+        free(storage);
+        return NULL;
+    }
+
+    storage->size = size;
+    storage->is_mapped = false;
+    storage->next = map->storage;
+    map->storage = storage;
+    return storage->data;
+}
+
+typedef struct _LinkedHashMapWriter
+{
+    int fd;
+    bool failed;
+    uint64_t checksum;
+    size_t used;
+    unsigned char buffer[LINKEDHASHMAP_IO_BUFFER_SIZE];
+} LinkedHashMapWriter;
+
+typedef struct _LinkedHashMapReader
+{
+    int fd;
+    bool failed;
+    uint64_t checksum;
+    size_t used;
+    size_t available;
+    unsigned char buffer[LINKEDHASHMAP_IO_BUFFER_SIZE];
+} LinkedHashMapReader;
+
+static size_t linkedhashmap_varint_encode(unsigned char* bytes, uint64_t value)
+{
+    size_t size = 0;
+
+    do
+    {
+        bytes[size] = (unsigned char)(value & 0x7f);
+        value >>= 7;
+
+        if (value != 0)
+            bytes[size] |= 0x80;
+
+        size++;
+    }
+    while (value != 0);
+
+    return size;
+}
+
+static size_t linkedhashmap_varint_size(uint64_t value)
+{
+    unsigned char bytes[10];
+    return linkedhashmap_varint_encode(bytes, value);
+}
+
+static bool linkedhashmap_varint_decode(unsigned char** data, unsigned char* end, uint64_t* value)
+{
+    *value = 0;
+
+    for (size_t shift = 0; shift < 64 && *data < end; shift += 7)
+    {
+        unsigned char byte = *((*data)++);
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+static void linkedhashmap_journal_put(LinkedHashMapJournal* journal, const void* data, size_t size)
+{
+    size_t offset = (journal->start + journal->size) % journal->capacity;
+    size_t first = journal->capacity - offset < size ? journal->capacity - offset : size;
+
+    memcpy(journal->data + offset, data, first);
+    memcpy(journal->data, (const unsigned char*)data + first, size - first);
+    journal->size += size;
+}
+
+static bool linkedhashmap_record_has_value(int op)
+{
+    return op == LINKEDHASHMAP_JOURNAL_SET || op == LINKEDHASHMAP_JOURNAL_INSERT_BEFORE || op == LINKEDHASHMAP_JOURNAL_INSERT_AFTER;
+}
+
+static size_t linkedhashmap_record_body_size(int op, uint64_t sequence, void* anchor, size_t anchor_size, void* key, size_t key_size, size_t value_size)
+{
+    size_t body_size = 1 + linkedhashmap_varint_size(sequence);
+
+    if (anchor != NULL)
+        body_size += linkedhashmap_varint_size(anchor_size) + anchor_size;
+
+    if (key != NULL)
+        body_size += linkedhashmap_varint_size(key_size) + key_size;
+
+    if (linkedhashmap_record_has_value(op))
+        body_size += linkedhashmap_varint_size(value_size) + value_size;
+
+    return body_size;
+}
+
+static unsigned char* linkedhashmap_record_encode_bytes(unsigned char* out, const void* data, size_t size)
+{
+    out += linkedhashmap_varint_encode(out, size);
+    memcpy(out, data, size);
+    return out + size;
+}
+
+static void linkedhashmap_record_encode(unsigned char* out, size_t body_size, int op, uint64_t sequence, void* anchor, size_t anchor_size, void* key, size_t key_size, void* value, size_t value_size)
+{
+    out += linkedhashmap_varint_encode(out, body_size);
+    *(out++) = (unsigned char)op;
+    out += linkedhashmap_varint_encode(out, sequence);
+
+    if (anchor != NULL)
+        out = linkedhashmap_record_encode_bytes(out, anchor, anchor_size);
+
+    if (key != NULL)
+        out = linkedhashmap_record_encode_bytes(out, key, key_size);
+
+    if (linkedhashmap_record_has_value(op))
+        linkedhashmap_record_encode_bytes(out, value, value_size);
+}
+
+static size_t linkedhashmap_journal_record_size(LinkedHashMapJournal* journal, size_t offset)
+{
+    uint64_t body_size = 0;
+    size_t i = 0;
+
+    // Every record starts with the size of the rest of it, which is all that's needed to skip over it
+    for (unsigned char byte = 0x80; byte & 0x80; i++)
+    {
+        byte = journal->data[(journal->start + offset + i) % journal->capacity];
+        body_size |= (uint64_t)(byte & 0x7f) << (i * 7);
+    }
+
+    return i + (size_t)body_size;
+}
+
+void linkedhashmap_journal_enable(LinkedHashMap* map, size_t capacity)
+{
+    if (map->journal != NULL)
+        return;
+
+    if (capacity == 0)
+        capacity = 1;
+
+    map->journal = (LinkedHashMapJournal*)malloc(sizeof(LinkedHashMapJournal));
+    map->journal->data = (unsigned char*)malloc(capacity);
+    map->journal->capacity = capacity;
+    map->journal->start = 0;
+    map->journal->size = 0;
+    map->journal->first_sequence = 0;
+    map->journal->next_sequence = 0;
+}
+
+void linkedhashmap_journal_disable(LinkedHashMap* map)
+{
+    if (map->journal == NULL)
+        return;
+
+    free(map->journal->data);
+    free(map->journal);
+    map->journal = NULL;
+}
+
+uint64_t linkedhashmap_journal_sequence(LinkedHashMap* map)
+{
+    return map->journal != NULL ? map->journal->next_sequence : 0;
+}
+
+static void linkedhashmap_journal_append(LinkedHashMapJournal* journal, int op, void* anchor, size_t anchor_size, void* key, size_t key_size, void* value, size_t value_size)
+{
+    uint64_t sequence = journal->next_sequence++;
+    size_t body_size = linkedhashmap_record_body_size(op, sequence, anchor, anchor_size, key, key_size, value_size);
+    size_t size = linkedhashmap_varint_size(body_size) + body_size;
+
+    // A record that could never fit takes every earlier record with it, so that no consumer can read past the gap
+    if (size > journal->capacity)
+    {
+        journal->start = 0;
+        journal->size = 0;
+        journal->first_sequence = journal->next_sequence;
+        return;
+    }
+
+    while (journal->size + size > journal->capacity)
+    {
+        size_t dropped = linkedhashmap_journal_record_size(journal, 0);
+        journal->start = (journal->start + dropped) % journal->capacity;
+        journal->size -= dropped;
+        journal->first_sequence++;
+    }
+
+    size_t offset = (journal->start + journal->size) % journal->capacity;
+
+    // Records are encoded in place unless they wrap around the end of the ring
+    if (offset + size <= journal->capacity)
+    {
+        linkedhashmap_record_encode(journal->data + offset, body_size, op, sequence, anchor, anchor_size, key, key_size, value, value_size);
+        journal->size += size;
+    }
+    else
+    {
+        unsigned char* record = (unsigned char*)malloc(size);
+        linkedhashmap_record_encode(record, body_size, op, sequence, anchor, anchor_size, key, key_size, value, value_size);
+        linkedhashmap_journal_put(journal, record, size);
+        free(record);
+    }
+}
+
+void linkedhashmap_journal_record(LinkedHashMap* map, int op, void* anchor, size_t anchor_size, void* key, size_t key_size, void* value, size_t value_size)
+{
+    if (map->journal != NULL)
+        linkedhashmap_journal_append(map->journal, op, anchor, anchor_size, key, key_size, value, value_size);
+
+#ifndef _WIN32
+    if (map->wal != NULL)
+        linkedhashmap_wal_append(map, op, anchor, anchor_size, key, key_size, value, value_size);
+#endif
+}
+
+void linkedhashmap_order_set(LinkedHashMap* map, LinkedHashMapNode** nodes, size_t length)
+{
+    // Only the order links change, so every node stays in its slot
+    for (size_t i = 0; i < length; i++)
+    {
+        nodes[i]->prev = i > 0 ? (size_t)(nodes[i - 1] - map->nodes) : LINKEDHASHMAP_NO_NODE;
+        nodes[i]->next = i + 1 < length ? (size_t)(nodes[i + 1] - map->nodes) : LINKEDHASHMAP_NO_NODE;
+    }
+
+    map->head = (size_t)(nodes[0] - map->nodes);
+    map->tail = (size_t)(nodes[length - 1] - map->nodes);
+
+    if (map->digests_enabled)
+        linkedhashmap_enable_digests(map);
+
+    if (map->journal == NULL && map->wal == NULL)
+        return;
+
+    // Comparators can't be replayed, so followers are given the whole resulting order in a single record, which a write-ahead log commits at once
+    size_t size = 0;
+
+    for (size_t i = 0; i < length; i++)
+        size += linkedhashmap_varint_size(nodes[i]->key_size) + nodes[i]->key_size;
+
+    unsigned char* keys = (unsigned char*)malloc(size);
+    unsigned char* out = keys;
+
+    for (size_t i = 0; i < length; i++)
+        out = linkedhashmap_record_encode_bytes(out, nodes[i]->key, nodes[i]->key_size);
+
+    linkedhashmap_journal_record(map, LINKEDHASHMAP_JOURNAL_ORDER, NULL, 0, keys, size, NULL, 0);
+    free(keys);
+}
+
+size_t linkedhashmap_journal_read(LinkedHashMap* map, uint64_t* cursor, void* buffer, size_t buffer_size)
+{
+    LinkedHashMapJournal* journal = map->journal;
+
+    if (journal == NULL || *cursor < journal->first_sequence || *cursor > journal->next_sequence)
+        return ~(size_t)0;
+
+    uint64_t sequence = journal->first_sequence;
+    size_t offset = 0;
+    size_t written = 0;
+
+    while (sequence < *cursor)
+    {
+        offset += linkedhashmap_journal_record_size(journal, offset);
+        sequence++;
+    }
+
+    while (sequence < journal->next_sequence)
+    {
+        size_t size = linkedhashmap_journal_record_size(journal, offset);
+
+        if (written + size > buffer_size)
+            break;
+
+        size_t from = (journal->start + offset) % journal->capacity;
+        size_t first = journal->capacity - from < size ? journal->capacity - from : size;
+
+        memcpy((unsigned char*)buffer + written, journal->data + from, first);
+        memcpy((unsigned char*)buffer + written + first, journal->data, size - first);
+        written += size;
+        offset += size;
+        sequence++;
+    }
+
+    *cursor = sequence;
+    return written;
+}
+
+static bool linkedhashmap_journal_decode_bytes(unsigned char** data, unsigned char* end, void** bytes, size_t* size)
+{
+    uint64_t value;
+
+    if (!linkedhashmap_varint_decode(data, end, &value) || value > (uint64_t)(end - *data))
+        return false;
+
+    *bytes = *data;
+    *size = (size_t)value;
+    *data += value;
+    return true;
+}
+
+static void* linkedhashmap_storage_copy(LinkedHashMap* map, void* data, size_t size)
+{
+    // Copies are indexed by address apart from the rest of the map's storage, so that each can be freed once the map stops using it
+    if (map->owned_storage == NULL && (map->owned_storage = linkedhashmap_new()) == NULL)
+        return NULL;
+
+    LinkedHashMapStorage* storage = (LinkedHashMapStorage*)malloc(sizeof(LinkedHashMapStorage));
+
+    if (storage == NULL)
+        return NULL;
+
+    storage->data = malloc(size > 0 ? size : 1);
+
+    if (storage->data == NULL)
+    {
+        free(storage);
+        return NULL;
+    }
+
+    memcpy(storage->data, data, size);
+    storage->size = size;
+    storage->is_mapped = false;
+    storage->next = NULL;
+    free(linkedhashmap_set(map->owned_storage, &(storage->data), sizeof(void*), storage, sizeof(LinkedHashMapStorage)));
+    return storage->data;
+}
+
+static void linkedhashmap_storage_release(LinkedHashMap* map, void* data)
+{
+    // Copies and snapshots of the map may still point at the copy, so it is kept until the map is freed
+    if (map->owned_storage == NULL || (map->storage_share != NULL && atomic_load(&(map->storage_share->refs)) > 1))
+        return;
+
+    LinkedHashMapEntry* entry = linkedhashmap_pop(map->owned_storage, &data, sizeof(void*));
+
+    if (entry == NULL)
+        return;
+
+    LinkedHashMapStorage* storage = (LinkedHashMapStorage*)entry->value;
+    free(storage->data);
+    free(storage);
+    free(entry);
+}
+
+static void linkedhashmap_storage_release_all(LinkedHashMap* map)
+{
+    if (map->owned_storage == NULL)
+        return;
+
+    LinkedHashMap* registry = map->owned_storage;
+
+    for (size_t index = registry->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(registry, index)->next)
+    {
+        LinkedHashMapStorage* storage = (LinkedHashMapStorage*)LINKEDHASHMAP_NODE(registry, index)->value;
+        free(storage->data);
+        free(storage);
+    }
+
+    linkedhashmap_free(map->owned_storage);
+    map->owned_storage = NULL;
+}
+
+static LinkedHashMapStorage* linkedhashmap_storage_take(LinkedHashMap* map)
+{
+    LinkedHashMapStorage* storage = map->storage;
+    map->storage = NULL;
+
+    if (map->owned_storage == NULL)
+        return storage;
+
+    LinkedHashMap* registry = map->owned_storage;
+
+    for (size_t index = registry->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(registry, index)->next)
+    {
+        LinkedHashMapStorage* copy = (LinkedHashMapStorage*)LINKEDHASHMAP_NODE(registry, index)->value;
+        copy->next = storage;
+        storage = copy;
+    }
+
+    linkedhashmap_free(map->owned_storage);
+    map->owned_storage = NULL;
+    return storage;
+}
+
+static void linkedhashmap_storage_push(LinkedHashMapShare* share, LinkedHashMapStorage* storage)
+{
+    if (storage == NULL)
+        return;
+
+    LinkedHashMapStorage* last = storage;
+
+    while (last->next != NULL)
+        last = last->next;
+
+    // Maps sharing the storage may be freed on different threads at once
+    LinkedHashMapStorage* head = atomic_load(&(share->storage));
+
+    do
+        last->next = head;
+    while (!atomic_compare_exchange_weak(&(share->storage), &head, storage));
+}
+
+static bool linkedhashmap_journal_apply_order(LinkedHashMap* map, unsigned char* data, unsigned char* end)
+{
+    if (map->length == 0)
+        return data == end;
+
+    linkedhashmap_materialize(map);
+
+    LinkedHashMapNode** nodes = (LinkedHashMapNode**)malloc(map->length * sizeof(LinkedHashMapNode*));
+    unsigned char* seen = (unsigned char*)calloc(map->capacity, 1);
+    size_t count = 0;
+    bool success = true;
+
+    // The record has to name every key of the map exactly once, or the order links would be left broken
+    while (success && data < end)
+    {
+        void* key;
+        size_t key_size;
+        size_t index = ~(size_t)0;
+
+        success = count < map->length
+            && linkedhashmap_journal_decode_bytes(&data, end, &key, &key_size)
+            && (index = linkedhashmap_find_key(map, key, key_size)) != ~(size_t)0
+            && !seen[index];
+
+        if (success)
+        {
+            seen[index] = 1;
+            nodes[count++] = &(map->nodes[index]);
+        }
+    }
+
+    success = success && count == map->length;
+
+    if (success)
+        linkedhashmap_order_set(map, nodes, count);
+
+    free(seen);
+    free(nodes);
+    return success;
+}
+
+static bool linkedhashmap_journal_apply_record(LinkedHashMap* map, unsigned char** data, unsigned char* end)
+{
+    unsigned char* current = *data;
+    uint64_t body_size;
+    uint64_t sequence;
+
+    if (!linkedhashmap_varint_decode(&current, end, &body_size) || body_size == 0 || body_size > (uint64_t)(end - current))
+        return false;
+
+    unsigned char* record_end = current + body_size;
+    int op = *(current++);
+    bool has_anchor = op == LINKEDHASHMAP_JOURNAL_INSERT_BEFORE || op == LINKEDHASHMAP_JOURNAL_INSERT_AFTER;
+    bool has_value = linkedhashmap_record_has_value(op);
+    void* anchor = NULL;
+    size_t anchor_size = 0;
+    void* key = NULL;
+    size_t key_size = 0;
+    void* value = NULL;
+    size_t value_size = 0;
+
+    if (!linkedhashmap_varint_decode(&current, record_end, &sequence))
+        return false;
+
+    if (has_anchor && !linkedhashmap_journal_decode_bytes(&current, record_end, &anchor, &anchor_size))
+        return false;
+
+    if (op != LINKEDHASHMAP_JOURNAL_CLEAR && !linkedhashmap_journal_decode_bytes(&current, record_end, &key, &key_size))
+        return false;
+
+    if (has_value && !linkedhashmap_journal_decode_bytes(&current, record_end, &value, &value_size))
+        return false;
+
+    if (current != record_end)
+        return false;
+
+    // The key of an order record is the list of every key in its new order
+    if (op == LINKEDHASHMAP_JOURNAL_ORDER)
+    {
+        if (!linkedhashmap_journal_apply_order(map, (unsigned char*)key, (unsigned char*)key + key_size))
+            return false;
+
+        *data = current;
+        return true;
+    }
+
+    // Keys the map already has are used in place, so only new keys and values are copied into the map's storage
+    size_t index = key != NULL ? linkedhashmap_find_key(map, key, key_size) : ~(size_t)0;
+    void* old_key = NULL;
+    void* old_value = NULL;
+    bool success = true;
+
+    if (index != ~(size_t)0)
+    {
+        key = old_key = LINKEDHASHMAP_NODE(map, index)->key;
+        old_value = LINKEDHASHMAP_NODE(map, index)->value;
+    }
+    else if (has_value && (key = linkedhashmap_storage_copy(map, key, key_size)) == NULL)
+        return false;
+
+    if (has_value && (value = linkedhashmap_storage_copy(map, value, value_size)) == NULL)
+    {
+        if (index == ~(size_t)0)
+            linkedhashmap_storage_release(map, key);
+
+        return false;
+    }
+
+    switch (op)
+    {
+        case LINKEDHASHMAP_JOURNAL_SET:
+            free(linkedhashmap_set(map, key, key_size, value, value_size));
+            break;
+        case LINKEDHASHMAP_JOURNAL_POP:
+            if (index == ~(size_t)0)
+                return false;
+
+            linkedhashmap_delete(map, key, key_size);
+            linkedhashmap_storage_release(map, old_key);
+            break;
+        case LINKEDHASHMAP_JOURNAL_CLEAR:
+            linkedhashmap_clear(map);
+
+            if (map->storage_share == NULL || atomic_load(&(map->storage_share->refs)) == 1)
+                linkedhashmap_storage_release_all(map);
+
+            break;
+        case LINKEDHASHMAP_JOURNAL_MOVE_TO_END:
+            success = linkedhashmap_move_to_end(map, key, key_size);
+            break;
+        case LINKEDHASHMAP_JOURNAL_MOVE_TO_FRONT:
+            success = linkedhashmap_move_to_front(map, key, key_size);
+            break;
+        case LINKEDHASHMAP_JOURNAL_INSERT_BEFORE:
+        case LINKEDHASHMAP_JOURNAL_INSERT_AFTER:
+            success = linkedhashmap_insert_relative(map, anchor, anchor_size, key, key_size, value, value_size, op == LINKEDHASHMAP_JOURNAL_INSERT_BEFORE);
+            break;
+        default:
+            return false;
+    }
+
+    // Whatever the record replaced is released, as are its own copies if it didn't apply
+    if (!success)
+    {
+        if (index == ~(size_t)0)
+            linkedhashmap_storage_release(map, key);
+
+        linkedhashmap_storage_release(map, value);
+        return false;
+    }
+
+    if (has_value || op == LINKEDHASHMAP_JOURNAL_POP)
+        linkedhashmap_storage_release(map, old_value);
+
+    *data = current;
+    return true;
+}
+
+bool linkedhashmap_journal_apply(LinkedHashMap* map, void* data, size_t size)
+{
+    unsigned char* current = (unsigned char*)data;
+    unsigned char* end = current + size;
+
+    while (current < end)
+    {
+        if (!linkedhashmap_journal_apply_record(map, &current, end))
+            return false;
+    }
+
+    return true;
+}
+
+static bool linkedhashmap_write_all(int fd, const unsigned char* data, size_t size)
+{
+    while (size > 0)
+    {
+        long written = (long)write(fd, data, size);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        data += written;
+        size -= (size_t)written;
+    }
+
+    return true;
+}
+
+static void linkedhashmap_writer_flush(LinkedHashMapWriter* writer)
+{
+    if (!writer->failed && !linkedhashmap_write_all(writer->fd, writer->buffer, writer->used))
+        writer->failed = true;
+
+    writer->used = 0;
+}
+
+static void linkedhashmap_writer_write(LinkedHashMapWriter* writer, const void* data, size_t size, bool checksummed)
+{
+    if (checksummed)
+        writer->checksum = linkedhashmap_hash_bytes(data, size, writer->checksum);
+
+    if (writer->used + size > LINKEDHASHMAP_IO_BUFFER_SIZE)
+        linkedhashmap_writer_flush(writer);
+
+    // Anything that would not fit in the buffer bypasses it
+    if (size > LINKEDHASHMAP_IO_BUFFER_SIZE)
+    {
+        if (!writer->failed && !linkedhashmap_write_all(writer->fd, (const unsigned char*)data, size))
+            writer->failed = true;
+
+        return;
+    }
+
+    memcpy(writer->buffer + writer->used, data, size);
+    writer->used += size;
+}
+
+static void linkedhashmap_writer_write_u64(LinkedHashMapWriter* writer, uint64_t value, bool checksummed)
+{
+    unsigned char bytes[8];
+
+    for (size_t i = 0; i < 8; i++)
+        bytes[i] = (unsigned char)(value >> (i * 8));
+
+    linkedhashmap_writer_write(writer, bytes, sizeof(bytes), checksummed);
+}
+
+static void linkedhashmap_writer_write_u32(LinkedHashMapWriter* writer, uint32_t value, bool checksummed)
+{
+    unsigned char bytes[4];
+
+    for (size_t i = 0; i < 4; i++)
+        bytes[i] = (unsigned char)(value >> (i * 8));
+
+    linkedhashmap_writer_write(writer, bytes, sizeof(bytes), checksummed);
+}
+
+static void linkedhashmap_writer_pad(LinkedHashMapWriter* writer, uint64_t size)
+{
+    static const unsigned char zeros[16] = { 0 };
+    linkedhashmap_writer_write(writer, zeros, (size_t)size, false);
+}
+
+static bool linkedhashmap_read_all(int fd, unsigned char* data, size_t size, size_t min_size, size_t* read_size)
+{
+    size_t total = 0;
+
+    while (total < min_size)
+    {
+        long count = (long)read(fd, data + total, size - total);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count <= 0)
+            return false;
+
+        total += (size_t)count;
+    }
+
+    *read_size = total;
+    return true;
+}
+
+static void linkedhashmap_reader_read(LinkedHashMapReader* reader, void* data, size_t size, bool checksummed)
+{
+    unsigned char* dest = (unsigned char*)data;
+    size_t buffered = reader->available - reader->used;
+
+    if (reader->failed)
+        return;
+
+    if (buffered >= size)
+    {
+        memcpy(dest, reader->buffer + reader->used, size);
+        reader->used += size;
+    }
+    else
+    {
+        size_t read_size;
+        memcpy(dest, reader->buffer + reader->used, buffered);
+        reader->used = 0;
+        reader->available = 0;
+
+        // Large reads go straight into their destination, and smaller ones refill the buffer
+        if (size - buffered > LINKEDHASHMAP_IO_BUFFER_SIZE)
+        {
+            if (!linkedhashmap_read_all(reader->fd, dest + buffered, size - buffered, size - buffered, &read_size))
+                reader->failed = true;
+        }
+        else
+        {
+            if (!linkedhashmap_read_all(reader->fd, reader->buffer, LINKEDHASHMAP_IO_BUFFER_SIZE, size - buffered, &read_size))
+                reader->failed = true;
+            else
+            {
+                memcpy(dest + buffered, reader->buffer, size - buffered);
+                reader->used = size - buffered;
+                reader->available = read_size;
+            }
+        }
+    }
+
+    if (checksummed && !reader->failed)
+        reader->checksum = linkedhashmap_hash_bytes(data, size, reader->checksum);
+}
+
+static uint64_t linkedhashmap_reader_read_u64(LinkedHashMapReader* reader, bool checksummed)
+{
+    unsigned char bytes[8] = { 0 };
+    uint64_t value = 0;
+
+    linkedhashmap_reader_read(reader, bytes, sizeof(bytes), checksummed);
+
+    for (size_t i = 0; i < 8; i++)
+        value |= (uint64_t)bytes[i] << (i * 8);
+
+    return value;
+}
+
+static bool linkedhashmap_snapshot_take(uint64_t data_size, uint64_t* data_used, uint64_t size)
+{
+    uint64_t remaining = data_size - *data_used;
+
+    if (size > remaining || LINKEDHASHMAP_SNAPSHOT_ALIGN(size) > remaining)
+        return false;
+
+    *data_used += LINKEDHASHMAP_SNAPSHOT_ALIGN(size);
+    return true;
+}
+
+uint64_t linkedhashmap_layout_fingerprint(LinkedHashMap* map)
+{
+    uint64_t fingerprint = 0;
+
+    if (LINKEDHASHMAP_IS_SMALL(map->capacity))
+        return fingerprint;
+
+    for (uint64_t i = 0; i < 16; i++)
+        fingerprint = linkedhashmap_mix(fingerprint ^ (uint64_t)linkedhashmap_hash(map, &i, sizeof(i)));
+
+    return fingerprint;
+}
+
+bool linkedhashmap_save(LinkedHashMap* map, int fd, bool include_layout)
+{
+    LinkedHashMapWriter* writer = (LinkedHashMapWriter*)malloc(sizeof(LinkedHashMapWriter));
+    size_t index = map->head;
+    uint64_t data_size = 0;
+
+    writer->fd = fd;
+    writer->failed = false;
+    writer->checksum = 0;
+    writer->used = 0;
+
+    while (index != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        data_size += LINKEDHASHMAP_SNAPSHOT_ALIGN(current->key_size) + LINKEDHASHMAP_SNAPSHOT_ALIGN(current->value_size);
+        index = current->next;
+    }
+
+    linkedhashmap_writer_write(writer, LINKEDHASHMAP_SNAPSHOT_MAGIC, 8, true);
+    linkedhashmap_writer_write_u64(writer, LINKEDHASHMAP_SNAPSHOT_VERSION, true);
+    linkedhashmap_writer_write_u64(writer, include_layout ? LINKEDHASHMAP_SNAPSHOT_LAYOUT : 0, true);
+    linkedhashmap_writer_write_u64(writer, map->length, true);
+    linkedhashmap_writer_write_u64(writer, map->capacity, true);
+    linkedhashmap_writer_write_u64(writer, include_layout ? linkedhashmap_layout_fingerprint(map) : 0, true);
+    linkedhashmap_writer_write_u64(writer, data_size, true);
+
+    index = map->head;
+
+    while (index != LINKEDHASHMAP_NO_NODE && !writer->failed)
+    {
+        LinkedHashMapNode* current = LINKEDHASHMAP_NODE(map, index);
+        linkedhashmap_writer_write_u64(writer, current->key_size, true);
+        linkedhashmap_writer_write_u64(writer, current->value_size, true);
+
+        if (include_layout)
+            linkedhashmap_writer_write_u64(writer, (uint64_t)index, true);
+
+        linkedhashmap_writer_write(writer, current->key, current->key_size, true);
+        linkedhashmap_writer_write(writer, current->value, current->value_size, true);
+        index = current->next;
+    }
+
+    linkedhashmap_writer_write_u64(writer, writer->checksum, false);
+    linkedhashmap_writer_flush(writer);
+
+    bool success = !writer->failed;
+    free(writer);
+    return success;
+}
+
+static uint64_t linkedhashmap_reader_remaining(LinkedHashMapReader* reader)
+{
+    uint64_t buffered = (uint64_t)(reader->available - reader->used);
+
+#ifdef _WIN32
+    long long size = _filelengthi64(reader->fd);
+    long long position = _telli64(reader->fd);
+
+    if (size < 0 || position < 0)
+        return UINT64_MAX;
+#else
+    struct stat st;
+    off_t size;
+    off_t position = lseek(reader->fd, 0, SEEK_CUR);
+
+    // Pipes and other streams have no known end, so nothing can be bounded by it
+    if (position < 0 || fstat(reader->fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return UINT64_MAX;
+
+    size = st.st_size;
+#endif
+
+    return size > position ? (uint64_t)(size - position) + buffered : buffered;
+}
+
+LinkedHashMap* linkedhashmap_load(int fd)
+{
+    LinkedHashMapReader* reader = (LinkedHashMapReader*)malloc(sizeof(LinkedHashMapReader));
+    LinkedHashMap* map = NULL;
+    uint64_t* records = NULL;
+    unsigned char* data = NULL;
+    char magic[8];
+
+    if (reader == NULL)
+        return NULL;
+
+    reader->fd = fd;
+    reader->failed = false;
+    reader->checksum = 0;
+    reader->used = 0;
+    reader->available = 0;
+
+    linkedhashmap_reader_read(reader, magic, sizeof(magic), true);
+    uint64_t version = linkedhashmap_reader_read_u64(reader, true);
+    uint64_t flags = linkedhashmap_reader_read_u64(reader, true);
+    uint64_t length = linkedhashmap_reader_read_u64(reader, true);
+    uint64_t capacity = linkedhashmap_reader_read_u64(reader, true);
+    uint64_t fingerprint = linkedhashmap_reader_read_u64(reader, true);
+    uint64_t data_size = linkedhashmap_reader_read_u64(reader, true);
+    bool has_layout = (flags & LINKEDHASHMAP_SNAPSHOT_LAYOUT) != 0;
+    uint64_t record_size = (has_layout ? 3 : 2) * sizeof(uint64_t);
+    uint64_t remaining = linkedhashmap_reader_remaining(reader);
+
+    // The header is not covered by the checksum until the whole snapshot has been read, so nothing is sized from it that the rest of the file can't back up. Every entry takes at least its record header, and aligning keys and values at most doubles the bytes they take in the file.
+    if (reader->failed
+        || memcmp(magic, LINKEDHASHMAP_SNAPSHOT_MAGIC, sizeof(magic)) != 0
+        || version != LINKEDHASHMAP_SNAPSHOT_VERSION
+        || length > capacity
+        || capacity > SIZE_MAX / sizeof(LinkedHashMapNode)
+        || remaining < sizeof(uint64_t)
+        || length > (remaining - sizeof(uint64_t)) / record_size
+        || length > SIZE_MAX / (3 * sizeof(uint64_t))
+        || data_size > SIZE_MAX
+        || data_size / 2 > remaining)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    // The map starts out in its inline table, and only gets a table of the stored capacity once the checksum has been verified
+    map = (LinkedHashMap*)malloc(sizeof(LinkedHashMap));
+    records = (uint64_t*)malloc(length > 0 ? (size_t)length * 3 * sizeof(uint64_t) : 1);
+
+    if (map != NULL)
+    {
+        linkedhashmap_init(map, 0);
+        data = (unsigned char*)linkedhashmap_storage_alloc(map, (size_t)data_size);
+    }
+
+    if (data == NULL || records == NULL)
+        reader->failed = true;
+
+    uint64_t data_used = 0;
+
+    for (uint64_t i = 0; i < length && !reader->failed; i++)
+    {
+        uint64_t* record = records + i * 3;
+        record[0] = linkedhashmap_reader_read_u64(reader, true);
+        record[1] = linkedhashmap_reader_read_u64(reader, true);
+        record[2] = has_layout ? linkedhashmap_reader_read_u64(reader, true) : 0;
+
+        uint64_t key_offset = data_used;
+        bool valid = !reader->failed && linkedhashmap_snapshot_take(data_size, &data_used, record[0]);
+        uint64_t value_offset = data_used;
+        valid = valid && linkedhashmap_snapshot_take(data_size, &data_used, record[1]);
+
+        if (!valid)
+        {
+            reader->failed = true;
+            break;
+        }
+
+        linkedhashmap_reader_read(reader, data + key_offset, (size_t)record[0], true);
+        linkedhashmap_reader_read(reader, data + value_offset, (size_t)record[1], true);
+    }
+
+    uint64_t expected_checksum = reader->checksum;
+    uint64_t checksum = linkedhashmap_reader_read_u64(reader, false);
+
+    if (!reader->failed && checksum != expected_checksum)
+        reader->failed = true;
+
+    if (!reader->failed && !LINKEDHASHMAP_IS_SMALL(capacity))
+    {
+        size_t table_size = capacity < LINKEDHASHMAP_MIN_SIZE ? LINKEDHASHMAP_MIN_SIZE : (size_t)capacity;
+        LinkedHashMapNode* nodes = linkedhashmap_nodes_alloc(map, table_size);
+
+        if (nodes == NULL)
+            reader->failed = true;
+        else
+        {
+            map->nodes = nodes;
+            map->capacity = table_size;
+
+            for (size_t i = 0; i < table_size; i++)
+                map->nodes[i].is_allocated = false;
+
+            linkedhashmap_hash_init(map);
+        }
+    }
+
+    bool use_layout = false;
+
+    if (!reader->failed)
+    {
+        // The stored layout is only usable if this map places keys into the same slots, which requires the same hash seed as the writer. The seed is secret and drawn anew by every process, so it is never stored, and layouts are only reused by the process that wrote them.
+        use_layout = has_layout
+            && !LINKEDHASHMAP_IS_SMALL(map->capacity)
+            && fingerprint == linkedhashmap_layout_fingerprint(map);
+    }
+
+    data_used = 0;
+
+    for (uint64_t i = 0; i < length && !reader->failed; i++)
+    {
+        uint64_t* record = records + i * 3;
+        unsigned char* key = data + data_used;
+        data_used += LINKEDHASHMAP_SNAPSHOT_ALIGN(record[0]);
+        unsigned char* value = data + data_used;
+        data_used += LINKEDHASHMAP_SNAPSHOT_ALIGN(record[1]);
+
+        if (!use_layout)
+            linkedhashmap_insert_new(map, key, (size_t)record[0], value, (size_t)record[1]);
+        else if (record[2] < map->capacity && !map->nodes[record[2]].is_allocated)
+            linkedhashmap_insert_at(map, (size_t)record[2], (size_t)record[2], key, (size_t)record[0], value, (size_t)record[1]);
+        else
+            reader->failed = true;
+    }
+
+    if (reader->failed)
+    {
+        if (map != NULL)
+            linkedhashmap_free(map);
+
+        map = NULL;
+    }
+    else if (map->hash_flooded)
+        linkedhashmap_use_strong_hash(map);
+
+    free(records);
+    free(reader);
+    return map;
+}
+
+#ifndef _WIN32
+
+size_t linkedhashmap_frozen_slot(uint64_t hash, uint32_t displacement, size_t length)
+{
+    return (size_t)(linkedhashmap_mix(hash ^ linkedhashmap_mix((uint64_t)displacement + 1)) % length);
+}
+
+static bool linkedhashmap_frozen_build(uint64_t* hashes, size_t length, size_t bucket_count, uint32_t* displacements, uint64_t* slots)
+{
+    size_t* bucket_starts = (size_t*)calloc(bucket_count + 1, sizeof(size_t));
+    size_t* members = (size_t*)malloc((length > 0 ? length : 1) * sizeof(size_t));
+    unsigned char* taken = (unsigned char*)calloc(length > 0 ? length : 1, sizeof(unsigned char));
+    size_t max_bucket_size = 0;
+    bool success = true;
+
+    // Group entries by bucket with a counting sort
+    for (size_t i = 0; i < length; i++)
+        bucket_starts[hashes[i] % bucket_count + 1]++;
+
+    for (size_t i = 0; i < bucket_count; i++)
+    {
+        if (bucket_starts[i + 1] > max_bucket_size)
+            max_bucket_size = bucket_starts[i + 1];
+
+        bucket_starts[i + 1] += bucket_starts[i];
+    }
+
+    size_t* bucket_fill = (size_t*)malloc((bucket_count + 1) * sizeof(size_t));
+    memcpy(bucket_fill, bucket_starts, (bucket_count + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < length; i++)
+        members[bucket_fill[hashes[i] % bucket_count]++] = i;
+
+    free(bucket_fill);
+
+    // Place the largest buckets first, while the most slots are still free
+    for (size_t size = max_bucket_size; size > 0 && success; size--)
+    {
+        for (size_t bucket = 0; bucket < bucket_count && success; bucket++)
+        {
+            size_t start = bucket_starts[bucket];
+
+            if (bucket_starts[bucket + 1] - start != size)
+                continue;
+
+            uint64_t max_attempts = (uint64_t)length * 16 + 1024;
+            bool placed = false;
+
+            for (uint64_t displacement = 0; displacement < max_attempts && displacement < UINT32_MAX && !placed; displacement++)
+            {
+                size_t claimed = 0;
+
+                for (; claimed < size; claimed++)
+                {
+                    size_t slot = linkedhashmap_frozen_slot(hashes[members[start + claimed]], (uint32_t)displacement, length);
+
+                    if (taken[slot])
+                        break;
+
+                    taken[slot] = 1;
+                    slots[members[start + claimed]] = slot;
+                }
+
+                placed = claimed == size;
+
+                if (!placed)
+                {
+                    for (size_t i = 0; i < claimed; i++)
+                        taken[slots[members[start + i]]] = 0;
+                }
+                else
+                    displacements[bucket] = (uint32_t)displacement;
+            }
+
+            success = placed;
+        }
+    }
+
+    free(bucket_starts);
+    free(members);
+    free(taken);
+    return success;
+}
+
+bool linkedhashmap_freeze(LinkedHashMap* map, const char* path)
+{
+    size_t length = map->length;
+    size_t bucket_count = length / LINKEDHASHMAP_FROZEN_BUCKET_LOAD + 1;
+    uint64_t* hashes = (uint64_t*)malloc((length > 0 ? length : 1) * sizeof(uint64_t));
+    uint64_t* slots = (uint64_t*)malloc((length > 0 ? length : 1) * sizeof(uint64_t));
+    uint64_t* data_offsets = (uint64_t*)malloc((length > 0 ? length : 1) * 2 * sizeof(uint64_t));
+    uint32_t* displacements = (uint32_t*)calloc(bucket_count, sizeof(uint32_t));
+    LinkedHashMapNode** nodes = (LinkedHashMapNode**)malloc((length > 0 ? length : 1) * sizeof(LinkedHashMapNode*));
+    uint64_t seed = 0;
+    bool built = false;
+
+    size_t index = map->head;
+
+    for (size_t i = 0; index != LINKEDHASHMAP_NO_NODE; i++)
+    {
+        nodes[i] = LINKEDHASHMAP_NODE(map, index);
+        index = nodes[i]->next;
+    }
+
+    for (size_t attempt = 0; attempt < LINKEDHASHMAP_FROZEN_MAX_SEEDS && !built; attempt++)
+    {
+        seed = linkedhashmap_mix(seed + attempt + 1);
+
+        for (size_t i = 0; i < length; i++)
+            hashes[i] = linkedhashmap_hash_bytes(nodes[i]->key, nodes[i]->key_size, seed);
+
+        built = linkedhashmap_frozen_build(hashes, length, bucket_count, displacements, slots);
+    }
+
+    char* tmp_path = (char*)malloc(strlen(path) + 5);
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
+
+    int fd = built ? open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    bool success = fd >= 0;
+
+    if (success)
+    {
+        uint64_t displacements_offset = LINKEDHASHMAP_FROZEN_HEADER_SIZE;
+        uint64_t records_offset = LINKEDHASHMAP_SNAPSHOT_ALIGN(displacements_offset + bucket_count * sizeof(uint32_t));
+        uint64_t order_offset = records_offset + length * sizeof(LinkedHashMapFrozenRecord);
+        uint64_t data_offset = LINKEDHASHMAP_SNAPSHOT_ALIGN(order_offset + length * sizeof(uint64_t));
+        uint64_t data_size = 0;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            data_offsets[i * 2] = data_offset + data_size;
+            data_size += LINKEDHASHMAP_SNAPSHOT_ALIGN(nodes[i]->key_size);
+            data_offsets[i * 2 + 1] = data_offset + data_size;
+            data_size += LINKEDHASHMAP_SNAPSHOT_ALIGN(nodes[i]->value_size);
+        }
+
+        // Records are laid out by slot, so invert the slot assignment
+        uint64_t* slot_entries = (uint64_t*)malloc((length > 0 ? length : 1) * sizeof(uint64_t));
+
+        for (size_t i = 0; i < length; i++)
+            slot_entries[slots[i]] = i;
+
+        LinkedHashMapWriter* writer = (LinkedHashMapWriter*)malloc(sizeof(LinkedHashMapWriter));
+        writer->fd = fd;
+        writer->failed = false;
+        writer->checksum = 0;
+        writer->used = 0;
+
+        linkedhashmap_writer_write(writer, LINKEDHASHMAP_FROZEN_MAGIC, 8, false);
+        linkedhashmap_writer_write_u64(writer, LINKEDHASHMAP_FROZEN_BYTE_ORDER, false);
+        linkedhashmap_writer_write_u64(writer, LINKEDHASHMAP_FROZEN_VERSION, false);
+        linkedhashmap_writer_write_u64(writer, length, false);
+        linkedhashmap_writer_write_u64(writer, bucket_count, false);
+        linkedhashmap_writer_write_u64(writer, seed, false);
+        linkedhashmap_writer_write_u64(writer, displacements_offset, false);
+        linkedhashmap_writer_write_u64(writer, records_offset, false);
+        linkedhashmap_writer_write_u64(writer, order_offset, false);
+        linkedhashmap_writer_write_u64(writer, data_offset, false);
+        linkedhashmap_writer_write_u64(writer, data_offset + data_size, false);
+
+        for (size_t i = 0; i < bucket_count; i++)
+            linkedhashmap_writer_write_u32(writer, displacements[i], false);
+
+        linkedhashmap_writer_pad(writer, records_offset - (displacements_offset + bucket_count * sizeof(uint32_t)));
+
+        for (size_t slot = 0; slot < length; slot++)
+        {
+            size_t i = slot_entries[slot];
+            linkedhashmap_writer_write_u64(writer, data_offsets[i * 2], false);
+            linkedhashmap_writer_write_u64(writer, nodes[i]->key_size, false);
+            linkedhashmap_writer_write_u64(writer, data_offsets[i * 2 + 1], false);
+            linkedhashmap_writer_write_u64(writer, nodes[i]->value_size, false);
+            linkedhashmap_writer_write_u64(writer, i, false);
+        }
+
+        for (size_t i = 0; i < length; i++)
+            linkedhashmap_writer_write_u64(writer, slots[i], false);
+
+        linkedhashmap_writer_pad(writer, data_offset - (order_offset + length * sizeof(uint64_t)));
+
+        for (size_t i = 0; i < length; i++)
+        {
+            linkedhashmap_writer_write(writer, nodes[i]->key, nodes[i]->key_size, false);
+            linkedhashmap_writer_pad(writer, LINKEDHASHMAP_SNAPSHOT_ALIGN(nodes[i]->key_size) - nodes[i]->key_size);
+            linkedhashmap_writer_write(writer, nodes[i]->value, nodes[i]->value_size, false);
+            linkedhashmap_writer_pad(writer, LINKEDHASHMAP_SNAPSHOT_ALIGN(nodes[i]->value_size) - nodes[i]->value_size);
+        }
+
+        linkedhashmap_writer_flush(writer);
+        success = !writer->failed;
+        free(writer);
+        free(slot_entries);
+
+        if (close(fd) != 0)
+            success = false;
+
+        // Renaming into place means readers never see a partially written file
+        if (success && rename(tmp_path, path) != 0)
+            success = false;
+
+        if (!success)
+            unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(hashes);
+    free(slots);
+    free(data_offsets);
+    free(displacements);
+    free(nodes);
+    return success;
+}
+
+static bool linkedhashmap_frozen_fits(uint64_t offset, uint64_t size, uint64_t start, uint64_t end)
+{
+    // Compared by subtraction, so that no offset or size read from the file can overflow
+    return offset >= start && offset <= end && size <= end - offset;
+}
+
+FrozenLinkedHashMap* linkedhashmap_frozen_open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &file_stat) != 0 || (uint64_t)file_stat.st_size < LINKEDHASHMAP_FROZEN_HEADER_SIZE)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t mapping_size = (size_t)file_stat.st_size;
+    void* mapping = mmap(NULL, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    uint64_t header[LINKEDHASHMAP_FROZEN_HEADER_SIZE / sizeof(uint64_t)];
+    memcpy(header, mapping, sizeof(header));
+
+    unsigned char* base = (unsigned char*)mapping;
+    uint64_t length = header[3];
+    uint64_t bucket_count = header[4];
+    uint64_t displacements_offset = header[6];
+    uint64_t records_offset = header[7];
+    uint64_t order_offset = header[8];
+    uint64_t data_offset = header[9];
+
+    // The file is read in place, so it must have been written with this machine's byte order, and every section must lie within it in the order they are written
+    bool valid = memcmp(mapping, LINKEDHASHMAP_FROZEN_MAGIC, 8) == 0
+        && header[1] == LINKEDHASHMAP_FROZEN_BYTE_ORDER
+        && header[2] == LINKEDHASHMAP_FROZEN_VERSION
+        && header[10] == mapping_size
+        && bucket_count != 0
+        && bucket_count <= mapping_size / sizeof(uint32_t)
+        && length <= mapping_size / sizeof(LinkedHashMapFrozenRecord)
+        && displacements_offset % sizeof(uint32_t) == 0
+        && records_offset % sizeof(uint64_t) == 0
+        && order_offset % sizeof(uint64_t) == 0
+        && linkedhashmap_frozen_fits(displacements_offset, bucket_count * sizeof(uint32_t), LINKEDHASHMAP_FROZEN_HEADER_SIZE, mapping_size)
+        && linkedhashmap_frozen_fits(records_offset, length * sizeof(LinkedHashMapFrozenRecord), displacements_offset + bucket_count * sizeof(uint32_t), mapping_size)
+        && linkedhashmap_frozen_fits(order_offset, length * sizeof(uint64_t), records_offset + length * sizeof(LinkedHashMapFrozenRecord), mapping_size)
+        && linkedhashmap_frozen_fits(data_offset, 0, order_offset + length * sizeof(uint64_t), mapping_size);
+
+    LinkedHashMapFrozenRecord* records = (LinkedHashMapFrozenRecord*)(void*)(base + records_offset);
+    uint64_t* order = (uint64_t*)(void*)(base + order_offset);
+
+    // Lookups trust every record and order entry without checking them again, so a damaged file is turned away here rather than read out of bounds later
+    for (uint64_t i = 0; i < length && valid; i++)
+    {
+        valid = linkedhashmap_frozen_fits(records[i].key_offset, records[i].key_size, data_offset, mapping_size)
+            && linkedhashmap_frozen_fits(records[i].value_offset, records[i].value_size, data_offset, mapping_size)
+            && records[i].index < length
+            && order[i] < length;
+    }
+
+    if (!valid)
+    {
+        munmap(mapping, mapping_size);
+        return NULL;
+    }
+
+    FrozenLinkedHashMap* map = (FrozenLinkedHashMap*)malloc(sizeof(FrozenLinkedHashMap));
+
+    if (map == NULL)
+    {
+        munmap(mapping, mapping_size);
+        return NULL;
+    }
+
+    map->length = (size_t)length;
+    map->bucket_count = (size_t)bucket_count;
+    map->seed = header[5];
+    map->displacements = (uint32_t*)(void*)(base + displacements_offset);
+    map->records = records;
+    map->order = order;
+    map->data = base;
+    map->mapping = mapping;
+    map->mapping_size = mapping_size;
     return map;
 }
 
-size_t linkedhashmap_hash(LinkedHashMap* map, void* key, size_t key_size)
+size_t linkedhashmap_frozen_find_key(FrozenLinkedHashMap* map, void* key, size_t key_size)
 {
-    size_t hashvalue = 0;
+    if (map->length == 0)
+        return ~0;
 
-    for (size_t i = 0; i < key_size; i++)
-        hashvalue += (size_t)(*((char*)key + i));
+    uint64_t hash = linkedhashmap_hash_bytes(key, key_size, map->seed);
+    size_t slot = linkedhashmap_frozen_slot(hash, map->displacements[hash % map->bucket_count], map->length);
+    LinkedHashMapFrozenRecord* record = &(map->records[slot]);
+
+    // Keys that are not in the map still land on some slot, so the key itself must be compared
+    if (!linkedhashmap_mem_equal(key, key_size, map->data + record->key_offset, record->key_size))
+        return ~0;
 
-    return hashvalue % map->capacity;
+    return slot;
 }
 
-bool linkedhashmap_mem_equal(void* p1, size_t size1, void* p2, size_t size2)
+size_t linkedhashmap_frozen_length(FrozenLinkedHashMap* map)
 {
-    if (size1 != size2)
-        return false;
+    return map->length;
+}
 
-    return memcmp(p1, p2, size1) == 0;
+bool linkedhashmap_frozen_is_empty(FrozenLinkedHashMap* map)
+{
+    return map->length == 0;
 }
 
-size_t linkedhashmap_find_key(LinkedHashMap* map, void* key, size_t key_size)
+LinkedHashMapEntry* linkedhashmap_frozen_entry(FrozenLinkedHashMap* map, size_t slot)
 {
-    size_t hashvalue = linkedhashmap_hash(map, key, key_size);
-    size_t current;
+    LinkedHashMapFrozenRecord* record = &(map->records[slot]);
+    LinkedHashMapEntry* res = (LinkedHashMapEntry*)malloc(sizeof(LinkedHashMapEntry));
+    res->key = map->data + record->key_offset;
+    res->key_size = record->key_size;
+    res->value = map->data + record->value_offset;
+    res->value_size = record->value_size;
+    return res;
+}
 
-    for (size_t i = 0; i < map->capacity; i++)
-    {
-        current = (hashvalue + i) % map->capacity;
+LinkedHashMapEntry* linkedhashmap_frozen_get(FrozenLinkedHashMap* map, void* key, size_t key_size)
+{
+    size_t slot = linkedhashmap_frozen_find_key(map, key, key_size);
 
-        if (map->nodes[current].is_allocated
-            && linkedhashmap_mem_equal(key, key_size, map->nodes[current].key, map->nodes[current].key_size))
-            return current;
-    }
+    if (slot == ~(size_t)0)
+        return NULL;
 
-    return ~0;
+    return linkedhashmap_frozen_entry(map, slot);
 }
 
-size_t linkedhashmap_length(LinkedHashMap* map)
+LinkedHashMapEntry* linkedhashmap_frozen_get_by_index(FrozenLinkedHashMap* map, size_t index)
 {
-    return map->length;
+    if (index >= map->length)
+        return NULL;
+
+    return linkedhashmap_frozen_entry(map, map->order[index]);
 }
 
-bool linkedhashmap_is_empty(LinkedHashMap* map)
+size_t linkedhashmap_frozen_get_index(FrozenLinkedHashMap* map, void* key, size_t key_size)
 {
-    return map->length == 0;
+    size_t slot = linkedhashmap_frozen_find_key(map, key, key_size);
+
+    if (slot == ~(size_t)0)
+        return ~0;
+
+    return map->records[slot].index;
 }
 
-LinkedHashMapKey* linkedhashmap_keys(LinkedHashMap* map)
+bool linkedhashmap_frozen_contains(FrozenLinkedHashMap* map, void* key, size_t key_size)
 {
-    LinkedHashMapKey* map_keys = (LinkedHashMapKey*)malloc(map->length * sizeof(LinkedHashMapKey));
-    size_t found = 0;
-    LinkedHashMapNode* current = map->head;
+    return linkedhashmap_frozen_find_key(map, key, key_size) != ~(size_t)0;
+}
 
-    while (current != NULL)
+void linkedhashmap_frozen_foreach(FrozenLinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg)
+{
+    for (size_t i = 0; i < map->length; i++)
     {
-        map_keys[found].key = current->key;
-        map_keys[found++].key_size = current->key_size;
-        current = current->next;
+        LinkedHashMapFrozenRecord* record = &(map->records[map->order[i]]);
+        (*fn)(map->data + record->key_offset, record->key_size, map->data + record->value_offset, record->value_size, arg);
     }
+}
 
-    return map_keys;
+void linkedhashmap_frozen_close(FrozenLinkedHashMap* map)
+{
+    munmap(map->mapping, map->mapping_size);
+    free(map);
 }
 
-LinkedHashMapValue* linkedhashmap_values(LinkedHashMap* map)
+LinkedHashMap* linkedhashmap_load_delimited(const char* path, char field_delimiter, char record_delimiter)
 {
-    LinkedHashMapValue* map_values = (LinkedHashMapValue*)malloc(map->length * sizeof(LinkedHashMapValue));
-    size_t found = 0;
-    LinkedHashMapNode* current = map->head;
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+
+    if (fd < 0)
+        return NULL;
 
-    while (current != NULL)
+    if (fstat(fd, &file_stat) != 0)
     {
-        map_values[found].value = current->value;
-        map_values[found++].value_size = current->value_size;
-        current = current->next;
+        close(fd);
+        return NULL;
     }
 
-    return map_values;
-}
+    LinkedHashMap* map = linkedhashmap_new();
+    size_t size = (size_t)file_stat.st_size;
 
-LinkedHashMapEntry* linkedhashmap_entries(LinkedHashMap* map)
-{
-    LinkedHashMapEntry* map_entries = (LinkedHashMapEntry*)malloc(map->length * sizeof(LinkedHashMapEntry));
-    size_t found = 0;
-    LinkedHashMapNode* current = map->head;
+    if (size == 0)
+    {
+        close(fd);
+        return map;
+    }
+
+    // A private writable mapping lets callers modify values in place without touching the file
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
 
-    while (current != NULL)
+    if (mapping == MAP_FAILED)
     {
-        map_entries[found].key = current->key;
-        map_entries[found].key_size = current->key_size;
-        map_entries[found].value = current->value;
-        map_entries[found++].value_size = current->value_size;
-        current = current->next;
+        linkedhashmap_free(map);
+        return NULL;
     }
 
-    return map_entries;
-}
+    madvise(mapping, size, MADV_SEQUENTIAL);
 
-void linkedhashmap_resize(LinkedHashMap* map, size_t new_size)
-{
-    LinkedHashMapEntry* map_entries = (LinkedHashMapEntry*)malloc(map->length * sizeof(LinkedHashMapEntry));
-    size_t found = 0;
-    LinkedHashMapNode* current = map->head;
+    LinkedHashMapStorage* storage = (LinkedHashMapStorage*)malloc(sizeof(LinkedHashMapStorage));
+    storage->data = mapping;
+    storage->size = size;
+    storage->is_mapped = true;
+    storage->next = map->storage;
+    map->storage = storage;
+
+    char* start = (char*)mapping;
+    char* end = start + size;
+    char* record;
+    char* record_end;
+    size_t records = 0;
 
-    while (current != NULL)
+    // memchr is vectorized by the C library, so both passes run at close to memory bandwidth
+    for (record = start; record < end && (record_end = (char*)memchr(record, record_delimiter, (size_t)(end - record))) != NULL; record = record_end + 1)
+        records++;
+
+    linkedhashmap_reserve(map, records + 1);
+
+    for (record = start; record < end; record = record_end + 1)
     {
-        map_entries[found].key = current->key;
-        map_entries[found].key_size = current->key_size;
-        map_entries[found].value = current->value;
-        map_entries[found++].value_size = current->value_size;
-        current = current->next;
-    }
+        record_end = (char*)memchr(record, record_delimiter, (size_t)(end - record));
 
-    map->length = 0;
-    map->capacity = new_size;
-    map->nodes = (LinkedHashMapNode*)realloc(map->nodes, new_size * sizeof(LinkedHashMapNode));
-    map->head = NULL;
-    map->tail = NULL;
+        if (record_end == NULL)
+            record_end = end;
 
-    for (size_t i = 0; i < map->capacity; i++)
-        map->nodes[i].is_allocated = false;
+        size_t record_size = (size_t)(record_end - record);
 
-    for (size_t i = 0; i < found; i++)
-        linkedhashmap_set(map, map_entries[i].key, map_entries[i].key_size, map_entries[i].value, map_entries[i].value_size);
+        if (record_delimiter == '\n' && record_size > 0 && record[record_size - 1] == '\r')
+            record_size--;
 
-    free(map_entries);
-}
+        if (record_size == 0)
+            continue;
 
-void linkedhashmap_resize_up(LinkedHashMap* map)
-{
-    size_t new_size = map->capacity << 1;
-    linkedhashmap_resize(map, new_size);
+        char* field_end = (char*)memchr(record, field_delimiter, record_size);
+        size_t key_size = field_end != NULL ? (size_t)(field_end - record) : record_size;
+        char* value = field_end != NULL ? field_end + 1 : record + record_size;
+        size_t value_size = record_size - (size_t)(value - record);
+
+        LinkedHashMapEntry* res = linkedhashmap_set(map, record, key_size, value, value_size);
+
+        if (res != NULL)
+            free(res);
+    }
+
+    return map;
 }
 
-void linkedhashmap_resize_down(LinkedHashMap* map)
+
+static uint64_t linkedhashmap_wal_snapshot_size(LinkedHashMap* map)
 {
-    size_t new_size = map->capacity >> 1;
+    // Snapshots in the log never include the layout, so their size follows from the entries alone
+    uint64_t size = 7 * sizeof(uint64_t) + sizeof(uint64_t);
 
-    if (new_size < LINKEDHASHMAP_MIN_SIZE)
-        new_size = LINKEDHASHMAP_MIN_SIZE;
+    for (size_t index = map->head; index != LINKEDHASHMAP_NO_NODE; index = LINKEDHASHMAP_NODE(map, index)->next)
+        size += 2 * sizeof(uint64_t) + LINKEDHASHMAP_NODE(map, index)->key_size + LINKEDHASHMAP_NODE(map, index)->value_size;
 
-    linkedhashmap_resize(map, new_size);
+    return size;
 }
 
-LinkedHashMapEntry* linkedhashmap_get(LinkedHashMap* map, void* key, size_t key_size)
+static bool linkedhashmap_wal_sync_directory(const char* path)
 {
-    size_t hashvalue = linkedhashmap_hash(map, key, key_size);
-    size_t current;
+    const char* slash = strrchr(path, '/');
+    size_t length = slash != NULL ? (size_t)(slash - path) + 1 : 1;
+    char* directory = (char*)malloc(length + 1);
 
-    for (size_t i = 0; i < map->capacity; i++)
-    {
-        current = (hashvalue + i) % map->capacity;
+    memcpy(directory, slash != NULL ? path : ".", length);
+    directory[length] = '\0';
 
-        if (linkedhashmap_mem_equal(key, key_size, map->nodes[current].key, map->nodes[current].key_size)
-            && map->nodes[current].is_allocated)
-        {
-            LinkedHashMapEntry* res = (LinkedHashMapEntry*)malloc(sizeof(LinkedHashMapEntry));
-            res->key = map->nodes[current].key;
-            res->key_size = map->nodes[current].key_size;
-            res->value = map->nodes[current].value;
-            res->value_size = map->nodes[current].value_size;
-            return res;
-        }
-    }
+    int fd = open(directory, O_RDONLY);
+    bool success = fd >= 0 && fsync(fd) == 0;
 
-    return NULL;
+    if (fd >= 0)
+        close(fd);
+
+    free(directory);
+    return success;
 }
 
-LinkedHashMapEntry* linkedhashmap_get_by_index(LinkedHashMap* map, size_t index)
+static bool linkedhashmap_wal_write_snapshot(LinkedHashMap* map, const char* path, uint64_t* snapshot_size)
 {
-    LinkedHashMapNode* current = map->head;
+    char* tmp_path = (char*)malloc(strlen(path) + 5);
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
 
-    for (size_t i = 0; i < index && current != NULL; i++)
-        current = current->next;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool success = fd >= 0 && linkedhashmap_save(map, fd, false) && fsync(fd) == 0;
 
-    if (current == NULL)
-        return NULL;
+    if (fd >= 0 && close(fd) != 0)
+        success = false;
 
-    LinkedHashMapEntry* res = (LinkedHashMapEntry*)malloc(sizeof(LinkedHashMapEntry));
-    res->key = current->key;
-    res->key_size = current->key_size;
-    res->value = current->value;
-    res->value_size = current->value_size;
-    return res;
+    // The snapshot replaces the whole log in a single rename, so a crash leaves either the old snapshot and its records or the new snapshot alone
+    success = success && rename(tmp_path, path) == 0 && linkedhashmap_wal_sync_directory(path);
+
+    if (!success)
+        unlink(tmp_path);
+
+    free(tmp_path);
+    *snapshot_size = linkedhashmap_wal_snapshot_size(map);
+    return success;
 }
 
-size_t linkedhashmap_get_index(LinkedHashMap* map, void* key, size_t key_size)
+static bool linkedhashmap_wal_replay(LinkedHashMap* map, int fd, uint64_t* snapshot_size, uint64_t* log_size)
 {
-    LinkedHashMapNode* current = map->head;
+    struct stat st;
+
+    *snapshot_size = linkedhashmap_wal_snapshot_size(map);
+    *log_size = 0;
+
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < *snapshot_size || (uint64_t)st.st_size - *snapshot_size > SIZE_MAX)
+        return false;
+
+    size_t size = (size_t)((uint64_t)st.st_size - *snapshot_size);
+    unsigned char* data = (unsigned char*)malloc(size > 0 ? size : 1);
+    unsigned char* current = data;
+    unsigned char* end = data + size;
+    size_t read_size;
+    bool success = lseek(fd, (off_t)*snapshot_size, SEEK_SET) >= 0 && linkedhashmap_read_all(fd, data, size, size, &read_size);
 
-    for (size_t i = 0; current != NULL; i++)
+    while (success && current < end)
     {
-        if (linkedhashmap_mem_equal(current->key, current->key_size, key, key_size))
-            return i;
+        unsigned char* record = current;
+        uint64_t body_size;
+        uint64_t checksum = 0;
 
-        current = current->next;
+        // A record cut short by a crash, or one that fails its checksum, marks the end of what was made durable
+        if (!linkedhashmap_varint_decode(&current, end, &body_size)
+            || body_size > (uint64_t)(end - current)
+            || (uint64_t)(end - current) - body_size < sizeof(uint64_t))
+            break;
+
+        unsigned char* record_end = current + body_size;
+
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+            checksum |= (uint64_t)record_end[i] << (i * 8);
+
+        if (checksum != linkedhashmap_hash_bytes(record, (size_t)(record_end - record), 0))
+            break;
+
+        current = record;
+        success = linkedhashmap_journal_apply_record(map, &current, record_end);
+        current = record_end + sizeof(uint64_t);
+        *log_size = (uint64_t)(current - data);
     }
 
-    return ~0;
+    // Anything after the last intact record was never acknowledged, so it is cut off before new records are appended
+    if (success && *log_size < size)
+        success = ftruncate(fd, (off_t)(*snapshot_size + *log_size)) == 0;
+
+    free(data);
+    return success;
 }
 
-LinkedHashMapEntry* linkedhashmap_set(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size)
+LinkedHashMap* linkedhashmap_wal_open(const char* path)
 {
-    size_t existing_index = linkedhashmap_find_key(map, key, key_size);
+    int fd = open(path, O_RDWR);
+    LinkedHashMap* map = NULL;
+    uint64_t snapshot_size = 0;
+    uint64_t log_size = 0;
 
-    if (existing_index == ~(size_t)0)
+    if (fd < 0)
     {
-        size_t hashvalue = linkedhashmap_hash(map, key, key_size);
-        size_t current;
+        if (errno != ENOENT)
+            return NULL;
 
-        for (size_t i = 0; i < map->capacity; i++)
-        {
-            current = (hashvalue + i) % map->capacity;
-
-            if (!map->nodes[current].is_allocated)
-            {
-                map->nodes[current].key = key;
-                map->nodes[current].key_size = key_size;
-                map->nodes[current].value = value;
-                map->nodes[current].value_size = value_size;
-                map->nodes[current].is_allocated = true;
-                map->nodes[current].prev = map->tail;
-                map->nodes[current].next = NULL;
-
-                if (map->length == 0)
-                {
-                    map->head = &(map->nodes[current]);
-                }
-                else
-                {
-                    map->tail->next = &(map->nodes[current]);
-                }
+        // A missing log starts out as the snapshot of an empty map
+        map = linkedhashmap_new();
 
-                map->tail = &(map->nodes[current]);
-                map->length++;
-                return NULL;
-            }
+        if (!linkedhashmap_wal_write_snapshot(map, path, &snapshot_size) || (fd = open(path, O_RDWR)) < 0)
+        {
+            linkedhashmap_free(map);
+            return NULL;
         }
-
-        linkedhashmap_resize_up(map);
-        return linkedhashmap_set(map, key, key_size, value, value_size);
     }
     else
     {
-        LinkedHashMapEntry* res = (LinkedHashMapEntry*)malloc(sizeof(LinkedHashMapEntry));
-        res->key = map->nodes[existing_index].key;
-        res->key_size = map->nodes[existing_index].key_size;
-        res->value = map->nodes[existing_index].value;
-        res->value_size = map->nodes[existing_index].value_size;
+        map = linkedhashmap_load(fd);
 
-        map->nodes[existing_index].value = value;
+        // Replayed records are already in the log, so the log is only attached once they have all been applied
+        if (map != NULL && !linkedhashmap_wal_replay(map, fd, &snapshot_size, &log_size))
+        {
+            linkedhashmap_free(map);
+            map = NULL;
+        }
 
-        return res;
+        if (map == NULL)
+        {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    if (lseek(fd, (off_t)(snapshot_size + log_size), SEEK_SET) < 0)
+    {
+        close(fd);
+        linkedhashmap_free(map);
+        return NULL;
     }
+
+    LinkedHashMapWal* wal = (LinkedHashMapWal*)malloc(sizeof(LinkedHashMapWal));
+    wal->fd = fd;
+    wal->path = (char*)malloc(strlen(path) + 1);
+    strcpy(wal->path, path);
+    wal->buffer = NULL;
+    wal->buffer_size = 0;
+    wal->buffer_capacity = 0;
+    wal->pending_records = 0;
+    wal->sync_records = 1;
+    wal->sync_interval_ns = 0;
+    wal->last_sync_ns = linkedhashmap_clock_ns();
+    wal->snapshot_size = snapshot_size;
+    wal->log_size = log_size;
+    wal->compact_size = LINKEDHASHMAP_WAL_COMPACT_SIZE;
+    wal->next_sequence = 0;
+    wal->compact_due = false;
+    wal->failed = false;
+    map->wal = wal;
+
+    return map;
 }
 
-void linkedhashmap_extend(LinkedHashMap* map1, LinkedHashMap* map2)
+void linkedhashmap_wal_set_sync(LinkedHashMap* map, size_t records, uint64_t milliseconds)
 {
-    LinkedHashMapNode* current = map2->head;
+    if (map->wal == NULL)
+        return;
 
-    while (current != NULL)
-    {
-        LinkedHashMapEntry* res = linkedhashmap_set(map1, current->key, current->key_size, current->value, current->value_size);
+    map->wal->sync_records = records;
+    map->wal->sync_interval_ns = milliseconds * 1000000;
+}
 
-        if (res != NULL)
-            free(res);
+void linkedhashmap_wal_set_compact_size(LinkedHashMap* map, uint64_t size)
+{
+    if (map->wal != NULL)
+        map->wal->compact_size = size;
+}
 
-        current = current->next;
-    }
+static bool linkedhashmap_wal_interval_elapsed(LinkedHashMapWal* wal)
+{
+    return wal->sync_interval_ns > 0 && linkedhashmap_clock_ns() - wal->last_sync_ns >= wal->sync_interval_ns;
 }
 
-LinkedHashMapEntry* linkedhashmap_pop(LinkedHashMap* map, void* key, size_t key_size)
+void linkedhashmap_wal_append(LinkedHashMap* map, int op, void* anchor, size_t anchor_size, void* key, size_t key_size, void* value, size_t value_size)
 {
-    size_t hashvalue = linkedhashmap_hash(map, key, key_size);
-    size_t current;
+    LinkedHashMapWal* wal = map->wal;
+    uint64_t sequence = wal->next_sequence++;
+    size_t body_size = linkedhashmap_record_body_size(op, sequence, anchor, anchor_size, key, key_size, value_size);
+    size_t size = linkedhashmap_varint_size(body_size) + body_size;
 
-    for (size_t i = 0; i < map->capacity; i++)
+    if (wal->buffer_size + size + sizeof(uint64_t) > wal->buffer_capacity)
     {
-        current = (hashvalue + i) % map->capacity;
+        size_t capacity = wal->buffer_capacity > 0 ? wal->buffer_capacity : LINKEDHASHMAP_IO_BUFFER_SIZE;
 
-        if (linkedhashmap_mem_equal(key, key_size, map->nodes[current].key, map->nodes[current].key_size)
-            && map->nodes[current].is_allocated)
-        {
-            LinkedHashMapEntry* res = (LinkedHashMapEntry*)malloc(sizeof(LinkedHashMapEntry));
-            res->key = map->nodes[current].key;
-            res->key_size = map->nodes[current].key_size;
-            res->value = map->nodes[current].value;
-            res->value_size = map->nodes[current].value_size;
+        while (capacity < wal->buffer_size + size + sizeof(uint64_t))
+            capacity *= 2;
 
-            map->nodes[current].is_allocated = false;
-            map->length--;
+        wal->buffer = (unsigned char*)realloc(wal->buffer, capacity);
+        wal->buffer_capacity = capacity;
+    }
 
-            if (map->nodes[current].prev != NULL)
-                map->nodes[current].prev->next = map->nodes[current].next;
-            else
-                map->head = map->nodes[current].next;
+    unsigned char* record = wal->buffer + wal->buffer_size;
+    linkedhashmap_record_encode(record, body_size, op, sequence, anchor, anchor_size, key, key_size, value, value_size);
 
-            if (map->nodes[current].next != NULL)
-                map->nodes[current].next->prev = map->nodes[current].prev;
-            else
-                map->tail = map->nodes[current].prev;
+    uint64_t checksum = linkedhashmap_hash_bytes(record, size, 0);
 
-            if (map->length <= (map->capacity >> 1) && map->capacity > LINKEDHASHMAP_MIN_SIZE)
-                linkedhashmap_resize_down(map);
+    for (size_t i = 0; i < sizeof(uint64_t); i++)
+        record[size + i] = (unsigned char)(checksum >> (i * 8));
 
-            return res;
-        }
-    }
+    wal->buffer_size += size + sizeof(uint64_t);
+    wal->pending_records++;
 
-    return NULL;
+    // Records are committed in groups that share a single write and fsync
+    if ((wal->sync_records > 0 && wal->pending_records >= wal->sync_records) || linkedhashmap_wal_interval_elapsed(wal))
+        linkedhashmap_wal_sync(map);
 }
 
-void linkedhashmap_delete(LinkedHashMap* map, void* key, size_t key_size)
+bool linkedhashmap_wal_sync(LinkedHashMap* map)
 {
-    LinkedHashMapEntry* res = linkedhashmap_pop(map, key, key_size);
+    LinkedHashMapWal* wal = map->wal;
 
-    if (res != NULL)
-        free(res);
-}
-
-bool linkedhashmap_contains(LinkedHashMap* map, void* key, size_t key_size)
-{
-    size_t hashvalue = linkedhashmap_hash(map, key, key_size);
-    size_t current;
+    if (wal == NULL)
+        return false;
 
-    for (size_t i = 0; i < map->capacity; i++)
+    // Once a write fails the log has a gap, so nothing more is written to it until it is compacted
+    if (wal->buffer_size > 0)
     {
-        current = (hashvalue + i) % map->capacity;
+        if (!wal->failed && !linkedhashmap_write_all(wal->fd, wal->buffer, wal->buffer_size))
+            wal->failed = true;
 
-        if (linkedhashmap_mem_equal(key, key_size, map->nodes[current].key, map->nodes[current].key_size)
-            && map->nodes[current].is_allocated)
-            return true;
+        wal->log_size += wal->buffer_size;
+        wal->buffer_size = 0;
     }
 
-    return false;
+    if (wal->pending_records > 0 && !wal->failed && fsync(wal->fd) != 0)
+        wal->failed = true;
+
+    wal->pending_records = 0;
+    wal->last_sync_ns = linkedhashmap_clock_ns();
+
+    if (wal->compact_size > 0 && wal->log_size >= wal->compact_size)
+        wal->compact_due = true;
+
+    return !wal->failed;
 }
 
-bool linkedhashmap_equal(LinkedHashMap* map1, LinkedHashMap* map2)
+bool linkedhashmap_wal_sync_due(LinkedHashMap* map)
 {
-    if (map1->length != map2->length)
+    if (map->wal == NULL)
         return false;
 
-    for (size_t i = 0; i < map1->capacity; i++)
-    {
-        if (map1->nodes[i].is_allocated)
-        {
-            LinkedHashMapEntry* res = linkedhashmap_get(map2, map1->nodes[i].key, map1->nodes[i].key_size);
-
-            if (res != NULL && !linkedhashmap_mem_equal(map1->nodes[i].value, map1->nodes[i].value_size, res->value, res->value_size))
-            {
-                free(res);
-                return false;
-            }
-
-            if (res != NULL)
-                free(res);
-        }
-    }
+    if (map->wal->pending_records > 0 && linkedhashmap_wal_interval_elapsed(map->wal))
+        return linkedhashmap_wal_sync(map);
 
-    return true;
+    return !map->wal->failed;
 }
 
-bool linkedhashmap_equal_with_insertion_order(LinkedHashMap* map1, LinkedHashMap* map2)
+bool linkedhashmap_wal_compact(LinkedHashMap* map)
 {
-    if (map1->length != map2->length)
+    LinkedHashMapWal* wal = map->wal;
+    uint64_t snapshot_size;
+
+    if (wal == NULL)
         return false;
 
-    LinkedHashMapNode* current1 = map1->head;
-    LinkedHashMapNode* current2 = map2->head;
+    // The log is kept complete first, so that it is still usable if the new snapshot can't be written
+    linkedhashmap_wal_sync(map);
+    wal->compact_due = false;
 
-    while (current1 != NULL)
+    if (!linkedhashmap_wal_write_snapshot(map, wal->path, &snapshot_size))
+        return false;
+
+    // The old descriptor now refers to the replaced file, so records written through it would be lost
+    int fd = open(wal->path, O_WRONLY);
+
+    if (fd < 0 || lseek(fd, 0, SEEK_END) < 0)
     {
-        if (!linkedhashmap_mem_equal(current1->key, current1->key_size, current2->key, current2->key_size)
-            || !linkedhashmap_mem_equal(current1->value, current1->value_size, current2->value, current2->value_size))
-            return false;
+        if (fd >= 0)
+            close(fd);
 
-        current1 = current1->next;
-        current2 = current2->next;
+        wal->failed = true;
+        return false;
     }
 
+    close(wal->fd);
+    wal->fd = fd;
+    wal->snapshot_size = snapshot_size;
+    wal->log_size = 0;
+    wal->failed = false;
     return true;
 }
 
-void linkedhashmap_clear(LinkedHashMap* map)
+bool linkedhashmap_wal_close(LinkedHashMap* map)
 {
-    map->length = 0;
-    map->capacity = LINKEDHASHMAP_MIN_SIZE;
-    map->nodes = (LinkedHashMapNode*)realloc(map->nodes, LINKEDHASHMAP_MIN_SIZE * sizeof(LinkedHashMapNode));
-    map->head = NULL;
-    map->tail = NULL;
+    LinkedHashMapWal* wal = map->wal;
 
-    for (size_t i = 0; i < map->capacity; i++)
-        map->nodes[i].is_allocated = false;
+    if (wal == NULL)
+        return true;
+
+    bool success = linkedhashmap_wal_sync(map);
+
+    if (close(wal->fd) != 0)
+        success = false;
+
+    free(wal->buffer);
+    free(wal->path);
+    free(wal);
+    map->wal = NULL;
+    return success;
 }
 
-LinkedHashMap* linkedhashmap_copy(LinkedHashMap* map)
+#endif
+
+void linkedhashmap_free(LinkedHashMap* map)
+{
+    linkedhashmap_destroy(map);
+    free(map);
+}
+
+void linkedhashmap_destroy(LinkedHashMap* map)
 {
-    LinkedHashMap* new_map = linkedhashmap_new();
-    LinkedHashMapNode* current = map->head;
+    LinkedHashMapStorage* storage = linkedhashmap_storage_take(map);
+    LinkedHashMapShare* storage_share = map->storage_share;
 
-    while (current != NULL)
+    // Copies and snapshots may still point at anything the map owns, so it is handed to the share, and freed by whichever map releases the share last
+    if (storage_share != NULL)
     {
-        linkedhashmap_set(new_map, current->key, current->key_size, current->value, current->value_size);
-        current = current->next;
+        linkedhashmap_storage_push(storage_share, storage);
+        storage = NULL;
+
+        if (atomic_fetch_sub(&(storage_share->refs), 1) == 1)
+        {
+            storage = atomic_load(&(storage_share->storage));
+            free(storage_share);
+        }
     }
 
-    return new_map;
-}
+    while (storage != NULL)
+    {
+        LinkedHashMapStorage* next = storage->next;
 
-void linkedhashmap_foreach(LinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg)
-{
-    LinkedHashMapNode* current = map->head;
+#ifndef _WIN32
+        if (storage->is_mapped)
+            munmap(storage->data, storage->size);
+        else
+#endif
+            free(storage->data);
 
-    while (current != NULL)
-    {
-        (*fn)(current->key, current->key_size, current->value, current->value_size, arg);
-        current = current->next;
+        free(storage);
+        storage = next;
     }
-}
 
-void linkedhashmap_free(LinkedHashMap* map)
-{
-    free(map->nodes);
-    free(map);
+    map->storage = NULL;
+    map->storage_share = NULL;
+
+    free(map->latency);
+    free(map->stats);
+
+    linkedhashmap_journal_disable(map);
+
+#ifndef _WIN32
+    linkedhashmap_wal_close(map);
+#endif
+
+    linkedhashmap_chunks_free(map->chunks, map->capacity);
+
+    if (!linkedhashmap_release_share(map) && map->nodes_owned)
+        linkedhashmap_nodes_free(map->nodes, map->capacity, map->nodes_mapped);
 }
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 #  define LINKEDHASHMAP_EXPORT __declspec(dllexport)
@@ -17,6 +18,56 @@
 #endif
 
 #define LINKEDHASHMAP_MIN_SIZE 16
+#define LINKEDHASHMAP_SMALL_SIZE 8
+#define LINKEDHASHMAP_FLOOD_PROBE_LENGTH 128
+#define LINKEDHASHMAP_PARALLEL_MIN_LENGTH 4096
+#define LINKEDHASHMAP_PARALLEL_CHUNKS_PER_THREAD 8
+#define LINKEDHASHMAP_PARALLEL_SAMPLE_PROBES 64
+#define LINKEDHASHMAP_PARALLEL_RESIZE_MIN_LENGTH 65536
+#define LINKEDHASHMAP_SORT_INSERTION_LENGTH 16
+#define LINKEDHASHMAP_PROBE_BATCH 8
+#define LINKEDHASHMAP_CHUNK_SIZE 512
+#define LINKEDHASHMAP_NO_NODE (~(size_t)0)
+
+#define LINKEDHASHMAP_HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define LINKEDHASHMAP_NUMA_DEFAULT -1
+#define LINKEDHASHMAP_NUMA_INTERLEAVE -2
+
+#define LINKEDHASHMAP_IO_BUFFER_SIZE 65536
+#define LINKEDHASHMAP_SNAPSHOT_MAGIC "LHMSNAP\0"
+#define LINKEDHASHMAP_SNAPSHOT_VERSION 1
+#define LINKEDHASHMAP_SNAPSHOT_LAYOUT 0x1
+#define LINKEDHASHMAP_SNAPSHOT_ALIGN(size) (((size) + 15) & ~(uint64_t)15)
+
+#define LINKEDHASHMAP_STATS_PROBE_BUCKETS 32
+
+#define LINKEDHASHMAP_LATENCY_SUB_BUCKET_BITS 4
+#define LINKEDHASHMAP_LATENCY_SUB_BUCKETS (1 << LINKEDHASHMAP_LATENCY_SUB_BUCKET_BITS)
+#define LINKEDHASHMAP_LATENCY_BUCKETS (LINKEDHASHMAP_LATENCY_SUB_BUCKETS * (64 - LINKEDHASHMAP_LATENCY_SUB_BUCKET_BITS + 1))
+
+#define LINKEDHASHMAP_OP_SET 0
+#define LINKEDHASHMAP_OP_GET 1
+#define LINKEDHASHMAP_OP_POP 2
+#define LINKEDHASHMAP_OP_RESIZE 3
+#define LINKEDHASHMAP_OP_COUNT 4
+
+#define LINKEDHASHMAP_JOURNAL_SET 1
+#define LINKEDHASHMAP_JOURNAL_POP 2
+#define LINKEDHASHMAP_JOURNAL_CLEAR 3
+#define LINKEDHASHMAP_JOURNAL_MOVE_TO_END 4
+#define LINKEDHASHMAP_JOURNAL_MOVE_TO_FRONT 5
+#define LINKEDHASHMAP_JOURNAL_INSERT_BEFORE 6
+#define LINKEDHASHMAP_JOURNAL_INSERT_AFTER 7
+#define LINKEDHASHMAP_JOURNAL_ORDER 8
+
+#define LINKEDHASHMAP_WAL_COMPACT_SIZE ((uint64_t)64 << 20)
+
+#define LINKEDHASHMAP_FROZEN_MAGIC "LHMFROZ\0"
+#define LINKEDHASHMAP_FROZEN_VERSION 1
+#define LINKEDHASHMAP_FROZEN_BYTE_ORDER 0x0102030405060708ULL
+#define LINKEDHASHMAP_FROZEN_HEADER_SIZE 88
+#define LINKEDHASHMAP_FROZEN_BUCKET_LOAD 4
+#define LINKEDHASHMAP_FROZEN_MAX_SEEDS 8
 
 /// @brief A representation of a linked hashmap key. This contains the type-erased pointer to the key and the key size in bytes.
 typedef struct _LinkedHashMapKey
@@ -41,7 +92,7 @@ typedef struct _LinkedHashMapEntry
     size_t value_size;
 } LinkedHashMapEntry;
 
-/// @brief A single node in a linked hashmap.
+/// @brief A single node in a linked hashmap. The order links hold the slots of the previous and next nodes, or `LINKEDHASHMAP_NO_NODE` at either end of the insertion order, so that they stay valid wherever the table is copied to.
 typedef struct _LinkedHashMapNode
 {
     void* key;
@@ -49,36 +100,223 @@ typedef struct _LinkedHashMapNode
     void* value;
     size_t value_size;
     bool is_allocated;
-    struct _LinkedHashMapNode* prev;
-    struct _LinkedHashMapNode* next;
+    size_t prev;
+    size_t next;
 } LinkedHashMapNode;
 
-/// @brief A linked hashmap. This is like a normal hashmap, but keeps track of insertion order by having each node store a pointer to the previous and next nodes.
+/// @brief The location of a single entry within a frozen linked hashmap file. Offsets are relative to the start of the file.
+typedef struct _LinkedHashMapFrozenRecord
+{
+    uint64_t key_offset;
+    uint64_t key_size;
+    uint64_t value_offset;
+    uint64_t value_size;
+    uint64_t index;
+} LinkedHashMapFrozenRecord;
+
+/// @brief A read-only linked hashmap served directly from a memory-mapped file written by `linkedhashmap_freeze`. Keys are located through a minimal perfect hash, so every lookup inspects exactly one record.
+typedef struct _FrozenLinkedHashMap
+{
+    size_t length;
+    size_t bucket_count;
+    uint64_t seed;
+    uint32_t* displacements;
+    LinkedHashMapFrozenRecord* records;
+    uint64_t* order;
+    unsigned char* data;
+    void* mapping;
+    size_t mapping_size;
+} FrozenLinkedHashMap;
+
+/// @brief A block of memory owned by a linked hashmap, such as the key and value bytes of a loaded snapshot, or a file mapping. These are freed or unmapped along with the map.
+typedef struct _LinkedHashMapStorage
+{
+    void* data;
+    size_t size;
+    bool is_mapped;
+    struct _LinkedHashMapStorage* next;
+} LinkedHashMapStorage;
+
+#ifdef LINKEDHASHMAP_STATS
+
+/// @brief Runtime statistics for a linked hashmap. These are only available when compiled with `LINKEDHASHMAP_STATS` defined. Probe lengths are recorded in power-of-two buckets, so bucket `i` counts lookups that inspected between `2^i` and `2^(i+1) - 1` slots.
+typedef struct _LinkedHashMapStats
+{
+    double load_factor;
+    uint64_t hit_probe_lengths[LINKEDHASHMAP_STATS_PROBE_BUCKETS];
+    uint64_t miss_probe_lengths[LINKEDHASHMAP_STATS_PROBE_BUCKETS];
+    uint64_t resize_up_count;
+    uint64_t resize_down_count;
+    double resize_up_seconds;
+    double resize_down_seconds;
+    uint64_t entries_allocated;
+    size_t node_table_bytes;
+} LinkedHashMapStats;
+
+#endif
+
+/// @brief The statistics recorded for a map, along with how often its lookups are sampled. These are only kept when compiled with `LINKEDHASHMAP_STATS` defined. Its layout is private to the implementation.
+typedef struct _LinkedHashMapStatsRecorder LinkedHashMapStatsRecorder;
+
+/// @brief Per-operation latency histograms for a linked hashmap. These are only available when compiled with `LINKEDHASHMAP_LATENCY` defined. Each histogram splits every power of two nanoseconds into `LINKEDHASHMAP_LATENCY_SUB_BUCKETS` linear buckets, so recorded latencies are accurate to within about 6%.
+typedef struct _LinkedHashMapLatency LinkedHashMapLatency;
+
+#ifdef LINKEDHASHMAP_LATENCY
+
+struct _LinkedHashMap;
+
+struct _LinkedHashMapLatency
+{
+    uint64_t counts[LINKEDHASHMAP_OP_COUNT][LINKEDHASHMAP_LATENCY_BUCKETS];
+    uint64_t totals[LINKEDHASHMAP_OP_COUNT];
+    uint64_t maximums[LINKEDHASHMAP_OP_COUNT];
+    uint64_t thresholds[LINKEDHASHMAP_OP_COUNT];
+    void (*callback)(struct _LinkedHashMap*, int, uint64_t, void*);
+    void* callback_arg;
+};
+
+#endif
+
+/// @brief A log of the changes made to a map, kept in a ring buffer of encoded records. Each record holds its length, the kind of change, its sequence number, and the bytes of the keys and values involved, with every size and number encoded as a LEB128 varint. Once the buffer is full, the oldest records are dropped to make room.
+typedef struct _LinkedHashMapJournal
+{
+    unsigned char* data;
+    size_t capacity;
+    size_t start;
+    size_t size;
+    uint64_t first_sequence;
+    uint64_t next_sequence;
+} LinkedHashMapJournal;
+
+/// @brief A write-ahead log of the changes made to a map, kept in a file alongside a snapshot of the map. The file holds a snapshot written by `linkedhashmap_save`, followed by a record for every change made since, encoded as in the journal and followed by its checksum. Records are buffered and committed to the file in groups.
+typedef struct _LinkedHashMapWal
+{
+    int fd;
+    char* path;
+    unsigned char* buffer;
+    size_t buffer_size;
+    size_t buffer_capacity;
+    size_t pending_records;
+    size_t sync_records;
+    uint64_t sync_interval_ns;
+    uint64_t last_sync_ns;
+    uint64_t snapshot_size;
+    uint64_t log_size;
+    uint64_t compact_size;
+    uint64_t next_sequence;
+    bool compact_due;
+    bool failed;
+} LinkedHashMapWal;
+
+/// @brief The reference count of a node table shared between a map and its snapshots, or of the storage shared between a map and its copies and snapshots, which it frees once the last of them is freed. Its layout is private to the implementation.
+typedef struct _LinkedHashMapShare LinkedHashMapShare;
+
+/// @brief A linked hashmap. This is like a normal hashmap, but keeps track of insertion order by having each node store the slots of the previous and next nodes. Maps of at most `LINKEDHASHMAP_SMALL_SIZE` entries keep their nodes in `small_nodes`, packed at the front with no hashing, and are searched by comparing every key, which is faster than hashing for so few entries. They move to a hashed table once they outgrow it. Only a hashed table is ever hashed, so `hash_seed` and `strong_hash_key` share their memory with the inline table, and are only set while the map is in a hashed table. Hashed tables double once they are seven eighths full and halve once they are a quarter full, so a lookup of a missing key never probes far for a free slot. While the node table is shared with a snapshot, `chunks` holds the private copies of the chunks of `LINKEDHASHMAP_CHUNK_SIZE` nodes that the map has written to since, so nodes should be read with `linkedhashmap_node` rather than from `nodes` directly. The `latency` and `stats` fields are present in every build, and are `NULL` unless recording is compiled in and enabled, so that the layout of a map does not depend on `LINKEDHASHMAP_LATENCY` or `LINKEDHASHMAP_STATS`.
 typedef struct _LinkedHashMap
 {
     size_t length;
     size_t capacity;
     LinkedHashMapNode* nodes;
-    LinkedHashMapNode* head;
-    LinkedHashMapNode* tail;
+    LinkedHashMapNode** chunks;
+    size_t head;
+    size_t tail;
+    uint64_t digest;
+    uint64_t order_digest;
+    LinkedHashMapStorage* storage;
+    struct _LinkedHashMap* owned_storage;
+    LinkedHashMapShare* storage_share;
+    size_t resize_threads;
+    LinkedHashMapShare* share;
+    LinkedHashMapJournal* journal;
+    LinkedHashMapWal* wal;
+    LinkedHashMapLatency* latency;
+    LinkedHashMapStatsRecorder* stats;
+    int numa_node;
+    bool digests_enabled;
+    bool strong_hash;
+    bool hash_flooded;
+    bool huge_pages;
+    bool nodes_mapped;
+    bool nodes_owned;
+    union
+    {
+        LinkedHashMapNode small_nodes[LINKEDHASHMAP_SMALL_SIZE];
+        struct
+        {
+            uint64_t hash_seed;
+            uint64_t strong_hash_key[2];
+        };
+    };
 } LinkedHashMap;
 
-/// @brief Constructs a new linked hashmap with the default capacity. When done with the map, `linkedhashmap_free` will need to be called to free the memory.
+/// @brief Constructs a new linked hashmap with the default capacity, which holds up to `LINKEDHASHMAP_SMALL_SIZE` entries inside the map itself, so that small maps need only a single allocation. When done with the map, `linkedhashmap_free` will need to be called to free the memory.
 /// @return The newly constructed linked hashmap.
 LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_new(void);
 
 /// @brief Constructs a new linked hashmap with the given capacity. When done with the map, `linkedhashmap_free` will need to be called to free the memory.
-/// @param capacity The starting capacity. `LINKEDHASHMAP_MIN_SIZE` will be used instead if `capacity` is less than it.
+/// @param capacity The starting capacity. `LINKEDHASHMAP_SMALL_SIZE` will be used instead if `capacity` is at most that, and `LINKEDHASHMAP_MIN_SIZE` if it is otherwise less than it.
 /// @return The newly constructed linked hashmap.
 LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_new_with_capacity(size_t capacity);
 
-/// @brief Calculates the hash of a given key. This is only intended to be used internally.
-/// @param map The linked hashmap. This is necessary because this function needs to mod by the map's capacity.
+/// @brief Constructs a new linked hashmap in memory provided by the caller, such as a field of a larger struct or an element of an array, rather than allocating it. A map that still fits in its inline table needs no allocations at all. The map points into its own storage, so it must not be moved or copied by value while in use. When done with the map, `linkedhashmap_destroy` will need to be called to free the memory it owns.
+/// @param map The memory to construct the map in.
+/// @param capacity The starting capacity, as for `linkedhashmap_new_with_capacity`.
+LINKEDHASHMAP_EXPORT void linkedhashmap_init(LinkedHashMap* map, size_t capacity);
+
+/// @brief Constructs a new linked hashmap in memory provided by the caller, like `linkedhashmap_init`, whose node table starts out as a buffer also provided by the caller, such as an array on the stack or inside a larger struct. The buffer is used until the table is first resized, after which the map allocates its tables as usual, and it is never freed by the map. The buffer needs to stay valid until then or until the map is destroyed. Snapshots of a map still using the buffer copy it instead of sharing it. Buffers of at most `LINKEDHASHMAP_SMALL_SIZE` nodes are not used, since the map keeps that many entries inline already.
+/// @param map The memory to construct the map in.
+/// @param nodes The initial node table, or `NULL` to allocate one as `linkedhashmap_init` does. It does not need to be initialized.
+/// @param capacity The number of nodes in `nodes`, which becomes the starting capacity of the map.
+LINKEDHASHMAP_EXPORT void linkedhashmap_init_with_buffer(LinkedHashMap* map, LinkedHashMapNode* nodes, size_t capacity);
+
+/// @brief Gets the node in a slot of the map's table, such as `head`, `tail` or the slot held by an order link. This reads through to the map's own copy of the chunk holding the slot, if it has one. The node must not be modified through the returned pointer, which is valid until the map is next modified.
+/// @param map The linked hashmap.
+/// @param index The slot, which must be less than the capacity of the map.
+/// @return A pointer to the node.
+LINKEDHASHMAP_EXPORT LinkedHashMapNode* linkedhashmap_node(LinkedHashMap* map, size_t index);
+
+/// @brief Draws 64 random bits from the operating system's entropy source. This is only intended to be used internally.
+/// @return The random bits.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_random_u64(void);
+
+/// @brief Returns the hash seed shared by all maps in this process. The seed is drawn at random the first time it is needed, so hashes differ between processes. This is only intended to be used internally.
+/// @return The process-wide hash seed.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_process_seed(void);
+
+/// @brief Calculates the SipHash-2-4 of a region of memory. This is slower than the default hash, but collisions cannot be found without knowing the key. This is only intended to be used internally.
+/// @param key A pointer to the memory to hash.
+/// @param key_size The size of the memory in bytes.
+/// @param k0 The first half of the 128-bit key.
+/// @param k1 The second half of the 128-bit key.
+/// @return The calculated hash.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_siphash(const void* key, size_t key_size, uint64_t k0, uint64_t k1);
+
+/// @brief Calculates the full 64-bit hash of a given key, using the map's seeded hash function. This is only intended to be used internally.
+/// @param map The linked hashmap, which needs to be in a hashed table rather than its inline table.
+/// @param key A pointer to the key to hash.
+/// @param key_size The size of the key in bytes.
+/// @return The calculated hash.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_hash_key(LinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Calculates the slot a given key hashes to. This is only intended to be used internally.
+/// @param map The linked hashmap, which needs to be in a hashed table rather than its inline table. This is necessary because this function needs to mod by the map's capacity.
 /// @param key A pointer to the key to hash.
 /// @param key_size The size of the key in bytes.
 /// @return A `size_t` representing the calculated hash.
 LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_hash(LinkedHashMap* map, void* key, size_t key_size);
 
+/// @brief Calculates a 64-bit hash of a region of memory, independent of any map. This is only intended to be used internally.
+/// @param key A pointer to the memory to hash.
+/// @param key_size The size of the memory in bytes.
+/// @param seed A seed to mix into the hash.
+/// @return The calculated hash.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_hash_bytes(const void* key, size_t key_size, uint64_t seed);
+
+/// @brief Scrambles the bits of a 64-bit integer. This is only intended to be used internally.
+/// @param x The integer to scramble.
+/// @return The scrambled integer.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_mix(uint64_t x);
+
 /// @brief Checks if two regions of memory are equal. Used for comparing keys and values. This is only intended to be used internally.
 /// @param p1 The pointer to the first region of memory.
 /// @param size1 The size of the first region of memory in bytes.
@@ -87,6 +325,31 @@ LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_hash(LinkedHashMap* map, void* ke
 /// @return `true` if the memory regions contain identical data.
 LINKEDHASHMAP_TEST_EXPORT bool linkedhashmap_mem_equal(void* p1, size_t size1, void* p2, size_t size2);
 
+/// @brief Replaces a precomputed hash with the map's own hash of the key if the map no longer uses the process-wide seed, for example after switching to SipHash. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param key The key.
+/// @param key_size The size of the key in bytes.
+/// @param hash The hash returned by `linkedhashmap_key_hash`.
+/// @return The hash to use for the key in this map.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_resolve_hash(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash);
+
+/// @brief Probes for a given key with an already calculated hash. See `linkedhashmap_find_slot`. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param key The key to locate.
+/// @param key_size The size of the key in bytes.
+/// @param hash The full hash of the key in this map.
+/// @param found Set to `true` if the key exists.
+/// @return The index of the given key if it exists, otherwise the index of the empty slot it would be inserted into. Returns `~0` if the key does not exist and the map has no free slots.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_find_slot_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash, bool* found);
+
+/// @brief Probes for a given key, stopping at the key or at the first empty slot, whichever comes first. The empty slot is where the key would be inserted, so a single probe serves both lookup and insertion. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param key The key to locate.
+/// @param key_size The size of the key in bytes.
+/// @param found Set to `true` if the key exists.
+/// @return The index of the given key if it exists, otherwise the index of the empty slot it would be inserted into. Returns `~0` if the key does not exist and the map has no free slots.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_find_slot(LinkedHashMap* map, void* key, size_t key_size, bool* found);
+
 /// @brief Locates the index within the allocated block where a given key resides. This is only intended to be used internally.
 /// @param map The linked hashmap.
 /// @param key The key to locate.
@@ -94,6 +357,45 @@ LINKEDHASHMAP_TEST_EXPORT bool linkedhashmap_mem_equal(void* p1, size_t size1, v
 /// @return The index of the given key. Returns `~0` if the key does not exist.
 LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_find_key(LinkedHashMap* map, void* key, size_t key_size);
 
+/// @brief Calculates the digest of a single entry from its key and value bytes. This is only intended to be used internally.
+/// @param node The node holding the entry, or `NULL` for the start or end of the insertion order.
+/// @return The entry digest, or `0` if `node` is `NULL`.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_entry_digest(LinkedHashMapNode* node);
+
+/// @brief Calculates the contribution of a pair of neighboring entries to the order digest. This is only intended to be used internally.
+/// @param prev_digest The digest of the earlier entry.
+/// @param next_digest The digest of the later entry.
+/// @return The link digest.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_order_link_digest(uint64_t prev_digest, uint64_t next_digest);
+
+/// @brief Adds a node that was just linked into the insertion order to the map's digests. Does nothing if digests are disabled. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param node The node that was linked.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_digest_link(LinkedHashMap* map, LinkedHashMapNode* node);
+
+/// @brief Removes a node that is about to be unlinked from the insertion order from the map's digests. Does nothing if digests are disabled. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param node The node that is about to be unlinked.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_digest_unlink(LinkedHashMap* map, LinkedHashMapNode* node);
+
+/// @brief Starts maintaining the map's digests. Both digests are calculated from scratch, and from then on are updated in `O(1)` on every insertion, overwrite and removal. While both maps being compared have digests enabled, `linkedhashmap_equal` and `linkedhashmap_equal_with_insertion_order` reject unequal maps without comparing entries. Modifying the memory pointed to by keys or values while they are in the map will invalidate the digests.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_enable_digests(LinkedHashMap* map);
+
+/// @brief Stops maintaining the map's digests.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_disable_digests(LinkedHashMap* map);
+
+/// @brief Returns the order-independent digest of the map. Maps with equal contents have equal digests, regardless of insertion order. This is only maintained while digests are enabled, and is `0` otherwise.
+/// @param map The linked hashmap.
+/// @return The order-independent digest.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_digest(LinkedHashMap* map);
+
+/// @brief Returns the order-dependent digest of the map. Maps with equal contents in the same insertion order have equal order digests. This is only maintained while digests are enabled, and is `0` otherwise.
+/// @param map The linked hashmap.
+/// @return The order-dependent digest.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_order_digest(LinkedHashMap* map);
+
 /// @brief Returns the number of items currently stored in the linked hashmap.
 /// @param map The linked hashmap.
 /// @return The number of items.
@@ -119,19 +421,110 @@ LINKEDHASHMAP_EXPORT LinkedHashMapValue* linkedhashmap_values(LinkedHashMap* map
 /// @return A pointer to the start of a collection of all entries in the map.
 LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_entries(LinkedHashMap* map);
 
+/// @brief Inserts a key that is known not to already exist in the map into the first free slot of its probe sequence, appending it to the insertion order. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param value The value.
+/// @param value_size The size of the given value.
+/// @return A pointer to the node the entry was placed in, or `NULL` if the map has no free slots.
+LINKEDHASHMAP_TEST_EXPORT LinkedHashMapNode* linkedhashmap_insert_new(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Places a key known not to be in the map into the given free slot, and appends it to the end of the insertion order. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param index The free slot, as found by `linkedhashmap_find_slot`.
+/// @param home The slot the key hashes to.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param value The value.
+/// @param value_size The size of the given value.
+/// @return A pointer to the node the entry was placed in.
+LINKEDHASHMAP_TEST_EXPORT LinkedHashMapNode* linkedhashmap_insert_at(LinkedHashMap* map, size_t index, size_t home, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Inserts a key known not to be in the map into the slot found by `linkedhashmap_find_slot`, resizing first if there was none, and updates the digests. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param index The free slot, or `~0` if the map has no free slots.
+/// @param hash The full hash of the key in this map. Only used if `index` is not `~0`.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param value The value.
+/// @param value_size The size of the given value.
+/// @return A pointer to the node the entry was placed in.
+LINKEDHASHMAP_TEST_EXPORT LinkedHashMapNode* linkedhashmap_insert_missing(LinkedHashMap* map, size_t index, uint64_t hash, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Moves a node to a different slot, repointing its neighbors in the insertion order at the new slot. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param from The slot the node is currently in.
+/// @param to The free slot to move it to.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_move_node(LinkedHashMap* map, size_t from, size_t to);
+
+/// @brief Frees the slot of a node that has already been unlinked from the insertion order, then shifts later nodes of its cluster back so that no probe sequence is broken by the gap. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param index The slot to free.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_remove_at(LinkedHashMap* map, size_t index);
+
 /// @brief Reallocates the map to the specified capacity, copying the contents to the new allocation. This is only intended to be used internally.
 /// @param map The linked hashmap.
 /// @param new_size The new capacity.
 LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_resize(LinkedHashMap* map, size_t new_size);
 
+/// @brief Reallocates the map to the specified capacity using multiple threads. Each thread moves the nodes from one part of the old table, claiming slots in the new table atomically, and then fixes up the order links of one part of the new table. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param new_size The new capacity.
+/// @param nthreads The number of threads to use, including the calling thread.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_resize_parallel(LinkedHashMap* map, size_t new_size, size_t nthreads);
+
+/// @brief Sets how many threads the map uses when it resizes. Maps with fewer than `LINKEDHASHMAP_PARALLEL_RESIZE_MIN_LENGTH` entries always resize on the calling thread. The map must not be accessed from other threads while it resizes.
+/// @param map The linked hashmap.
+/// @param nthreads The number of threads to use, including the calling thread. `0` uses one per online processor. The default is `1`.
+LINKEDHASHMAP_EXPORT void linkedhashmap_set_resize_threads(LinkedHashMap* map, size_t nthreads);
+
+/// @brief Allocates a node table for the map according to its allocation settings, and records in the map whether the table was memory-mapped. Tables of at most `LINKEDHASHMAP_SMALL_SIZE` nodes are the inline table of the map instead. The table is not initialized. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param capacity The number of nodes in the table.
+/// @return The new node table.
+LINKEDHASHMAP_TEST_EXPORT LinkedHashMapNode* linkedhashmap_nodes_alloc(LinkedHashMap* map, size_t capacity);
+
+/// @brief Frees a node table allocated by `linkedhashmap_nodes_alloc`. Inline tables are left alone. This is only intended to be used internally.
+/// @param nodes The node table.
+/// @param capacity The number of nodes in the table.
+/// @param mapped Whether the table was memory-mapped.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_nodes_free(LinkedHashMapNode* nodes, size_t capacity, bool mapped);
+
+/// @brief Sets how the node table of the map is allocated, and moves the current table accordingly. With huge pages enabled on Linux, tables of at least `LINKEDHASHMAP_HUGE_PAGE_SIZE` bytes are memory-mapped on huge page boundaries, backed by reserved huge pages when the system has them and by transparent huge pages otherwise, which greatly reduces TLB misses on random lookups in large maps. The table can also be bound to a single NUMA node, or interleaved across all of them. Each of these is best effort, so the map falls back to regular pages and the default memory policy wherever they are unavailable. On other platforms, the settings have no effect.
+/// @param map The linked hashmap.
+/// @param enabled Whether to use huge pages for large tables.
+/// @param numa_node The NUMA node to bind the table to, `LINKEDHASHMAP_NUMA_INTERLEAVE` to interleave it across all nodes, or `LINKEDHASHMAP_NUMA_DEFAULT` to leave placement to the system. Only applies to tables that use huge pages.
+LINKEDHASHMAP_EXPORT void linkedhashmap_set_huge_pages(LinkedHashMap* map, bool enabled, int numa_node);
+
 /// @brief Reallocates the map, doubling its capacity. This is only intended to be used internally.
 /// @param map The linked hashmap.
 LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_resize_up(LinkedHashMap* map);
 
-/// @brief Reallocates the map, halving its capacity. This is only intended to be used internally.
+/// @brief Reallocates the map, halving its capacity. A map in the smallest hashed table moves back to its inline table instead. This is only intended to be used internally.
 /// @param map The linked hashmap.
 LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_resize_down(LinkedHashMap* map);
 
+/// @brief Ensures the map has room for at least the given number of entries, growing it once up front rather than one resize at a time. This is useful before inserting a large, known number of entries. The table is sized as `linkedhashmap_shrink_to_fit` would size it for that many entries, so it still has free slots once they are all inserted.
+/// @param map The linked hashmap.
+/// @param capacity The total number of entries the map should be able to hold without resizing.
+/// @return `true` if the map has room for that many entries. `false` if no table could be allocated for so many, in which case the map is left unchanged.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_reserve(LinkedHashMap* map, size_t capacity);
+
+/// @brief Reallocates the map down to the smallest power of two capacity, no less than `LINKEDHASHMAP_MIN_SIZE`, that keeps the table at most three quarters full, so that a lookup of a missing key still stops at a nearby free slot. Maps of at most `LINKEDHASHMAP_SMALL_SIZE` entries move back to the inline table. The map is never grown by this.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_shrink_to_fit(LinkedHashMap* map);
+
+/// @brief Switches the map to SipHash with a random per-map key, and rehashes every entry. Maps switch automatically when a probe sequence grows much longer than the load of the table explains, but this can be called up front for maps that will hold keys from untrusted sources.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_use_strong_hash(LinkedHashMap* map);
+
+/// @brief Constructs a representation of the entry held by a node. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param node The node.
+/// @return A pointer to a representation of the entry. When done with the returned pointer, `free` must be called on it.
+LINKEDHASHMAP_TEST_EXPORT LinkedHashMapEntry* linkedhashmap_entry_new(LinkedHashMap* map, LinkedHashMapNode* node);
+
 /// @brief Retrieves the entry at the given key. Returns `NULL` if the key does not exist. When done with the returned pointer, `free` must be called on it.
 /// @param map The linked hashmap.
 /// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
@@ -139,6 +532,20 @@ LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_resize_down(LinkedHashMap* map);
 /// @return A pointer to a representation of the requested entry.
 LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_get(LinkedHashMap* map, void* key, size_t key_size);
 
+/// @brief Calculates a hash of a key that is the same for every map in this process, so a key looked up in several maps only needs to be hashed once. Pass the result to the `_hashed` variants of `linkedhashmap_get`, `linkedhashmap_contains`, `linkedhashmap_set` and `linkedhashmap_pop`. Hashes must not be stored or shared across processes, since the seed is chosen at random on startup.
+/// @param key A pointer to the key to hash.
+/// @param key_size The size of the key in bytes.
+/// @return The hash of the key.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_key_hash(void* key, size_t key_size);
+
+/// @brief Retrieves the entry at the given key, using a precomputed hash. Equivalent to `linkedhashmap_get`, but does not hash the key unless the map has switched to its own hash. When done with the returned pointer, `free` must be called on it.
+/// @param map The linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
+/// @param key_size The size of the given key.
+/// @param hash The hash of the key, as returned by `linkedhashmap_key_hash`.
+/// @return A pointer to a representation of the requested entry.
+LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_get_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash);
+
 /// @brief Retrieves the entry at the given insertion order index. Returns `NULL` if the index is invalid. Note that this is an `O(n)` lookup operation, unlike the `O(1)` operation that is retrieval by key. When done with the returned pointer, `free` must be called on it.
 /// @param map The linked hashmap.
 /// @param index The insertion order index.
@@ -161,11 +568,63 @@ LINKEDHASHMAP_EXPORT size_t linkedhashmap_get_index(LinkedHashMap* map, void* ke
 /// @return The previous entry at the given key, or `NULL` if the key did not already exist.
 LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_set(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size);
 
-/// @brief Extends `map1` with the contents of `map2`. Insertion order of `map2` carries over to `map1`.
+/// @brief Sets a key-value pair in the map, using a precomputed hash. Equivalent to `linkedhashmap_set`, but does not hash the key unless the map has switched to its own hash. When done with the returned pointer, `free` must be called on it, unless the pointer is `NULL`.
+/// @param map The linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
+/// @param key_size The size of the given key.
+/// @param value The value.
+/// @param value_size The size of the given value.
+/// @param hash The hash of the key, as returned by `linkedhashmap_key_hash`.
+/// @return The previous entry at the given key, or `NULL` if the key did not already exist.
+LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_set_hashed(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size, uint64_t hash);
+
+/// @brief Looks up a key, inserting it with the given value if it does not exist, and returns a pointer to the entry's value field. This takes a single probe, so "get or insert" and counter-style updates do not need a separate `linkedhashmap_get` and `linkedhashmap_set`. The pointer is valid until the map is next modified. Changes made through it could not be reflected in the map's digests, nor recorded in its journal or write-ahead log, so maps with any of these enabled are left unchanged and `NULL` is returned; use `linkedhashmap_upsert` for those.
+/// @param map The linked hashmap.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param value The value to insert if the key does not exist.
+/// @param value_size The size of the given value.
+/// @param inserted Set to `true` if the key was inserted. May be `NULL`.
+/// @return A pointer to the value field of the entry, or `NULL` if the map has digests, a journal or a write-ahead log enabled.
+LINKEDHASHMAP_EXPORT void** linkedhashmap_entry(LinkedHashMap* map, void* key, size_t key_size, void* value, size_t value_size, bool* inserted);
+
+/// @brief Updates the value of a key in place with a callback, inserting the key if it does not exist. This takes a single probe.
+/// @param map The linked hashmap.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param fn The function that produces the new value. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value pointer, a pointer to the value size, whether the key is being inserted, and the additional `void*` argument. The value pointer and size can be changed through their pointers. For a new key, they start out as `NULL` and `0`.
+/// @param arg An additional `void*` argument to pass to the function.
+/// @return `true` if the key was inserted.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_upsert(LinkedHashMap* map, void* key, size_t key_size, void (*fn)(void*, size_t, void**, size_t*, bool, void*), void* arg);
+
+/// @brief Extends `map1` with the contents of `map2`. Insertion order of `map2` carries over to `map1`. `map1` is reserved up front to fit the contents of both maps.
 /// @param map1 The map to extend.
 /// @param map2 The map to extend from.
 LINKEDHASHMAP_EXPORT void linkedhashmap_extend(LinkedHashMap* map1, LinkedHashMap* map2);
 
+/// @brief Adds the entries of `map2` whose keys are not in `map1` to the end of `map1`, in the insertion order of `map2`. Unlike `linkedhashmap_extend`, keys already in `map1` keep their values. This costs `O(|map2|)` lookups however large `map1` is, and `map1` is resized at most once.
+/// @param map1 The map to add to.
+/// @param map2 The map to add from.
+LINKEDHASHMAP_EXPORT void linkedhashmap_union_into(LinkedHashMap* map1, LinkedHashMap* map2);
+
+/// @brief Constructs a new map of the entries of `map1` whose keys are also in `map2`, in the insertion order of `map1`. This costs `O(min(|map1|, |map2|))` lookups, plus a walk of `map1` to build the result, whose table is sized as `linkedhashmap_shrink_to_fit` would size it, so that it is built without resizing and a miss still stops at a nearby free slot. Like `linkedhashmap_copy`, the keys and values themselves are not duplicated. When done with the new map, `linkedhashmap_free` will need to be called to free the memory.
+/// @param map1 The map whose entries are kept.
+/// @param map2 The map whose keys are looked for.
+/// @return The intersection of the maps.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_intersect(LinkedHashMap* map1, LinkedHashMap* map2);
+
+/// @brief Constructs a new map of the entries of `map1` whose keys are not in `map2`, in the insertion order of `map1`. This costs `O(min(|map1|, |map2|))` lookups, plus a walk of `map1` to build the result, which is sized as in `linkedhashmap_intersect`. When done with the new map, `linkedhashmap_free` will need to be called to free the memory.
+/// @param map1 The map whose entries are kept.
+/// @param map2 The map whose keys are left out.
+/// @return The difference of the maps.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_difference(LinkedHashMap* map1, LinkedHashMap* map2);
+
+/// @brief Constructs a new map of the entries whose keys are in exactly one of the maps, with those of `map1` first, followed by those of `map2`, each in their own insertion order. This costs `O(min(|map1|, |map2|))` lookups, plus a walk of both maps to build the result, which is sized as in `linkedhashmap_intersect`. When done with the new map, `linkedhashmap_free` will need to be called to free the memory.
+/// @param map1 The first map.
+/// @param map2 The second map.
+/// @return The symmetric difference of the maps.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_symmetric_difference(LinkedHashMap* map1, LinkedHashMap* map2);
+
 /// @brief Pops an entry from the map. Returns `NULL` if the key does not exist. When done with the returned pointer, `free` must be called on it, unless the pointer is `NULL`.
 /// @param map The linked hashmap.
 /// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
@@ -173,12 +632,112 @@ LINKEDHASHMAP_EXPORT void linkedhashmap_extend(LinkedHashMap* map1, LinkedHashMa
 /// @return The entry at the given key, or `NULL` if the key did not exist.
 LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_pop(LinkedHashMap* map, void* key, size_t key_size);
 
+/// @brief Pops an entry from the map, using a precomputed hash. Equivalent to `linkedhashmap_pop`, but does not hash the key unless the map has switched to its own hash. When done with the returned pointer, `free` must be called on it, unless the pointer is `NULL`.
+/// @param map The linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
+/// @param key_size The size of the given key.
+/// @param hash The hash of the key, as returned by `linkedhashmap_key_hash`.
+/// @return The entry at the given key, or `NULL` if the key did not exist.
+LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_pop_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash);
+
 /// @brief Deletes an entry from the map. This is equivalent to calling `linkedhashmap_pop` ignoring the returned entry.
 /// @param map The linked hashmap.
 /// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
 /// @param key_size The size of the given key.
 LINKEDHASHMAP_EXPORT void linkedhashmap_delete(LinkedHashMap* map, void* key, size_t key_size);
 
+/// @brief Removes a node from the insertion order list, keeping the digests up to date. The node stays in the table. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param node The node to unlink.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_order_unlink(LinkedHashMap* map, LinkedHashMapNode* node);
+
+/// @brief Links an unlinked node into the insertion order list directly after another node, keeping the digests up to date. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param index The slot of the node to link.
+/// @param anchor The slot of the node to place it after, or `LINKEDHASHMAP_NO_NODE` to place it at the front.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_order_link_after(LinkedHashMap* map, size_t index, size_t anchor);
+
+/// @brief Moves an entry to the end of the insertion order, as if it had just been inserted. This only relinks the entry, and never allocates or resizes.
+/// @param map The linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
+/// @param key_size The size of the given key.
+/// @return `true` if the key exists in the map.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_move_to_end(LinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Moves an entry to the front of the insertion order. This only relinks the entry, and never allocates or resizes.
+/// @param map The linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
+/// @param key_size The size of the given key.
+/// @return `true` if the key exists in the map.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_move_to_front(LinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Sets a key-value pair in the map and places it directly before another entry in the insertion order. If the key already exists, its value is replaced and it is moved without allocating. Nothing is changed if the anchor key does not exist.
+/// @param map The linked hashmap.
+/// @param anchor_key The key of the entry to place the pair before.
+/// @param anchor_key_size The size of the anchor key.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param value The value.
+/// @param value_size The size of the given value.
+/// @return `true` if the anchor key exists in the map.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_insert_before(LinkedHashMap* map, void* anchor_key, size_t anchor_key_size, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Sets a key-value pair in the map and places it directly after another entry in the insertion order. If the key already exists, its value is replaced and it is moved without allocating. Nothing is changed if the anchor key does not exist.
+/// @param map The linked hashmap.
+/// @param anchor_key The key of the entry to place the pair after.
+/// @param anchor_key_size The size of the anchor key.
+/// @param key The key.
+/// @param key_size The size of the given key.
+/// @param value The value.
+/// @param value_size The size of the given value.
+/// @return `true` if the anchor key exists in the map.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_insert_after(LinkedHashMap* map, void* anchor_key, size_t anchor_key_size, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Removes the oldest entry in the insertion order. This unlinks the head directly, without hashing or probing, and never allocates. Unlike `linkedhashmap_pop`, the table is not shrunk afterwards, so a map used as a queue keeps its capacity between bursts. Use `linkedhashmap_shrink_to_fit` to release it.
+/// @param map The linked hashmap.
+/// @param entry Where to store the removed entry. May be `NULL` if the entry is not needed.
+/// @return `true` if an entry was removed, or `false` if the map is empty.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_pop_front(LinkedHashMap* map, LinkedHashMapEntry* entry);
+
+/// @brief Removes the newest entry in the insertion order. This unlinks the tail directly, without hashing or probing, and never allocates. The table is not shrunk afterwards.
+/// @param map The linked hashmap.
+/// @param entry Where to store the removed entry. May be `NULL` if the entry is not needed.
+/// @return `true` if an entry was removed, or `false` if the map is empty.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_pop_back(LinkedHashMap* map, LinkedHashMapEntry* entry);
+
+/// @brief Retrieves the oldest entry in the insertion order without removing it. This never allocates.
+/// @param map The linked hashmap.
+/// @param entry Where to store the entry.
+/// @return `true` if the map is not empty.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_peek_front(LinkedHashMap* map, LinkedHashMapEntry* entry);
+
+/// @brief Retrieves the newest entry in the insertion order without removing it. This never allocates.
+/// @param map The linked hashmap.
+/// @param entry Where to store the entry.
+/// @return `true` if the map is not empty.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_peek_back(LinkedHashMap* map, LinkedHashMapEntry* entry);
+
+/// @brief Removes up to `count` of the oldest entries in the insertion order, as if by calling `linkedhashmap_pop_front` repeatedly.
+/// @param map The linked hashmap.
+/// @param entries An array of at least `count` entries to store the removed entries in, oldest first. May be `NULL` if the entries are not needed.
+/// @param count The maximum number of entries to remove.
+/// @return The number of entries removed.
+LINKEDHASHMAP_EXPORT size_t linkedhashmap_drain_front(LinkedHashMap* map, LinkedHashMapEntry* entries, size_t count);
+
+/// @brief Removes every entry for which a predicate returns `false`, keeping the remaining entries in their insertion order. The predicate is called once per entry, in insertion order, and must not modify the map. Unlike removing the entries one at a time, the table is rebuilt at most once, directly at the capacity the remaining entries need.
+/// @param map The linked hashmap.
+/// @param pred The predicate to run on each key-value pair. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value, the size of the value, and the additional `void*` argument. It should return `true` to keep the entry.
+/// @param arg An additional argument to pass to the predicate.
+/// @return The number of entries removed.
+LINKEDHASHMAP_EXPORT size_t linkedhashmap_retain(LinkedHashMap* map, bool (*pred)(void*, size_t, void*, size_t, void*), void* arg);
+
+/// @brief Removes a run of consecutive entries in the insertion order, rebuilding the table at most once.
+/// @param map The linked hashmap.
+/// @param start_index The position in the insertion order of the first entry to remove.
+/// @param count The maximum number of entries to remove.
+/// @return The number of entries removed, which is less than `count` if the run extends past the end of the map.
+LINKEDHASHMAP_EXPORT size_t linkedhashmap_remove_range(LinkedHashMap* map, size_t start_index, size_t count);
+
 /// @brief Checks whether a map contains a given key.
 /// @param map The linked hashmap.
 /// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
@@ -186,6 +745,14 @@ LINKEDHASHMAP_EXPORT void linkedhashmap_delete(LinkedHashMap* map, void* key, si
 /// @return `true` if the key exists in the map.
 LINKEDHASHMAP_EXPORT bool linkedhashmap_contains(LinkedHashMap* map, void* key, size_t key_size);
 
+/// @brief Checks whether a map contains a given key, using a precomputed hash. Equivalent to `linkedhashmap_contains`, but does not hash the key unless the map has switched to its own hash.
+/// @param map The linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison. This means that lookup can still be performed even if done via a pointer to a copy of the key, and not the exact same pointer that was inserted into the map in the first place.
+/// @param key_size The size of the given key.
+/// @param hash The hash of the key, as returned by `linkedhashmap_key_hash`.
+/// @return `true` if the key exists in the map.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_contains_hashed(LinkedHashMap* map, void* key, size_t key_size, uint64_t hash);
+
 /// @brief Checks if two maps contain the same set of key-value pairs. This does not take insertion order into account. For checking equality including insertion order, use `linkedhashmap_equal_with_insertion_order`.
 /// @param map1 The first map.
 /// @param map2 The second map.
@@ -198,23 +765,378 @@ LINKEDHASHMAP_EXPORT bool linkedhashmap_equal(LinkedHashMap* map1, LinkedHashMap
 /// @return `true` if both maps contain the same set of key-value pairs in the same order.
 LINKEDHASHMAP_EXPORT bool linkedhashmap_equal_with_insertion_order(LinkedHashMap* map1, LinkedHashMap* map2);
 
-/// @brief Empties the map and reallocates down to the default capacity.
+/// @brief Compares two maps, reporting each difference that turns the first map into the second through a callback. Each map is walked once in insertion order, looking every key up in the other map, without allocating per entry. Removed and changed keys are reported first, in the order of the first map, followed by added and moved keys, in the order of the second map. Any callback may be `NULL`, in which case that kind of difference is not reported. Passing `on_moved` also detects order changes: the keys in both maps are matched up by position, and the longest run of them that is in the same relative order in both maps stays in place, while every other shared key is reported as moved. This is the smallest set of keys that need to be moved, and takes `O(n log n)` time and one allocation.
+/// @param map1 The old map.
+/// @param map2 The new map.
+/// @param on_added The function to run on each key only in `map2`. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value, the size of the value, and the additional `void*` argument.
+/// @param on_removed The function to run on each key only in `map1`, with the same arguments as `on_added`.
+/// @param on_changed The function to run on each key whose value differs between the maps. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the old value, the size of the old value, a pointer to the new value, the size of the new value, and the additional `void*` argument.
+/// @param on_moved The function to run on each key whose position relative to the other shared keys changed, with the same arguments as `on_added`. The value passed is the one in `map2`.
+/// @param arg An additional `void*` argument to pass to the functions.
+LINKEDHASHMAP_EXPORT void linkedhashmap_diff(LinkedHashMap* map1, LinkedHashMap* map2, void (*on_added)(void*, size_t, void*, size_t, void*), void (*on_removed)(void*, size_t, void*, size_t, void*), void (*on_changed)(void*, size_t, void*, size_t, void*, size_t, void*), void (*on_moved)(void*, size_t, void*, size_t, void*), void* arg);
+
+/// @brief Empties the map, keeping its capacity so that it can be filled again without resizing. Only the slots that were in use are reset, so this takes time proportional to the length of the map rather than its capacity. `linkedhashmap_shrink_to_fit` can be called afterwards to give the memory back instead.
 /// @param map The linked hashmap.
 LINKEDHASHMAP_EXPORT void linkedhashmap_clear(LinkedHashMap* map);
 
-/// @brief Copies the contents of a map. This is a shallow copy. The keys and values themselves are not duplicated in this operation. Their pointers are duplicated instead. When done with the copy of the map, `linkedhashmap_free` will need to be called to free the memory.
+/// @brief Copies the contents of a map. This is a shallow copy. The keys and values themselves are not duplicated in this operation. Their pointers are duplicated instead. The node table is duplicated in a single allocation without rehashing. When done with the copy of the map, `linkedhashmap_free` will need to be called to free the memory.
 /// @param map The linked hashmap.
 /// @return The new copy of the map.
 LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_copy(LinkedHashMap* map);
 
+/// @brief Takes a point-in-time snapshot of the map. The snapshot shares the node table of the map, and whichever of the two is modified afterwards copies only the chunks of `LINKEDHASHMAP_CHUNK_SIZE` nodes that it writes to, so a single insertion, overwrite or removal costs `O(LINKEDHASHMAP_CHUNK_SIZE)` rather than a copy of the whole table. Operations that rewrite every node, such as resizing and sorting, take a private copy of the whole table instead. Taking the snapshot is constant time, apart from copying any chunks the map has written to while it still shares its table with an earlier snapshot. Once every other map sharing the table is freed, the written chunks are copied back into it. The two are independent, so the snapshot can be read on another thread while the map keeps being written to. Maps that still fit in their inline table are copied instead, which takes no longer. Like `linkedhashmap_copy`, the keys and values themselves are not duplicated. When done with the snapshot, `linkedhashmap_free` will need to be called to free the memory.
+/// @param map The linked hashmap.
+/// @return The snapshot of the map.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_snapshot(LinkedHashMap* map);
+
+/// @brief Prepares the map to be modified. While its node table is shared with a snapshot, the map copies each chunk it writes to from then on into `chunks`, and once nothing else shares the table, those chunks are copied back into it. Every operation that modifies the table calls this first.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_unshare(LinkedHashMap* map);
+
+/// @brief Drops the reference of the map to a shared node table, if it holds one.
+/// @param map The linked hashmap.
+/// @return `true` if the table is still in use by another map, in which case it must not be freed.
+LINKEDHASHMAP_TEST_EXPORT bool linkedhashmap_release_share(LinkedHashMap* map);
+
+#ifdef LINKEDHASHMAP_STATS
+
+/// @brief Reports runtime statistics for the map, accumulated since it was constructed or its statistics were last reset. This is only available when compiled with `LINKEDHASHMAP_STATS` defined.
+/// @param map The linked hashmap.
+/// @param stats The statistics to fill in.
+LINKEDHASHMAP_EXPORT void linkedhashmap_stats(LinkedHashMap* map, LinkedHashMapStats* stats);
+
+/// @brief Resets the runtime statistics for the map. This is only available when compiled with `LINKEDHASHMAP_STATS` defined.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_stats_reset(LinkedHashMap* map);
+
+/// @brief Sets how often lookups have their probe lengths recorded, for keeping statistics enabled in production at a lower cost. Resize and allocation counts are always recorded. This is only available when compiled with `LINKEDHASHMAP_STATS` defined.
+/// @param map The linked hashmap.
+/// @param sample_rate Record one in every `sample_rate` lookups. `1`, the default, records every lookup.
+LINKEDHASHMAP_EXPORT void linkedhashmap_stats_set_sample_rate(LinkedHashMap* map, size_t sample_rate);
+
+#endif
+
+#ifdef LINKEDHASHMAP_LATENCY
+
+/// @brief Calculates the latency histogram bucket a duration falls into. This is only intended to be used internally.
+/// @param nanoseconds The duration in nanoseconds.
+/// @return The bucket index.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_latency_bucket(uint64_t nanoseconds);
+
+/// @brief Calculates the highest duration that falls into a latency histogram bucket. This is only intended to be used internally.
+/// @param bucket The bucket index.
+/// @return The highest duration in the bucket, in nanoseconds.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_latency_bucket_value(size_t bucket);
+
+/// @brief Records the latency of an operation that started at the given time, and fires the threshold callback if it was exceeded. Does nothing if latency recording is disabled. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param operation The operation, one of the `LINKEDHASHMAP_OP_*` constants.
+/// @param start The time the operation started, in nanoseconds.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_latency_record(LinkedHashMap* map, int operation, uint64_t start);
+
+/// @brief Starts recording the latency of `linkedhashmap_set`, `linkedhashmap_get`, `linkedhashmap_pop` and `linkedhashmap_resize` on the map. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_latency_enable(LinkedHashMap* map);
+
+/// @brief Stops recording latencies on the map, discarding the histograms, thresholds and callback. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_latency_disable(LinkedHashMap* map);
+
+/// @brief Clears the recorded latencies of the map, keeping its thresholds and callback. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_latency_reset(LinkedHashMap* map);
+
+/// @brief Sets the latency above which an operation fires the map's callback. Enables latency recording if it is not already enabled. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+/// @param operation The operation, one of the `LINKEDHASHMAP_OP_*` constants.
+/// @param nanoseconds The threshold in nanoseconds. `0` disables the callback for the operation.
+LINKEDHASHMAP_EXPORT void linkedhashmap_latency_set_threshold(LinkedHashMap* map, int operation, uint64_t nanoseconds);
+
+/// @brief Sets the function called when an operation exceeds its threshold. Enables latency recording if it is not already enabled. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+/// @param fn The function to call. The function should take the following arguments: The map, the operation, the latency in nanoseconds, and the additional `void*` argument.
+/// @param arg An additional `void*` argument to pass to the function.
+LINKEDHASHMAP_EXPORT void linkedhashmap_latency_set_callback(LinkedHashMap* map, void (*fn)(LinkedHashMap*, int, uint64_t, void*), void* arg);
+
+/// @brief Returns the number of recorded calls of an operation. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+/// @param operation The operation, one of the `LINKEDHASHMAP_OP_*` constants.
+/// @return The number of recorded calls.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_latency_count(LinkedHashMap* map, int operation);
+
+/// @brief Returns the highest recorded latency of an operation. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+/// @param operation The operation, one of the `LINKEDHASHMAP_OP_*` constants.
+/// @return The highest latency in nanoseconds.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_latency_max(LinkedHashMap* map, int operation);
+
+/// @brief Returns a percentile of the recorded latencies of an operation, such as `99.0` for p99. This is only available when compiled with `LINKEDHASHMAP_LATENCY` defined.
+/// @param map The linked hashmap.
+/// @param operation The operation, one of the `LINKEDHASHMAP_OP_*` constants.
+/// @param percentile The percentile, between `0.0` and `100.0`.
+/// @return The latency in nanoseconds at or below which the given percentage of calls completed, or `0` if nothing has been recorded.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_latency_percentile(LinkedHashMap* map, int operation, double percentile);
+
+#endif
+
 /// @brief Applies a function to each key-value pair in the map, in the order in which they were inserted.
 /// @param map The linked hashmap.
 /// @param fn The function to run on each key-value pair. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value, the size of the value, and the additional `void*` argument.
 /// @param arg An additional `void*` argument to pass to the function.
 LINKEDHASHMAP_EXPORT void linkedhashmap_foreach(LinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg);
 
-/// @brief Frees the memory used by the map. This does not free the keys and values in the map, as it is assumed that they may still be referenced elsewhere in the application.
+/// @brief Calculates how many threads a parallel operation should use. This is only intended to be used internally.
+/// @param nthreads The requested number of threads, or `0` for one per online processor.
+/// @return The number of threads to use.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_thread_count(size_t nthreads);
+
+/// @brief Picks the slots whose nodes start each chunk of a parallel operation: the head, and the first node found in each of `max_chunks - 1` evenly spaced regions of the table. At most `LINKEDHASHMAP_PARALLEL_SAMPLE_PROBES` slots of each region are inspected, so this costs `O(max_chunks)` however sparse the table is, and a region whose first slots are all empty gets no boundary. This is only intended to be used internally.
+/// @param map The linked hashmap, which must not be empty.
+/// @param slots The array to write the slots into, which must hold `max_chunks` entries. They are written in no particular order, and may repeat.
+/// @param max_chunks The most chunks to split the map into.
+/// @return The number of slots written.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_parallel_sample(LinkedHashMap* map, size_t* slots, size_t max_chunks);
+
+/// @brief Applies a function to each key-value pair in the map using multiple threads. The insertion order is split into contiguous chunks, and each chunk is visited in insertion order by one thread at a time, but chunks run concurrently. The map must not be modified until this returns. Maps with fewer than `LINKEDHASHMAP_PARALLEL_MIN_LENGTH` entries are visited serially.
+/// @param map The linked hashmap.
+/// @param fn The function to run on each key-value pair. This may be called from several threads at once. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value, the size of the value, and the additional `void*` argument.
+/// @param arg An additional `void*` argument to pass to the function.
+/// @param nthreads The number of threads to use, including the calling thread. `0` uses one per online processor.
+LINKEDHASHMAP_EXPORT void linkedhashmap_foreach_parallel(LinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg, size_t nthreads);
+
+/// @brief Maps each key-value pair to a result and reduces the results into one using multiple threads. Results are always combined in insertion order, so `reduce_fn` only needs to be associative, not commutative. The map must not be modified until this returns.
+/// @param map The linked hashmap.
+/// @param map_fn The function to run on each key-value pair. This may be called from several threads at once. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value, the size of the value, and the additional `void*` argument. It should return the pair's result.
+/// @param reduce_fn The function that combines two results. This may be called from several threads at once. The function should take the following arguments: The result of the earlier entries, the result of the later entries, and the additional `void*` argument. It should return the combined result, and is responsible for freeing either input if necessary.
+/// @param arg An additional `void*` argument to pass to both functions.
+/// @param nthreads The number of threads to use, including the calling thread. `0` uses one per online processor.
+/// @return The combined result, or `NULL` if the map is empty.
+LINKEDHASHMAP_EXPORT void* linkedhashmap_map_reduce_parallel(LinkedHashMap* map, void* (*map_fn)(void*, size_t, void*, size_t, void*), void* (*reduce_fn)(void*, void*, void*), void* arg, size_t nthreads);
+
+/// @brief Sorts the insertion order of the map with a merge sort. Only the order links of the nodes are rewritten, so nothing is rehashed or moved within the table. The sort is stable, so entries that compare equal keep their relative order. A journal or write-ahead log records the whole new order as a single change.
+/// @param map The linked hashmap.
+/// @param cmp The function that compares two nodes. The function should take the following arguments: The first node, the second node, and the additional `void*` argument. It should return a negative number if the first node comes before the second, a positive number if it comes after, and `0` if they are equal. It must not modify the map.
+/// @param arg An additional `void*` argument to pass to the function.
+LINKEDHASHMAP_EXPORT void linkedhashmap_sort(LinkedHashMap* map, int (*cmp)(LinkedHashMapNode*, LinkedHashMapNode*, void*), void* arg);
+
+/// @brief Sorts the insertion order of the map like `linkedhashmap_sort`, using multiple threads. Each thread sorts a contiguous run of the order, and the runs are then merged in pairs. Maps with fewer than `LINKEDHASHMAP_PARALLEL_MIN_LENGTH` entries are sorted serially.
+/// @param map The linked hashmap.
+/// @param cmp The function that compares two nodes, as for `linkedhashmap_sort`. This may be called from several threads at once.
+/// @param arg An additional `void*` argument to pass to the function.
+/// @param nthreads The number of threads to use, including the calling thread. `0` uses one per online processor.
+LINKEDHASHMAP_EXPORT void linkedhashmap_sort_parallel(LinkedHashMap* map, int (*cmp)(LinkedHashMapNode*, LinkedHashMapNode*, void*), void* arg, size_t nthreads);
+
+/// @brief Relinks the insertion order of the map to follow the given nodes, and records the new order as a single change in the map's journal and write-ahead log. The map must not share its table, and every entry must be listed exactly once. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param nodes Pointers to every node of the map, in their new order.
+/// @param length The number of nodes, which must be the length of the map and at least `1`.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_order_set(LinkedHashMap* map, LinkedHashMapNode** nodes, size_t length);
+
+/// @brief Allocates a block of memory that will be owned by the map and freed along with it. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param size The size of the block in bytes.
+/// @return A pointer to the start of the block, or `NULL` if it could not be allocated.
+LINKEDHASHMAP_TEST_EXPORT void* linkedhashmap_storage_alloc(LinkedHashMap* map, size_t size);
+
+/// @brief Starts recording every change made to the map in a journal, so that other maps can be kept in sync by replaying only what changed. Sets, overwrites, pops, clears and reorderings are all recorded, including those made by bulk operations such as `linkedhashmap_retain` and `linkedhashmap_sort`. `linkedhashmap_entry` can't be used on a map with a journal, since the journal would not see values written through the pointer it returns, and `linkedhashmap_upsert` should be used instead. The journal copies the bytes of every key and value it records. Copies and snapshots of the map do not inherit its journal.
+/// @param map The linked hashmap.
+/// @param capacity The size of the journal's ring buffer in bytes. A consumer that falls further behind than this will need to resynchronize from a full copy of the map.
+LINKEDHASHMAP_EXPORT void linkedhashmap_journal_enable(LinkedHashMap* map, size_t capacity);
+
+/// @brief Stops recording changes to the map, discarding the journal.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_journal_disable(LinkedHashMap* map);
+
+/// @brief Gets the sequence number that the next change to the map will be recorded with. A consumer that has just copied or snapshotted the map should start reading from here.
+/// @param map The linked hashmap.
+/// @return The next sequence number, or `0` if the journal is not enabled.
+LINKEDHASHMAP_EXPORT uint64_t linkedhashmap_journal_sequence(LinkedHashMap* map);
+
+/// @brief Appends a record to the journal of the map. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param op The kind of change, one of the `LINKEDHASHMAP_JOURNAL_` constants.
+/// @param anchor The anchor key of an insertion before or after another key, or `NULL`.
+/// @param anchor_size The size of the anchor key.
+/// @param key The key that changed, `NULL` for a clear, or for a new order, every key in that order, each encoded as its size in a LEB128 varint followed by its bytes.
+/// @param key_size The size of the key.
+/// @param value The new value of the key, or `NULL` if the change doesn't set a value.
+/// @param value_size The size of the value.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_journal_record(LinkedHashMap* map, int op, void* anchor, size_t anchor_size, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Reads the records of the changes made to the map since a given sequence number, in the order they were made, and advances the cursor past them. As many whole records as fit are copied, so a buffer as large as the journal's capacity always holds at least one record.
+/// @param map The linked hashmap.
+/// @param cursor The sequence number of the first record to read. It is advanced to the sequence number of the first record that wasn't read.
+/// @param buffer The buffer to copy the records into.
+/// @param buffer_size The size of the buffer in bytes.
+/// @return The number of bytes copied, or `~0` if the journal is not enabled or the record at the cursor has already been dropped, in which case the consumer will need to resynchronize from a full copy of the map.
+LINKEDHASHMAP_EXPORT size_t linkedhashmap_journal_read(LinkedHashMap* map, uint64_t* cursor, void* buffer, size_t buffer_size);
+
+/// @brief Replays records read by `linkedhashmap_journal_read` into a map. The keys and values of the records are copied into memory owned by the map, and are freed by `linkedhashmap_free`. A copied value is freed as soon as a later record replaces it, as is a copied key once a record pops it, unless a copy or snapshot of the map is still alive, in which case they are kept until the map is freed. Copies and snapshots borrow them, and must not outlive the map. If the map has a journal of its own, the replayed changes are recorded in it too.
+/// @param map The linked hashmap.
+/// @param data The records to replay.
+/// @param size The size of the records in bytes.
+/// @return `true` if every record was replayed. `false` if a record is malformed or doesn't apply to the map, in which case the records before it have already been replayed.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_journal_apply(LinkedHashMap* map, void* data, size_t size);
+
+/// @brief Calculates a fingerprint of the slots keys are placed into by a map, which depends on its capacity and hash seed. A snapshot's stored table layout is only reused when the fingerprint matches, which requires the process that wrote it, since the seed is never stored. Maps that use SipHash never match. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @return The layout fingerprint.
+LINKEDHASHMAP_TEST_EXPORT uint64_t linkedhashmap_layout_fingerprint(LinkedHashMap* map);
+
+/// @brief Writes a snapshot of the map to a file descriptor. The snapshot is a versioned, checksummed binary format containing the key and value bytes of every entry, in insertion order. Writes are buffered and streamed, so the whole snapshot is never held in memory at once.
+/// @param map The linked hashmap.
+/// @param fd The file descriptor to write to.
+/// @param include_layout Whether to also store the slot of each entry, allowing `linkedhashmap_load` to place entries directly without probing. The slots are only reused when loading in the process that wrote them, since they depend on the secret hash seed, which is never stored.
+/// @return `true` if the snapshot was written successfully.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_save(LinkedHashMap* map, int fd, bool include_layout);
+
+/// @brief Reads a snapshot written by `linkedhashmap_save` from a file descriptor, constructing a new map. Unlike other maps, the keys and values of the loaded map are owned by it, and are freed by `linkedhashmap_free`. Copies of the loaded map borrow them, and must not outlive it. Sizes read from the header are checked against what is left of the file before anything is allocated from them, and the node table is only allocated once the checksum has been verified. When done with the map, `linkedhashmap_free` will need to be called to free the memory.
+/// @param fd The file descriptor to read from.
+/// @return The loaded map, or `NULL` if the snapshot could not be read, is of an unsupported version, is inconsistent with the size of the file, fails its checksum, or could not be allocated.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_load(int fd);
+
+#ifndef _WIN32
+
+/// @brief Calculates the slot of a key within a frozen map from the key's hash and its bucket's displacement. This is only intended to be used internally.
+/// @param hash The seeded hash of the key.
+/// @param displacement The displacement of the key's bucket.
+/// @param length The number of entries in the frozen map.
+/// @return The slot of the key.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_frozen_slot(uint64_t hash, uint32_t displacement, size_t length);
+
+/// @brief Writes the map to a file that can be opened as a read-only `FrozenLinkedHashMap`. The file contains a minimal perfect hash of the keys, the key and value bytes, and the insertion order. All references within the file are offsets, so it can be mapped at any address. The file is written alongside `path` and renamed into place, so readers never see a partially written file.
+/// @param map The linked hashmap.
+/// @param path The path of the file to write.
+/// @return `true` if the file was written successfully.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_freeze(LinkedHashMap* map, const char* path);
+
+/// @brief Opens a file written by `linkedhashmap_freeze`. The file is memory-mapped and read in place without any deserialization, and the page cache is shared by every process that opens the same file. Opening checks that every section, record and order entry lies within the file, which takes a single pass over the records, so that lookups never read outside the mapping. When done with the map, `linkedhashmap_frozen_close` will need to be called to unmap it.
+/// @param path The path of the file to open.
+/// @return The frozen map, or `NULL` if the file could not be mapped or is not a valid frozen map for this machine, including one that has been truncated or damaged.
+LINKEDHASHMAP_EXPORT FrozenLinkedHashMap* linkedhashmap_frozen_open(const char* path);
+
+/// @brief Locates the slot where a given key resides in a frozen map. This is only intended to be used internally.
+/// @param map The frozen linked hashmap.
+/// @param key The key to locate.
+/// @param key_size The size of the key in bytes.
+/// @return The slot of the given key. Returns `~0` if the key does not exist.
+LINKEDHASHMAP_TEST_EXPORT size_t linkedhashmap_frozen_find_key(FrozenLinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Returns the number of items stored in the frozen map.
+/// @param map The frozen linked hashmap.
+/// @return The number of items.
+LINKEDHASHMAP_EXPORT size_t linkedhashmap_frozen_length(FrozenLinkedHashMap* map);
+
+/// @brief Returns whether the frozen map is empty.
+/// @param map The frozen linked hashmap.
+/// @return `true` if the frozen map has no items.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_frozen_is_empty(FrozenLinkedHashMap* map);
+
+/// @brief Constructs an entry representing the record in the given slot of a frozen map. This is only intended to be used internally.
+/// @param map The frozen linked hashmap.
+/// @param slot The slot of the record.
+/// @return A pointer to a representation of the entry.
+LINKEDHASHMAP_TEST_EXPORT LinkedHashMapEntry* linkedhashmap_frozen_entry(FrozenLinkedHashMap* map, size_t slot);
+
+/// @brief Retrieves the entry at the given key from a frozen map. Returns `NULL` if the key does not exist. The key and value point into the read-only mapping, and are valid until the map is closed. When done with the returned pointer, `free` must be called on it.
+/// @param map The frozen linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison.
+/// @param key_size The size of the given key.
+/// @return A pointer to a representation of the requested entry.
+LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_frozen_get(FrozenLinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Retrieves the entry at the given insertion order index from a frozen map. Returns `NULL` if the index is invalid. Unlike `linkedhashmap_get_by_index`, this is an `O(1)` operation. When done with the returned pointer, `free` must be called on it.
+/// @param map The frozen linked hashmap.
+/// @param index The insertion order index.
+/// @return A pointer to a representation of the requested entry.
+LINKEDHASHMAP_EXPORT LinkedHashMapEntry* linkedhashmap_frozen_get_by_index(FrozenLinkedHashMap* map, size_t index);
+
+/// @brief Gets the insertion order index of the given key in a frozen map. Returns `~0` if the key does not exist. Unlike `linkedhashmap_get_index`, this is an `O(1)` operation.
+/// @param map The frozen linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison.
+/// @param key_size The size of the given key.
+/// @return The insertion order index.
+LINKEDHASHMAP_EXPORT size_t linkedhashmap_frozen_get_index(FrozenLinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Checks whether a frozen map contains a given key.
+/// @param map The frozen linked hashmap.
+/// @param key The lookup key. Keys are compared using value comparison, not reference comparison.
+/// @param key_size The size of the given key.
+/// @return `true` if the key exists in the frozen map.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_frozen_contains(FrozenLinkedHashMap* map, void* key, size_t key_size);
+
+/// @brief Applies a function to each key-value pair in a frozen map, in the order in which they were inserted into the original map. The keys and values passed to the function point into the read-only mapping, and must not be modified.
+/// @param map The frozen linked hashmap.
+/// @param fn The function to run on each key-value pair. The function should take the following arguments: A pointer to the key, the size of the key, a pointer to the value, the size of the value, and the additional `void*` argument.
+/// @param arg An additional `void*` argument to pass to the function.
+LINKEDHASHMAP_EXPORT void linkedhashmap_frozen_foreach(FrozenLinkedHashMap* map, void (*fn)(void*, size_t, void*, size_t, void*), void* arg);
+
+/// @brief Unmaps a frozen map and frees the memory used by it. Any entries retrieved from the map still need to be freed, but the keys and values they point to are no longer valid.
+/// @param map The frozen linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_frozen_close(FrozenLinkedHashMap* map);
+
+/// @brief Constructs a new map from a file of delimited key-value records, such as a TSV or CSV dump. The file is memory-mapped, and keys and values point directly into the mapping rather than being copied. The mapping is owned by the map, and is unmapped by `linkedhashmap_free`. Records are inserted in file order. Each record is split at the first field delimiter into its key and value, and a record with no field delimiter has an empty value. Keys and values are not null-terminated. When the record delimiter is `'\n'`, a trailing `'\r'` is dropped. Empty records are skipped. When done with the map, `linkedhashmap_free` will need to be called to free the memory.
+/// @param path The path of the file to load.
+/// @param field_delimiter The character separating a key from its value.
+/// @param record_delimiter The character separating records.
+/// @return The loaded map, or `NULL` if the file could not be mapped.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_load_delimited(const char* path, char field_delimiter, char record_delimiter);
+
+/// @brief Opens a map backed by a durable write-ahead log, recovering its contents from the file. The snapshot at the start of the file is loaded, and the records after it are replayed in order. A record left incomplete by a crash, along with anything after it, is cut off the end of the file. If the file does not exist, it is created holding an empty map. From then on every change made to the map is appended to the log, the same changes as would be recorded by `linkedhashmap_journal_enable`. By default each change is committed to disk before the call that made it returns, see `linkedhashmap_wal_set_sync` to commit changes in groups. Once the records in the log grow past `LINKEDHASHMAP_WAL_COMPACT_SIZE` bytes, the log is compacted by the next set or pop, including pops from either end of the order. `linkedhashmap_entry` can't be used on the map, since the log would not see values written through the pointer it returns, and `linkedhashmap_upsert` should be used instead. The keys and values recovered from the file are owned by the map, as with `linkedhashmap_load`, and those replayed from the log are freed once a later record replaces them, as with `linkedhashmap_journal_apply`. Copies and snapshots of the map do not inherit its log. When done with the map, `linkedhashmap_free` will need to be called, which commits any buffered changes and closes the log.
+/// @param path The path of the log file.
+/// @return The recovered map, or `NULL` if the file could not be created or read, or holds a record that cannot be applied.
+LINKEDHASHMAP_EXPORT LinkedHashMap* linkedhashmap_wal_open(const char* path);
+
+/// @brief Sets how changes are grouped into commits. Changes are buffered until either enough of them have been made or enough time has passed since the last commit, and are then written and synced to disk together. A change is only durable once it has been committed. There is no background thread, so the time limit is only checked when a change is made. A map that goes idle holds its buffered changes past the limit until `linkedhashmap_wal_sync_due` or `linkedhashmap_wal_sync` is called, or the map is freed.
+/// @param map The linked hashmap.
+/// @param records The number of changes to commit at once, or `0` for no limit. Defaults to `1`, which commits every change on its own.
+/// @param milliseconds The longest time to leave changes uncommitted, or `0` for no limit.
+LINKEDHASHMAP_EXPORT void linkedhashmap_wal_set_sync(LinkedHashMap* map, size_t records, uint64_t milliseconds);
+
+/// @brief Sets how large the records in the log may grow before the log is compacted into a new snapshot.
+/// @param map The linked hashmap.
+/// @param size The size of the records in bytes, or `0` to only compact when `linkedhashmap_wal_compact` is called. Defaults to `LINKEDHASHMAP_WAL_COMPACT_SIZE`.
+LINKEDHASHMAP_EXPORT void linkedhashmap_wal_set_compact_size(LinkedHashMap* map, uint64_t size);
+
+/// @brief Appends a record to the write-ahead log of the map, committing it if the group is complete. This is only intended to be used internally.
+/// @param map The linked hashmap.
+/// @param op The kind of change, one of the `LINKEDHASHMAP_JOURNAL_` constants.
+/// @param anchor The anchor key of a relative insertion, or `NULL`.
+/// @param anchor_size The size of the anchor key.
+/// @param key The key that was changed, or `NULL` for a clear.
+/// @param key_size The size of the key.
+/// @param value The new value, for changes that set one.
+/// @param value_size The size of the value.
+LINKEDHASHMAP_TEST_EXPORT void linkedhashmap_wal_append(LinkedHashMap* map, int op, void* anchor, size_t anchor_size, void* key, size_t key_size, void* value, size_t value_size);
+
+/// @brief Commits every buffered change to disk.
+/// @param map The linked hashmap.
+/// @return `true` if every change made so far is durable. Returns `false` if the map has no log, or if a write to the log has failed, after which changes are no longer logged until `linkedhashmap_wal_compact` succeeds.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_wal_sync(LinkedHashMap* map);
+
+/// @brief Commits the buffered changes if they have waited as long as the time limit set by `linkedhashmap_wal_set_sync`, and otherwise does nothing. A map that may go idle with changes buffered can call this from a timer or an event loop to keep to the limit, without paying for a commit each time.
+/// @param map The linked hashmap.
+/// @return `false` if the map has no log, or if a write to the log has failed, as for `linkedhashmap_wal_sync`.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_wal_sync_due(LinkedHashMap* map);
+
+/// @brief Compacts the log by writing a new snapshot of the map and starting an empty log after it. The new file is written alongside the log and renamed into place, so a crash during compaction leaves the old log intact.
+/// @param map The linked hashmap.
+/// @return `true` if the log was compacted.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_wal_compact(LinkedHashMap* map);
+
+/// @brief Commits any buffered changes and closes the log, after which changes to the map are no longer logged.
+/// @param map The linked hashmap.
+/// @return `true` if every change was committed, or if the map has no log.
+LINKEDHASHMAP_EXPORT bool linkedhashmap_wal_close(LinkedHashMap* map);
+
+#endif
+
+/// @brief Frees the memory used by the map. This does not free the keys and values in the map, as it is assumed that they may still be referenced elsewhere in the application. Memory owned by the map, such as the contents of a loaded snapshot, is freed. A map with a write-ahead log commits any buffered changes and closes the log first.
 /// @param map The linked hashmap.
 LINKEDHASHMAP_EXPORT void linkedhashmap_free(LinkedHashMap* map);
 
+/// @brief Frees the memory owned by a map constructed with `linkedhashmap_init`, like `linkedhashmap_free`, but leaves the memory of the map itself, and any node buffer passed to `linkedhashmap_init_with_buffer`, to the caller. The map can be constructed again in the same memory afterwards.
+/// @param map The linked hashmap.
+LINKEDHASHMAP_EXPORT void linkedhashmap_destroy(LinkedHashMap* map);
+
 #endif // __LINKEDHASHMAP_H__
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 
 #define STR_SIZE(s) ((strlen(s) + 1) * sizeof(char))
 
@@ -179,7 +180,7 @@ void test_init(void)
     TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)0);
     TEST_ASSERT(linkedhashmap_is_empty(map));
     TEST_ASSERT_EQ(map->length, (size_t)0);
-    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_MIN_SIZE);
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
 
     linkedhashmap_free(map);
 }
@@ -198,19 +199,228 @@ void test_init_with_capacity(void)
     linkedhashmap_free(map);
 }
 
+// test maps constructed in memory provided by the caller
+void test_init_destroy(void)
+{
+    size_t keys[48];
+    LinkedHashMap maps[4];
+
+    for (size_t i = 0; i < 48; i++)
+        keys[i] = i * 5;
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        linkedhashmap_init(&(maps[i]), 0);
+        TEST_ASSERT_EQ(maps[i].capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
+        TEST_ASSERT(maps[i].nodes == maps[i].small_nodes);
+
+        for (size_t j = 0; j <= i * 4; j++)
+            TEST_ASSERT(linkedhashmap_set(&(maps[i]), &(keys[j]), sizeof(keys[j]), &(keys[j]), sizeof(keys[j])) == NULL);
+    }
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQ(linkedhashmap_length(&(maps[i])), i * 4 + 1);
+        TEST_ASSERT(linkedhashmap_contains(&(maps[i]), &(keys[i * 4]), sizeof(keys[0])));
+        linkedhashmap_destroy(&(maps[i]));
+    }
+
+    // the buffer is used until the first resize, and never freed by the map
+    LinkedHashMapNode buffer[32];
+    LinkedHashMap* map = &(maps[0]);
+    linkedhashmap_init_with_buffer(map, buffer, 32);
+
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+    TEST_ASSERT(map->nodes == buffer);
+    TEST_ASSERT(!map->nodes_owned);
+
+    for (size_t i = 0; i < 24; i++)
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+
+    TEST_ASSERT(map->nodes == buffer);
+
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(map);
+    TEST_ASSERT(snapshot->nodes != buffer);
+    TEST_ASSERT(snapshot->nodes_owned);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, snapshot));
+
+    linkedhashmap_clear(map);
+    TEST_ASSERT(map->nodes == buffer);
+    TEST_ASSERT_EQ(snapshot->length, (size_t)24);
+
+    for (size_t i = 0; i < 48; i++)
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+
+    TEST_ASSERT_EQ(map->capacity, (size_t)64);
+    TEST_ASSERT(map->nodes != buffer);
+    TEST_ASSERT(map->nodes_owned);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->head)->key), keys[0]);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->tail)->key), keys[47]);
+
+    for (size_t i = 0; i < 48; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(keys[i]), sizeof(keys[i])));
+
+    linkedhashmap_destroy(map);
+    linkedhashmap_free(snapshot);
+
+    // the same memory can be used again, and buffers no larger than the inline table are not needed
+    linkedhashmap_init_with_buffer(map, buffer, LINKEDHASHMAP_SMALL_SIZE);
+    TEST_ASSERT(map->nodes == map->small_nodes);
+    TEST_ASSERT(linkedhashmap_set(map, &(keys[0]), sizeof(keys[0]), &(keys[0]), sizeof(keys[0])) == NULL);
+    linkedhashmap_destroy(map);
+}
+
 // test hash function
 void test_hash(void)
 {
-    LinkedHashMap* map = linkedhashmap_new();
+    LinkedHashMap* map = linkedhashmap_new_with_capacity(LINKEDHASHMAP_MIN_SIZE);
 
     int int_key = 123;
     size_t int_hash = linkedhashmap_hash(map, &int_key, sizeof(int));
-    TEST_ASSERT_EQ(int_hash, (size_t)(123 % map->capacity));
+    TEST_ASSERT(int_hash < map->capacity);
+    TEST_ASSERT_EQ(int_hash, (size_t)(linkedhashmap_hash_key(map, &int_key, sizeof(int)) % map->capacity));
 
     char* str_key = "abcde";
     size_t str_hash = linkedhashmap_hash(map, str_key, STR_SIZE(str_key));
-    TEST_ASSERT_EQ(str_hash, (size_t)(495 % map->capacity));
+    TEST_ASSERT(str_hash < map->capacity);
+    TEST_ASSERT_EQ(str_hash, (size_t)(linkedhashmap_hash_key(map, str_key, STR_SIZE(str_key)) % map->capacity));
+
+    // the seed is shared by every hashed map in the process
+    LinkedHashMap* map2 = linkedhashmap_new_with_capacity(LINKEDHASHMAP_MIN_SIZE);
+    TEST_ASSERT_EQ(map->hash_seed, map2->hash_seed);
+    TEST_ASSERT_EQ(map->hash_seed, linkedhashmap_process_seed());
+    TEST_ASSERT_EQ(linkedhashmap_hash_key(map, str_key, STR_SIZE(str_key)), linkedhashmap_hash_key(map2, str_key, STR_SIZE(str_key)));
+    linkedhashmap_free(map2);
+
+    // SipHash-2-4 reference vectors, with key 00 01 ... 0f
+    unsigned char message[15];
+
+    for (int i = 0; i < 15; i++)
+        message[i] = (unsigned char)i;
+
+    TEST_ASSERT_EQ(linkedhashmap_siphash(message, 0, 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL), (uint64_t)0x726fdb47dd0e0e31ULL);
+    TEST_ASSERT_EQ(linkedhashmap_siphash(message, 15, 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL), (uint64_t)0xa129ca6149be45e5ULL);
+
+    linkedhashmap_free(map);
+}
+
+// test that colliding keys switch the map over to a keyed hash
+void test_hash_flooding(void)
+{
+    LinkedHashMap* flood_map = linkedhashmap_new_with_capacity(1024);
+    uint32_t* keys = (uint32_t*)malloc(256 * sizeof(uint32_t));
+    size_t found = 0;
+
+    // collide keys the way an attacker who learned the seed would
+    for (uint32_t candidate = 0; found < 256; candidate++)
+        if (linkedhashmap_hash(flood_map, &candidate, sizeof(candidate)) == 0)
+            keys[found++] = candidate;
+
+    for (size_t i = 0; i < 256; i++)
+        TEST_ASSERT(linkedhashmap_set(flood_map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+
+    TEST_ASSERT(flood_map->strong_hash);
+    TEST_ASSERT(!flood_map->hash_flooded);
+    TEST_ASSERT_EQ(flood_map->length, (size_t)256);
+    TEST_ASSERT_EQ(flood_map->capacity, (size_t)1024);
+
+    size_t current = flood_map->head;
+
+    for (size_t i = 0; i < 256; i++)
+    {
+        TEST_ASSERT(linkedhashmap_contains(flood_map, &(keys[i]), sizeof(keys[i])));
+        TEST_ASSERT_EQ((size_t)*(uint32_t*)linkedhashmap_node(flood_map, current)->key, (size_t)keys[i]);
+        current = linkedhashmap_node(flood_map, current)->next;
+    }
+
+    LinkedHashMap* copied_map = linkedhashmap_copy(flood_map);
+    TEST_ASSERT(copied_map->strong_hash);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(flood_map, copied_map));
+    linkedhashmap_free(copied_map);
+
+    free(keys);
+    linkedhashmap_free(flood_map);
+
+    // a table more than half full is still protected, with a threshold scaled by its load
+    flood_map = linkedhashmap_new_with_capacity(4096);
+    keys = (uint32_t*)malloc(3072 * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < 2176; i++)
+    {
+        keys[i] = 0x80000000u | i;
+        TEST_ASSERT(linkedhashmap_set(flood_map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+    }
+
+    TEST_ASSERT(!flood_map->strong_hash);
+    found = 2176;
+
+    for (uint32_t candidate = 0; found < 3072; candidate++)
+        if (linkedhashmap_hash(flood_map, &candidate, sizeof(candidate)) == 0)
+            keys[found++] = candidate;
+
+    for (size_t i = 2176; i < 3072; i++)
+        TEST_ASSERT(linkedhashmap_set(flood_map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+
+    TEST_ASSERT(flood_map->strong_hash);
+    TEST_ASSERT_EQ(flood_map->capacity, (size_t)4096);
+
+    for (size_t i = 0; i < 3072; i++)
+        TEST_ASSERT(linkedhashmap_contains(flood_map, &(keys[i]), sizeof(keys[i])));
+
+    free(keys);
+    linkedhashmap_free(flood_map);
+
+    // ordinary keys never trigger the switch, but it can be requested explicitly
+    INIT_SQUARES();
+    TEST_ASSERT(!map->strong_hash);
+    linkedhashmap_use_strong_hash(map);
+    TEST_ASSERT(map->strong_hash);
+
+    for (int i = 0; i < 16; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(indices[i]), sizeof(indices[i])));
+
+    linkedhashmap_free(map);
+}
+
+// test lookups with a precomputed hash across several maps
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_hashed(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* overlay = linkedhashmap_new();
+    uint64_t hash = linkedhashmap_key_hash(&(indices[5]), sizeof(indices[5]));
+
+    TEST_ASSERT_EQ(hash, linkedhashmap_hash_key(map, &(indices[5]), sizeof(indices[5])));
+    TEST_ASSERT(linkedhashmap_contains_hashed(map, &(indices[5]), sizeof(indices[5]), hash));
+    TEST_ASSERT(!linkedhashmap_contains_hashed(overlay, &(indices[5]), sizeof(indices[5]), hash));
+
+    TEST_ASSERT(linkedhashmap_set_hashed(overlay, &(indices[5]), sizeof(indices[5]), &(squares[16]), sizeof(squares[16]), hash) == NULL);
+    LinkedHashMapEntry* res = linkedhashmap_get(overlay, &(indices[5]), sizeof(indices[5]));
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 256);
+    free(res);
+
+    res = linkedhashmap_get_hashed(map, &(indices[5]), sizeof(indices[5]), hash);
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 25);
+    free(res);
 
+    // a map with its own hash ignores the precomputed one
+    linkedhashmap_use_strong_hash(map);
+    res = linkedhashmap_get_hashed(map, &(indices[5]), sizeof(indices[5]), hash);
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 25);
+    free(res);
+
+    res = linkedhashmap_pop_hashed(map, &(indices[5]), sizeof(indices[5]), hash);
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 25);
+    free(res);
+    TEST_ASSERT(!linkedhashmap_contains(map, &(indices[5]), sizeof(indices[5])));
+
+    res = linkedhashmap_pop_hashed(overlay, &(indices[5]), sizeof(indices[5]), hash);
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 256);
+    free(res);
+    TEST_ASSERT(linkedhashmap_is_empty(overlay));
+
+    linkedhashmap_free(overlay);
     linkedhashmap_free(map);
 }
 
@@ -223,7 +433,7 @@ void test_set(void)
     TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)16);
     TEST_ASSERT(!linkedhashmap_is_empty(map));
     TEST_ASSERT_EQ(map->length, (size_t)16);
-    TEST_ASSERT_EQ(map->capacity, (size_t)16);
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
 
     int mapvalue = 21;
     LinkedHashMapEntry* res1 = linkedhashmap_set(map, &(indices[3]), sizeof(indices[3]), &mapvalue, sizeof(mapvalue));
@@ -236,7 +446,7 @@ void test_set(void)
     free(res2);
     linkedhashmap_free(map);
 
-    LinkedHashMap* map2 = linkedhashmap_new();
+    LinkedHashMap* map2 = linkedhashmap_new_with_capacity(16);
 
     int key1 = 5;
     int value1 = 1;
@@ -259,16 +469,16 @@ void test_set(void)
     linkedhashmap_delete(map2, &key1, sizeof(key1));
 
     TEST_ASSERT_EQ(map2->length, (size_t)1);
-    TEST_ASSERT_EQ(map2->capacity, (size_t)16);
+    TEST_ASSERT_EQ(map2->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
 
     LinkedHashMapEntry* res5 = linkedhashmap_set(map2, &key2, sizeof(key2), &value3, sizeof(value3));
 
     TEST_ASSERT_EQ(map2->length, (size_t)1);
-    TEST_ASSERT_EQ(map2->capacity, (size_t)16);
+    TEST_ASSERT_EQ(map2->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
     TEST_ASSERT_INT_EQ(*(int*)(res5->key), key2);
     TEST_ASSERT_INT_EQ(*(int*)(res5->value), value2);
 
-    LinkedHashMapEntry* res6 = linkedhashmap_get(map, &key2, sizeof(value3));
+    LinkedHashMapEntry* res6 = linkedhashmap_get(map2, &key2, sizeof(key2));
     TEST_ASSERT_INT_EQ(*(int*)(res6->value), value3);
 
     free(res5);
@@ -340,117 +550,1633 @@ void test_resize_up(void)
 {
     INIT_SQUARES();
 
-    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+
+    TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)17);
+    TEST_ASSERT_EQ(map->length, (size_t)17);
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+
+    for (int i = 0; i < 17; i++)
+    {
+        LinkedHashMapEntry* res = linkedhashmap_get(map, &(indices[i]), sizeof(indices[i]));
+        TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[i]);
+        free(res);
+    }
+
+    linkedhashmap_free(map);
+}
+
+// test pop and resize_down
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_pop_resize_down(void)
+{
+    INIT_SQUARES();
+
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+
+    LinkedHashMapEntry* res1 = linkedhashmap_pop(map, &(indices[16]), sizeof(indices[16]));
+
+    TEST_ASSERT_INT_EQ(*(int*)(res1->value), squares[16]);
+    TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)16);
+    TEST_ASSERT_EQ(map->length, (size_t)16);
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+
+    free(res1);
+
+    // the table only shrinks once it is a quarter full, so halving it leaves room to grow again
+    for (int i = 15; i >= 8; i--)
+        free(linkedhashmap_pop(map, &(indices[i]), sizeof(indices[i])));
+
+    TEST_ASSERT_EQ(map->length, (size_t)8);
+    TEST_ASSERT_EQ(map->capacity, (size_t)16);
+
+    for (int i = 0; i < 8; i++)
+    {
+        LinkedHashMapEntry* res2 = linkedhashmap_get(map, &(indices[i]), sizeof(indices[i]));
+        TEST_ASSERT_INT_EQ(*(int*)(res2->value), squares[i]);
+        free(res2);
+    }
+
+    linkedhashmap_free(map);
+}
+
+// test copy, equal, and equal with insertion order
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_copy_equal(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* map2 = linkedhashmap_copy(map);
+
+    for (int i = 0; i < 16; i++)
+    {
+        LinkedHashMapEntry* res = linkedhashmap_get(map2, &(indices[i]), sizeof(indices[i]));
+        TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[i]);
+        free(res);
+    }
+
+    TEST_ASSERT(linkedhashmap_equal(map, map2));
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+
+    LinkedHashMapEntry* res = linkedhashmap_set(map2, &(indices[3]), sizeof(indices[3]), &(squares[3]), sizeof(squares[3]));
+    free(res);
+
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+
+    LinkedHashMap* map3 = linkedhashmap_new();
+
+    for (int i = 1; i < 16; i++)
+        TEST_ASSERT(linkedhashmap_set(map3, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+
+    TEST_ASSERT(linkedhashmap_set(map3, &(indices[0]), sizeof(indices[0]), &(squares[0]), sizeof(squares[0])) == NULL);
+
+    TEST_ASSERT(linkedhashmap_equal(map, map3));
+    TEST_ASSERT(!linkedhashmap_equal_with_insertion_order(map, map3));
+
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+    linkedhashmap_free(map3);
+}
+
+// test snapshots
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_snapshot(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* copy = linkedhashmap_copy(map);
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(map);
+    LinkedHashMap* snapshot2 = linkedhashmap_snapshot(map);
+
+    // taking a snapshot copies nothing
+    TEST_ASSERT(snapshot->nodes == map->nodes);
+    TEST_ASSERT(snapshot2->nodes == map->nodes);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, snapshot));
+
+    // misses and reads leave the table shared
+    TEST_ASSERT(linkedhashmap_pop(map, &(indices[16]), sizeof(indices[16])) == NULL);
+    TEST_ASSERT(!linkedhashmap_move_to_end(map, &(indices[16]), sizeof(indices[16])));
+    TEST_ASSERT(linkedhashmap_contains(map, &(indices[3]), sizeof(indices[3])));
+    TEST_ASSERT(snapshot->nodes == map->nodes);
+
+    // the first write gives the map its own copy of the chunk it lands in, and the rest of the table stays shared
+    int value = 21;
+    free(linkedhashmap_set(map, &(indices[3]), sizeof(indices[3]), &value, sizeof(value)));
+    TEST_ASSERT(snapshot->nodes == map->nodes);
+    TEST_ASSERT(map->chunks != NULL && map->chunks[0] != NULL);
+    TEST_ASSERT(snapshot->chunks == NULL);
+    TEST_ASSERT(snapshot2->chunks == NULL);
+    TEST_ASSERT(linkedhashmap_move_to_front(map, &(indices[15]), sizeof(indices[15])));
+    linkedhashmap_delete(map, &(indices[0]), sizeof(indices[0]));
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->head)->key), 15);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->tail)->key), 16);
+
+    // the snapshots still see the map as it was
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(snapshot, copy));
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(snapshot2, copy));
+    TEST_ASSERT(!linkedhashmap_contains(snapshot, &(indices[16]), sizeof(indices[16])));
+
+    // snapshots are maps in their own right, and writing to one leaves the other alone
+    LinkedHashMapEntry entry;
+    TEST_ASSERT(linkedhashmap_pop_front(snapshot2, &entry));
+    TEST_ASSERT_INT_EQ(*(int*)(entry.key), 0);
+    TEST_ASSERT(snapshot2->chunks != NULL && snapshot2->chunks[0] != NULL);
+    TEST_ASSERT(snapshot->chunks == NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(snapshot, copy));
+    TEST_ASSERT_EQ(snapshot2->length, (size_t)15);
+
+    // a snapshot of a map takes copies of the chunks the map has written to
+    LinkedHashMap* snapshot3 = linkedhashmap_snapshot(map);
+    TEST_ASSERT(snapshot3->nodes == map->nodes);
+    TEST_ASSERT(snapshot3->chunks[0] != map->chunks[0]);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(snapshot3, map));
+    TEST_ASSERT(linkedhashmap_move_to_end(map, &(indices[15]), sizeof(indices[15])));
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(snapshot3, snapshot3->head)->key), 15);
+    linkedhashmap_free(snapshot3);
+
+    // resizing and clearing a map never copy a shared table
+    linkedhashmap_free(snapshot2);
+    snapshot2 = linkedhashmap_snapshot(map);
+    linkedhashmap_reserve(map, 64);
+    TEST_ASSERT(map->chunks == NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, snapshot2));
+    linkedhashmap_clear(snapshot2);
+    TEST_ASSERT(linkedhashmap_is_empty(snapshot2));
+    TEST_ASSERT_EQ(map->length, (size_t)16);
+    linkedhashmap_free(snapshot2);
+
+    // once the other holders are gone, the last one takes back the chunks it wrote and writes in place
+    LinkedHashMapNode* nodes = snapshot->nodes;
+    TEST_ASSERT(linkedhashmap_move_to_end(snapshot, &(indices[0]), sizeof(indices[0])));
+    TEST_ASSERT(snapshot->nodes == nodes);
+    TEST_ASSERT(snapshot->chunks == NULL);
+    TEST_ASSERT(snapshot->share == NULL);
+    TEST_ASSERT(linkedhashmap_move_to_front(snapshot, &(indices[0]), sizeof(indices[0])));
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(snapshot, copy));
+
+    linkedhashmap_free(snapshot);
+    linkedhashmap_free(copy);
+    linkedhashmap_free(map);
+
+    // a single write to a large shared table copies a chunk or two of it, not the whole table
+    size_t large_count = 100000;
+    size_t* large_keys = (size_t*)malloc((large_count + 1) * sizeof(size_t));
+    LinkedHashMap* large = linkedhashmap_new();
+
+    for (size_t i = 0; i <= large_count; i++)
+    {
+        large_keys[i] = i;
+
+        if (i < large_count)
+            TEST_ASSERT(linkedhashmap_set(large, &(large_keys[i]), sizeof(large_keys[i]), &(large_keys[i]), sizeof(large_keys[i])) == NULL);
+    }
+
+    LinkedHashMap* large_copy = linkedhashmap_copy(large);
+    LinkedHashMap* large_snapshot = linkedhashmap_snapshot(large);
+    size_t capacity = large->capacity;
+
+    TEST_ASSERT(linkedhashmap_set(large, &(large_keys[large_count]), sizeof(large_keys[large_count]), &(large_keys[0]), sizeof(large_keys[0])) == NULL);
+    TEST_ASSERT_EQ(large->capacity, capacity);
+    TEST_ASSERT(large->nodes == large_snapshot->nodes);
+
+    size_t copied = 0;
+
+    for (size_t i = 0; i * LINKEDHASHMAP_CHUNK_SIZE < large->capacity; i++)
+    {
+        if (large->chunks[i] != NULL)
+            copied++;
+    }
+
+    TEST_ASSERT(copied >= 1 && copied <= 2);
+    TEST_ASSERT_EQ(large->length, large_count + 1);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(large, large->tail)->key), large_count);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(large_snapshot, large_copy));
+    TEST_ASSERT(!linkedhashmap_contains(large_snapshot, &(large_keys[large_count]), sizeof(large_keys[large_count])));
+
+    linkedhashmap_free(large_snapshot);
+    linkedhashmap_free(large_copy);
+    linkedhashmap_free(large);
+    free(large_keys);
+}
+
+// test digests
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_digests(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* map2 = linkedhashmap_new();
+
+    for (int i = 15; i >= 0; i--)
+        TEST_ASSERT(linkedhashmap_set(map2, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+
+    linkedhashmap_enable_digests(map);
+    linkedhashmap_enable_digests(map2);
+
+    TEST_ASSERT(linkedhashmap_digest(map) == linkedhashmap_digest(map2));
+    TEST_ASSERT(linkedhashmap_order_digest(map) != linkedhashmap_order_digest(map2));
+    TEST_ASSERT(linkedhashmap_equal(map, map2));
+    TEST_ASSERT(!linkedhashmap_equal_with_insertion_order(map, map2));
+
+    LinkedHashMap* map3 = linkedhashmap_copy(map);
+    uint64_t digest = linkedhashmap_digest(map3);
+    uint64_t order_digest = linkedhashmap_order_digest(map3);
+
+    // overwrite, then restore
+    int mapvalue = 21;
+    free(linkedhashmap_set(map3, &(indices[3]), sizeof(indices[3]), &mapvalue, sizeof(mapvalue)));
+
+    TEST_ASSERT(linkedhashmap_digest(map3) != digest);
+    TEST_ASSERT(!linkedhashmap_equal(map, map3));
+
+    free(linkedhashmap_set(map3, &(indices[3]), sizeof(indices[3]), &(squares[3]), sizeof(squares[3])));
+
+    TEST_ASSERT(linkedhashmap_digest(map3) == digest);
+    TEST_ASSERT(linkedhashmap_order_digest(map3) == order_digest);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map3));
+
+    // pop from the middle, then append again
+    linkedhashmap_delete(map3, &(indices[7]), sizeof(indices[7]));
+
+    TEST_ASSERT(linkedhashmap_digest(map3) != digest);
+
+    TEST_ASSERT(linkedhashmap_set(map3, &(indices[7]), sizeof(indices[7]), &(squares[7]), sizeof(squares[7])) == NULL);
+
+    TEST_ASSERT(linkedhashmap_digest(map3) == digest);
+    TEST_ASSERT(linkedhashmap_order_digest(map3) != order_digest);
+    TEST_ASSERT(linkedhashmap_equal(map, map3));
+    TEST_ASSERT(!linkedhashmap_equal_with_insertion_order(map, map3));
+
+    // digests maintained incrementally match digests calculated from scratch
+    uint64_t incremental_digest = linkedhashmap_digest(map3);
+    uint64_t incremental_order_digest = linkedhashmap_order_digest(map3);
+    linkedhashmap_enable_digests(map3);
+
+    TEST_ASSERT(linkedhashmap_digest(map3) == incremental_digest);
+    TEST_ASSERT(linkedhashmap_order_digest(map3) == incremental_order_digest);
+
+    linkedhashmap_clear(map3);
+    LinkedHashMap* map4 = linkedhashmap_new();
+    linkedhashmap_enable_digests(map4);
+
+    TEST_ASSERT(linkedhashmap_digest(map3) == linkedhashmap_digest(map4));
+    TEST_ASSERT(linkedhashmap_order_digest(map3) == linkedhashmap_order_digest(map4));
+
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+    linkedhashmap_free(map3);
+    linkedhashmap_free(map4);
+}
+
+typedef struct _DiffLog
+{
+    int added[17];
+    int removed[17];
+    int changed[17];
+    int moved[17];
+    size_t added_count;
+    size_t removed_count;
+    size_t changed_count;
+    size_t moved_count;
+} DiffLog;
+
+void log_added(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key_size;
+    (void)value;
+    (void)value_size;
+
+    DiffLog* log = (DiffLog*)arg;
+    log->added[log->added_count++] = *(int*)key;
+}
+
+void log_removed(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key_size;
+    (void)value;
+    (void)value_size;
+
+    DiffLog* log = (DiffLog*)arg;
+    log->removed[log->removed_count++] = *(int*)key;
+}
+
+void log_changed(void* key, size_t key_size, void* old_value, size_t old_value_size, void* new_value, size_t new_value_size, void* arg)
+{
+    (void)key_size;
+    (void)old_value_size;
+    (void)new_value_size;
+
+    DiffLog* log = (DiffLog*)arg;
+    TEST_ASSERT(*(int*)old_value != *(int*)new_value);
+    log->changed[log->changed_count++] = *(int*)key;
+}
+
+void log_moved(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key_size;
+    (void)value;
+    (void)value_size;
+
+    DiffLog* log = (DiffLog*)arg;
+    log->moved[log->moved_count++] = *(int*)key;
+}
+
+// test reporting the differences between two maps
+void test_diff(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* other = linkedhashmap_copy(map);
+    DiffLog log = { 0 };
+
+    linkedhashmap_diff(map, other, log_added, log_removed, log_changed, log_moved, &log);
+    TEST_ASSERT_EQ(log.added_count + log.removed_count + log.changed_count + log.moved_count, (size_t)0);
+
+    int value = 1000;
+    linkedhashmap_delete(other, &(indices[2]), sizeof(indices[2]));
+    free(linkedhashmap_set(other, &(indices[3]), sizeof(indices[3]), &value, sizeof(value)));
+    free(linkedhashmap_set(other, &(indices[5]), sizeof(indices[5]), &(squares[5]), sizeof(squares[5])));
+    TEST_ASSERT(linkedhashmap_set(other, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    TEST_ASSERT(linkedhashmap_move_to_front(other, &(indices[7]), sizeof(indices[7])));
+    TEST_ASSERT(linkedhashmap_move_to_end(other, &(indices[1]), sizeof(indices[1])));
+    linkedhashmap_delete(map, &(indices[12]), sizeof(indices[12]));
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[12]), sizeof(indices[12]), &(squares[12]), sizeof(squares[12])) == NULL);
+
+    // only the keys out of the longest run in the same order count as moved
+    linkedhashmap_diff(map, other, log_added, log_removed, log_changed, log_moved, &log);
+    TEST_ASSERT_EQ(log.removed_count, (size_t)1);
+    TEST_ASSERT_INT_EQ(log.removed[0], 2);
+    TEST_ASSERT_EQ(log.changed_count, (size_t)1);
+    TEST_ASSERT_INT_EQ(log.changed[0], 3);
+    TEST_ASSERT_EQ(log.added_count, (size_t)1);
+    TEST_ASSERT_INT_EQ(log.added[0], 16);
+    TEST_ASSERT_EQ(log.moved_count, (size_t)3);
+    TEST_ASSERT_INT_EQ(log.moved[0], 7);
+    TEST_ASSERT_INT_EQ(log.moved[1], 12);
+    TEST_ASSERT_INT_EQ(log.moved[2], 1);
+
+    // without order changes, added keys are found by lookup instead
+    memset(&log, 0, sizeof(log));
+    linkedhashmap_diff(map, other, log_added, NULL, NULL, NULL, &log);
+    TEST_ASSERT_EQ(log.added_count, (size_t)1);
+    TEST_ASSERT_INT_EQ(log.added[0], 16);
+    TEST_ASSERT_EQ(log.removed_count + log.changed_count + log.moved_count, (size_t)0);
+
+    // the other way around
+    memset(&log, 0, sizeof(log));
+    linkedhashmap_diff(other, map, log_added, log_removed, log_changed, NULL, &log);
+    TEST_ASSERT_EQ(log.added_count, (size_t)1);
+    TEST_ASSERT_INT_EQ(log.added[0], 2);
+    TEST_ASSERT_EQ(log.removed_count, (size_t)1);
+    TEST_ASSERT_INT_EQ(log.removed[0], 16);
+
+    linkedhashmap_free(map);
+    linkedhashmap_free(other);
+}
+
+// test extend
+// { 0: 0, 1: 1, 2: 4, 3: 21, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225, 16: 37 }
+void test_extend(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* map2 = linkedhashmap_copy(map);
+    int map3value1 = 21;
+    int map3value2 = 37;
+    LinkedHashMap* map3 = linkedhashmap_new();
+    LinkedHashMapEntry* res1 = linkedhashmap_set(map3, &(indices[3]), sizeof(indices[3]), &(map3value1), sizeof(map3value1));
+    LinkedHashMapEntry* res2 = linkedhashmap_set(map3, &(indices[16]), sizeof(indices[16]), &(map3value2), sizeof(map3value2));
+    linkedhashmap_extend(map2, map3);
+    LinkedHashMapEntry* res3 = linkedhashmap_get(map2, &(indices[3]), sizeof(indices[3]));
+    LinkedHashMapEntry* res4 = linkedhashmap_get(map2, &(indices[16]), sizeof(indices[16]));
+
+    TEST_ASSERT(!linkedhashmap_equal(map, map2));
+    TEST_ASSERT(!linkedhashmap_equal(map, map3));
+    TEST_ASSERT(!linkedhashmap_equal(map2, map3));
+    TEST_ASSERT_INT_EQ(*(int*)(res3->value), map3value1);
+    TEST_ASSERT_INT_EQ(*(int*)(res4->value), map3value2);
+    TEST_ASSERT_EQ(linkedhashmap_length(map2), (size_t)17);
+
+    free(res1);
+    free(res2);
+    free(res3);
+    free(res4);
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+    linkedhashmap_free(map3);
+}
+
+void verify_keys_in_order(LinkedHashMap* map, int* keys, size_t count)
+{
+    size_t current = map->head;
+
+    TEST_ASSERT_EQ(linkedhashmap_length(map), count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, current)->key), keys[i]);
+        current = linkedhashmap_node(map, current)->next;
+    }
+}
+
+// test union, intersection and differences of maps
+void test_set_algebra(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* other = linkedhashmap_new();
+    int value = 1000;
+    TEST_ASSERT(linkedhashmap_set(other, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    TEST_ASSERT(linkedhashmap_set(other, &(indices[12]), sizeof(indices[12]), &(squares[12]), sizeof(squares[12])) == NULL);
+    TEST_ASSERT(linkedhashmap_set(other, &(indices[3]), sizeof(indices[3]), &value, sizeof(value)) == NULL);
+
+    // the left map's order and values are kept, whichever map is smaller
+    LinkedHashMap* result = linkedhashmap_intersect(map, other);
+    int intersection[] = { 3, 12 };
+    verify_keys_in_order(result, intersection, 2);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(result, result->head)->value), 9);
+    linkedhashmap_free(result);
+
+    result = linkedhashmap_intersect(other, map);
+    int reverse_intersection[] = { 12, 3 };
+    verify_keys_in_order(result, reverse_intersection, 2);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(result, result->tail)->value), 1000);
+    linkedhashmap_free(result);
+
+    result = linkedhashmap_difference(map, other);
+    int difference[] = { 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 13, 14, 15 };
+    verify_keys_in_order(result, difference, 14);
+
+    // the result is sized up front, leaving a quarter of its table free
+    TEST_ASSERT_EQ(result->capacity, (size_t)32);
+    linkedhashmap_free(result);
+
+    result = linkedhashmap_difference(other, map);
+    int reverse_difference[] = { 16 };
+    verify_keys_in_order(result, reverse_difference, 1);
+    linkedhashmap_free(result);
+
+    result = linkedhashmap_symmetric_difference(map, other);
+    int symmetric_difference[] = { 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 13, 14, 15, 16 };
+    verify_keys_in_order(result, symmetric_difference, 15);
+    linkedhashmap_free(result);
+
+    result = linkedhashmap_intersect(map, map);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(result, map));
+    linkedhashmap_free(result);
+
+    result = linkedhashmap_difference(map, map);
+    TEST_ASSERT(linkedhashmap_is_empty(result));
+    linkedhashmap_free(result);
+
+    // shared keys keep their values and places
+    linkedhashmap_union_into(other, map);
+    int union_keys[] = { 16, 12, 3, 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 13, 14, 15 };
+    verify_keys_in_order(other, union_keys, 17);
+    LinkedHashMapEntry* res = linkedhashmap_get(other, &(indices[3]), sizeof(indices[3]));
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 1000);
+    free(res);
+
+    linkedhashmap_free(map);
+    linkedhashmap_free(other);
+}
+
+// test reserve and shrink to fit
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225, 16: 256 }
+void test_reserve_shrink_to_fit(void)
+{
+    INIT_SQUARES();
+
+    // the reserved table still has a quarter of its slots free once it holds that many entries
+    TEST_ASSERT(linkedhashmap_reserve(map, 128));
+
+    TEST_ASSERT_EQ(map->length, (size_t)16);
+    TEST_ASSERT_EQ(map->capacity, (size_t)256);
+
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+
+    TEST_ASSERT(linkedhashmap_reserve(map, 17));
+
+    TEST_ASSERT_EQ(map->capacity, (size_t)256);
+
+    // requests no table could hold are rejected rather than wrapping around
+    TEST_ASSERT(!linkedhashmap_reserve(map, SIZE_MAX));
+    TEST_ASSERT(!linkedhashmap_reserve(map, SIZE_MAX / sizeof(LinkedHashMapNode)));
+    TEST_ASSERT_EQ(map->capacity, (size_t)256);
+
+    LinkedHashMap* map2 = linkedhashmap_copy(map);
+
+    TEST_ASSERT_EQ(map2->capacity, (size_t)256);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+
+    linkedhashmap_shrink_to_fit(map);
+
+    TEST_ASSERT_EQ(map->length, (size_t)17);
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+
+    // a missing key stops probing at a free slot instead of going round the whole table
+    for (int i = 17; i < 117; i++)
+    {
+        bool found;
+        size_t index = linkedhashmap_find_slot(map, &i, sizeof(i), &found);
+
+        TEST_ASSERT(!found);
+        TEST_ASSERT(index != ~(size_t)0);
+        TEST_ASSERT(!map->nodes[index].is_allocated);
+    }
+
+    LinkedHashMapKey* map_keys = linkedhashmap_keys(map);
+
+    for (int i = 0; i < 17; i++)
+    {
+        TEST_ASSERT_INT_EQ(*(int*)(map_keys[i].key), indices[i]);
+
+        LinkedHashMapEntry* res = linkedhashmap_get(map, &(indices[i]), sizeof(indices[i]));
+        TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[i]);
+        free(res);
+    }
+
+    free(map_keys);
+
+    linkedhashmap_delete(map2, &(indices[0]), sizeof(indices[0]));
+    linkedhashmap_delete(map2, &(indices[16]), sizeof(indices[16]));
+
+    TEST_ASSERT_EQ(map2->length, (size_t)15);
+    TEST_ASSERT(linkedhashmap_node(map2, map2->head)->prev == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(linkedhashmap_node(map2, map2->tail)->next == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map2, map2->head)->key), indices[1]);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map2, map2->tail)->key), indices[15]);
+
+    linkedhashmap_free(map);
+    linkedhashmap_free(map2);
+}
+
+// test save and load
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225, 16: 256 }
+void test_save_load(void)
+{
+    INIT_SQUARES();
+
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    linkedhashmap_delete(map, &(indices[4]), sizeof(indices[4]));
+
+    for (int layout = 0; layout < 2; layout++)
+    {
+        FILE* file = tmpfile();
+        TEST_ASSERT(file != NULL);
+        TEST_ASSERT(linkedhashmap_save(map, fileno(file), layout == 1));
+        rewind(file);
+
+        LinkedHashMap* map2 = linkedhashmap_load(fileno(file));
+        TEST_ASSERT(map2 != NULL);
+        TEST_ASSERT_EQ(map2->length, map->length);
+        TEST_ASSERT_EQ(map2->capacity, map->capacity);
+        TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+
+        for (int i = 0; i < 17; i++)
+        {
+            LinkedHashMapEntry* res = linkedhashmap_get(map2, &(indices[i]), sizeof(indices[i]));
+
+            if (i == 4)
+                TEST_ASSERT(res == NULL)
+            else
+            {
+                TEST_ASSERT(res->key != &(indices[i]));
+                TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[i]);
+                free(res);
+            }
+        }
+
+        // copies and snapshots keep the loaded keys and values alive after the map they came from is freed
+        LinkedHashMap* loaded_copy = linkedhashmap_copy(map2);
+        LinkedHashMap* loaded_snapshot = linkedhashmap_snapshot(map2);
+        linkedhashmap_free(map2);
+        TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, loaded_copy));
+        linkedhashmap_free(loaded_copy);
+        TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, loaded_snapshot));
+        linkedhashmap_free(loaded_snapshot);
+
+        // flipping a byte of the contents fails the checksum
+        fseek(file, -12, SEEK_END);
+        int byte = fgetc(file);
+        fseek(file, -12, SEEK_END);
+        fputc(byte ^ 0xff, file);
+        fflush(file);
+        rewind(file);
+
+        TEST_ASSERT(linkedhashmap_load(fileno(file)) == NULL);
+
+        fclose(file);
+    }
+
+    // headers claiming more than the file holds are rejected before anything is allocated from them
+    uint64_t corruptions[3][2] = { { 24, (uint64_t)1 << 40 }, { 32, (uint64_t)1 << 58 }, { 56, (uint64_t)1 << 62 } };
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        FILE* file = tmpfile();
+        TEST_ASSERT(linkedhashmap_save(map, fileno(file), true));
+
+        fseek(file, (long)corruptions[i][0], SEEK_SET);
+
+        for (size_t j = 0; j < 8; j++)
+            fputc((int)((corruptions[i][1] >> (j * 8)) & 0xff), file);
+
+        fflush(file);
+        rewind(file);
+
+        TEST_ASSERT(linkedhashmap_load(fileno(file)) == NULL);
+        fclose(file);
+    }
+
+    // an empty map round-trips too
+    LinkedHashMap* empty_map = linkedhashmap_new();
+    FILE* file = tmpfile();
+    TEST_ASSERT(linkedhashmap_save(empty_map, fileno(file), true));
+    rewind(file);
+
+    LinkedHashMap* empty_map2 = linkedhashmap_load(fileno(file));
+    TEST_ASSERT(empty_map2 != NULL);
+    TEST_ASSERT(linkedhashmap_is_empty(empty_map2));
+
+    fclose(file);
+    linkedhashmap_free(empty_map);
+    linkedhashmap_free(empty_map2);
+
+    // a layout saved by another process, which drew a different seed, is not reused, and the seed is never taken from the file
+    LinkedHashMap* seeded_map = linkedhashmap_new_with_capacity(64);
+    seeded_map->hash_seed = linkedhashmap_process_seed() ^ 0x5555555555555555ULL;
+
+    for (int i = 0; i < 17; i++)
+        TEST_ASSERT(linkedhashmap_set(seeded_map, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+
+    file = tmpfile();
+    TEST_ASSERT(linkedhashmap_save(seeded_map, fileno(file), true));
+    rewind(file);
+
+    LinkedHashMap* seeded_map2 = linkedhashmap_load(fileno(file));
+    TEST_ASSERT(seeded_map2 != NULL);
+    TEST_ASSERT_EQ(seeded_map2->hash_seed, linkedhashmap_process_seed());
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(seeded_map, seeded_map2));
+
+    fclose(file);
+
+    // the process seed is secret, so it is not written out with the layout
+    uint64_t seed = linkedhashmap_process_seed();
+    unsigned char saved[4096];
+    file = tmpfile();
+    TEST_ASSERT(linkedhashmap_save(seeded_map2, fileno(file), true));
+    rewind(file);
+    size_t saved_size = fread(saved, 1, sizeof(saved), file);
+    TEST_ASSERT(saved_size > 0 && saved_size < sizeof(saved));
+
+    for (size_t i = 0; i + sizeof(seed) <= saved_size; i++)
+        TEST_ASSERT(memcmp(saved + i, &seed, sizeof(seed)) != 0);
+
+    fclose(file);
+    linkedhashmap_free(seeded_map);
+    linkedhashmap_free(seeded_map2);
+    linkedhashmap_free(map);
+}
+
+int compare_int_values_descending(LinkedHashMapNode* a, LinkedHashMapNode* b, void* arg)
+{
+    (void)arg;
+
+    return *(int*)(b->value) - *(int*)(a->value);
+}
+
+#ifndef _WIN32
+
+typedef struct _FrozenForeachState
+{
+    size_t index;
+    int* keys;
+} FrozenForeachState;
+
+void verify_frozen_foreach_order(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)value;
+    (void)value_size;
+
+    FrozenForeachState* state = (FrozenForeachState*)arg;
+
+    TEST_ASSERT_EQ(key_size, sizeof(int));
+    TEST_ASSERT_INT_EQ(*(int*)key, state->keys[state->index]);
+
+    state->index += 1;
+}
+
+// test freezing a map and reading it back through a memory mapping
+void test_freeze(void)
+{
+    LinkedHashMap* map = linkedhashmap_new();
+    int keys[1000];
+    int values[1000];
+
+    for (int i = 0; i < 1000; i++)
+    {
+        keys[i] = (i * 7919) % 1000;
+        values[i] = keys[i] * 3;
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(values[i]), sizeof(values[i])) == NULL);
+    }
+
+    char* path = "bin/test_frozen.lhm";
+    TEST_ASSERT(linkedhashmap_freeze(map, path));
+
+    FrozenLinkedHashMap* frozen = linkedhashmap_frozen_open(path);
+    TEST_ASSERT(frozen != NULL);
+    TEST_ASSERT_EQ(linkedhashmap_frozen_length(frozen), (size_t)1000);
+    TEST_ASSERT(!linkedhashmap_frozen_is_empty(frozen));
+
+    for (int i = 0; i < 1000; i++)
+    {
+        TEST_ASSERT(linkedhashmap_frozen_contains(frozen, &(keys[i]), sizeof(keys[i])));
+        TEST_ASSERT_EQ(linkedhashmap_frozen_get_index(frozen, &(keys[i]), sizeof(keys[i])), (size_t)i);
+
+        LinkedHashMapEntry* res1 = linkedhashmap_frozen_get(frozen, &(keys[i]), sizeof(keys[i]));
+        TEST_ASSERT_INT_EQ(*(int*)(res1->value), values[i]);
+        free(res1);
+
+        LinkedHashMapEntry* res2 = linkedhashmap_frozen_get_by_index(frozen, i);
+        TEST_ASSERT_INT_EQ(*(int*)(res2->key), keys[i]);
+        TEST_ASSERT_INT_EQ(*(int*)(res2->value), values[i]);
+        free(res2);
+    }
+
+    int missing = 1000;
+    TEST_ASSERT(!linkedhashmap_frozen_contains(frozen, &missing, sizeof(missing)));
+    TEST_ASSERT(linkedhashmap_frozen_get(frozen, &missing, sizeof(missing)) == NULL);
+    TEST_ASSERT(linkedhashmap_frozen_get_by_index(frozen, 1000) == NULL);
+    TEST_ASSERT_EQ(linkedhashmap_frozen_get_index(frozen, &missing, sizeof(missing)), ~(size_t)0);
+
+    FrozenForeachState state;
+    state.index = 0;
+    state.keys = keys;
+    linkedhashmap_frozen_foreach(frozen, verify_frozen_foreach_order, &state);
+    TEST_ASSERT_EQ(state.index, (size_t)1000);
+
+    linkedhashmap_frozen_close(frozen);
+
+    // truncated or damaged files are turned away when opened
+    FILE* file = fopen(path, "rb");
+    TEST_ASSERT(file != NULL);
+    fseek(file, 0, SEEK_END);
+    size_t file_size = (size_t)ftell(file);
+    rewind(file);
+
+    unsigned char* bytes = (unsigned char*)malloc(file_size);
+    TEST_ASSERT(fread(bytes, 1, file_size, file) == file_size);
+    fclose(file);
+
+    uint64_t order_offset;
+    memcpy(&order_offset, bytes + 64, sizeof(order_offset));
+
+    for (int damage = 0; damage < 3; damage++)
+    {
+        unsigned char* damaged = (unsigned char*)malloc(file_size);
+        size_t damaged_size = damage < 2 ? file_size / 2 : file_size;
+        memcpy(damaged, bytes, file_size);
+
+        // the end of the file is claimed to be where the file was cut, so only the records give it away
+        if (damage == 1)
+        {
+            uint64_t end = damaged_size;
+            memcpy(damaged + 80, &end, sizeof(end));
+        }
+
+        // an order entry points past the last record
+        if (damage == 2)
+        {
+            uint64_t index = 1000;
+            memcpy(damaged + order_offset + 5 * sizeof(uint64_t), &index, sizeof(index));
+        }
+
+        file = fopen(path, "wb");
+        TEST_ASSERT(file != NULL);
+        TEST_ASSERT(fwrite(damaged, 1, damaged_size, file) == damaged_size);
+        fclose(file);
+
+        TEST_ASSERT(linkedhashmap_frozen_open(path) == NULL);
+        free(damaged);
+    }
+
+    free(bytes);
+
+    // an empty map can be frozen too
+    linkedhashmap_clear(map);
+    TEST_ASSERT(linkedhashmap_freeze(map, path));
+
+    frozen = linkedhashmap_frozen_open(path);
+    TEST_ASSERT(frozen != NULL);
+    TEST_ASSERT(linkedhashmap_frozen_is_empty(frozen));
+    TEST_ASSERT(!linkedhashmap_frozen_contains(frozen, &missing, sizeof(missing)));
+
+    linkedhashmap_frozen_close(frozen);
+    remove(path);
+    linkedhashmap_free(map);
+}
+
+// test loading a map from a delimited text file
+void test_load_delimited(void)
+{
+    char* path = "bin/test_delimited.tsv";
+    FILE* file = fopen(path, "w");
+    TEST_ASSERT(file != NULL);
+    fputs("banana\tyellow\r\napple\tred\n\ncherry\tdark\tred\nbanana\tgreen\nkiwi", file);
+    fclose(file);
+
+    LinkedHashMap* map = linkedhashmap_load_delimited(path, '\t', '\n');
+    TEST_ASSERT(map != NULL);
+    remove(path);
+
+    char* keys[] = { "banana", "apple", "cherry", "kiwi" };
+    char* values[] = { "green", "red", "dark\tred", "" };
+
+    TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)4);
+
+    LinkedHashMapEntry* map_entries = linkedhashmap_entries(map);
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQ(map_entries[i].key_size, strlen(keys[i]));
+        TEST_ASSERT_MEM_EQ(map_entries[i].key, keys[i], strlen(keys[i]));
+        TEST_ASSERT_EQ(map_entries[i].value_size, strlen(values[i]));
+        TEST_ASSERT_MEM_EQ(map_entries[i].value, values[i], strlen(values[i]));
+        TEST_ASSERT(linkedhashmap_contains(map, keys[i], strlen(keys[i])));
+    }
+
+    free(map_entries);
+    linkedhashmap_free(map);
+
+    TEST_ASSERT(linkedhashmap_load_delimited(path, '\t', '\n') == NULL);
+}
+
+long file_size(char* path)
+{
+    FILE* file = fopen(path, "rb");
+    TEST_ASSERT(file != NULL);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// test logging changes to a file and recovering them
+void test_wal(void)
+{
+    char* path = "bin/test_wal.lhm";
+    remove(path);
+
+    LinkedHashMap* map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_is_empty(map));
+
+    int indices[17];
+    int squares[17];
+
+    for (int i = 0; i < 17; i++)
+    {
+        indices[i] = i;
+        squares[i] = i * i;
+
+        if (i < 16)
+            TEST_ASSERT(linkedhashmap_set(map, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+    }
+
+    linkedhashmap_delete(map, &(indices[4]), sizeof(indices[4]));
+    TEST_ASSERT(linkedhashmap_move_to_front(map, &(indices[9]), sizeof(indices[9])));
+    TEST_ASSERT(linkedhashmap_insert_after(map, &(indices[2]), sizeof(indices[2]), &(indices[4]), sizeof(indices[4]), &(squares[3]), sizeof(squares[3])));
+
+    // every change was committed on its own
+    uint64_t log_size = map->wal->log_size;
+    TEST_ASSERT(log_size > 0);
+    TEST_ASSERT_EQ(map->wal->buffer_size, (size_t)0);
+
+    // changes in a group are only written once the group is committed
+    linkedhashmap_wal_set_sync(map, 3, 0);
+    int value = 1000;
+    free(linkedhashmap_set(map, &(indices[7]), sizeof(indices[7]), &value, sizeof(value)));
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    TEST_ASSERT_EQ(map->wal->log_size, log_size);
+    TEST_ASSERT(linkedhashmap_wal_sync(map));
+    TEST_ASSERT(map->wal->log_size > log_size);
+
+    // an idle group is only committed once its time limit has passed
+    linkedhashmap_wal_set_sync(map, 0, 60 * 60 * 1000);
+    TEST_ASSERT(linkedhashmap_move_to_end(map, &(indices[9]), sizeof(indices[9])));
+    log_size = map->wal->log_size;
+    TEST_ASSERT(linkedhashmap_wal_sync_due(map));
+    TEST_ASSERT_EQ(map->wal->log_size, log_size);
+    map->wal->sync_interval_ns = 1;
+    TEST_ASSERT(linkedhashmap_wal_sync_due(map));
+    TEST_ASSERT(map->wal->log_size > log_size);
+
+    // or when the map is freed
+    linkedhashmap_wal_set_sync(map, 0, 60 * 60 * 1000);
+    TEST_ASSERT(linkedhashmap_move_to_front(map, &(indices[9]), sizeof(indices[9])));
+    TEST_ASSERT_EQ(map->wal->pending_records, (size_t)1);
+
+    LinkedHashMap* expected = linkedhashmap_copy(map);
+    linkedhashmap_free(map);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    // the recovered keys and values are the map's own
+    LinkedHashMapEntry* res = linkedhashmap_get(map, &(indices[7]), sizeof(indices[7]));
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 1000);
+    TEST_ASSERT(res->value != &value);
+    free(res);
+    linkedhashmap_free(map);
+
+    // a record torn by a crash is cut off
+    long size = file_size(path);
+    FILE* file = fopen(path, "ab");
+    TEST_ASSERT(file != NULL);
+    fputs("\x20\x01\x05", file);
+    fclose(file);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+    TEST_ASSERT_EQ(file_size(path), size);
+
+    // compacting replaces the records with a snapshot
+    TEST_ASSERT(linkedhashmap_wal_compact(map));
+    TEST_ASSERT(file_size(path) < size);
+    TEST_ASSERT_EQ(map->wal->log_size, (uint64_t)0);
+
+    linkedhashmap_delete(map, &(indices[0]), sizeof(indices[0]));
+    linkedhashmap_delete(expected, &(indices[0]), sizeof(indices[0]));
+    linkedhashmap_free(map);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    // once the records grow large enough, the next change compacts them
+    linkedhashmap_wal_set_compact_size(map, 1);
+    linkedhashmap_delete(map, &(indices[1]), sizeof(indices[1]));
+    TEST_ASSERT(map->wal->compact_due);
+    log_size = map->wal->log_size;
+    linkedhashmap_delete(map, &(indices[2]), sizeof(indices[2]));
+    TEST_ASSERT(map->wal->log_size > 0);
+    TEST_ASSERT(map->wal->log_size < log_size);
+    linkedhashmap_clear(map);
+    linkedhashmap_free(map);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_is_empty(map));
+
+    // pops from either end of the order, and entries inserted in place, are recovered too
+    linkedhashmap_clear(expected);
+
+    for (int i = 0; i < 12; i++)
+    {
+        TEST_ASSERT(linkedhashmap_set(map, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+        TEST_ASSERT(linkedhashmap_set(expected, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+    }
+
+    LinkedHashMapEntry entry;
+    TEST_ASSERT(linkedhashmap_pop_front(map, &entry));
+    TEST_ASSERT_INT_EQ(*(int*)(entry.key), 0);
+    TEST_ASSERT(linkedhashmap_pop_front(expected, NULL));
+    TEST_ASSERT(linkedhashmap_pop_back(map, NULL));
+    TEST_ASSERT(linkedhashmap_pop_back(expected, NULL));
+    TEST_ASSERT_EQ(linkedhashmap_drain_front(map, NULL, 2), (size_t)2);
+    TEST_ASSERT_EQ(linkedhashmap_drain_front(expected, NULL, 2), (size_t)2);
+
+    // entry refuses a logged map, which would only see the value passed in and not what is written through the pointer
+    bool inserted = true;
+    TEST_ASSERT(linkedhashmap_entry(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16]), &inserted) == NULL);
+    TEST_ASSERT(!inserted);
+    TEST_ASSERT(!linkedhashmap_contains(map, &(indices[16]), sizeof(indices[16])));
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    TEST_ASSERT(linkedhashmap_set(expected, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    linkedhashmap_free(map);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    // and pop_front compacts the log once it is due, like any other pop
+    linkedhashmap_wal_set_compact_size(map, 1);
+    TEST_ASSERT(linkedhashmap_pop_front(map, NULL));
+    TEST_ASSERT(linkedhashmap_pop_front(expected, NULL));
+    TEST_ASSERT(map->wal->compact_due);
+    log_size = map->wal->log_size;
+    TEST_ASSERT(linkedhashmap_pop_front(map, NULL));
+    TEST_ASSERT(linkedhashmap_pop_front(expected, NULL));
+    TEST_ASSERT(map->wal->log_size < log_size);
+    linkedhashmap_free(map);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    // a sort is committed as a single record holding the new order
+    uint64_t sequence = map->wal->next_sequence;
+    linkedhashmap_sort(map, compare_int_values_descending, NULL);
+    linkedhashmap_sort(expected, compare_int_values_descending, NULL);
+    TEST_ASSERT_EQ(map->wal->next_sequence, sequence + 1);
+    TEST_ASSERT_EQ(map->wal->pending_records, (size_t)0);
+    linkedhashmap_free(map);
+
+    map = linkedhashmap_wal_open(path);
+    TEST_ASSERT(map != NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+    linkedhashmap_free(map);
+
+    remove(path);
+    linkedhashmap_free(expected);
+
+    TEST_ASSERT(linkedhashmap_wal_open("bin/missing/test_wal.lhm") == NULL);
+}
+
+#endif
+
+#ifdef LINKEDHASHMAP_STATS
+
+// test runtime statistics
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_stats(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMapStats stats;
+    linkedhashmap_stats(map, &stats);
+
+    TEST_ASSERT(stats.load_factor > 0.49 && stats.load_factor < 0.51);
+    TEST_ASSERT_EQ(stats.node_table_bytes, 32 * sizeof(LinkedHashMapNode));
+
+    // the map moved out of its inline table, then doubled once it was seven eighths full
+    TEST_ASSERT_EQ(stats.resize_up_count, (uint64_t)2);
+
+    linkedhashmap_stats_reset(map);
+
+    for (int i = 0; i < 16; i++)
+        free(linkedhashmap_get(map, &(indices[i]), sizeof(indices[i])));
+
+    TEST_ASSERT(!linkedhashmap_contains(map, &(indices[16]), sizeof(indices[16])));
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+
+    // deleting down to a quarter full halves the table
+    for (int i = 16; i >= 8; i--)
+        linkedhashmap_delete(map, &(indices[i]), sizeof(indices[i]));
+
+    linkedhashmap_stats(map, &stats);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    for (size_t i = 0; i < LINKEDHASHMAP_STATS_PROBE_BUCKETS; i++)
+    {
+        hits += stats.hit_probe_lengths[i];
+        misses += stats.miss_probe_lengths[i];
+    }
+
+    // 16 gets and 9 pops hit, and the contains and set both miss
+    TEST_ASSERT_EQ(hits, (uint64_t)25);
+    TEST_ASSERT_EQ(misses, (uint64_t)2);
+    TEST_ASSERT_EQ(stats.resize_up_count, (uint64_t)0);
+    TEST_ASSERT_EQ(stats.resize_down_count, (uint64_t)1);
+    TEST_ASSERT_EQ(stats.entries_allocated, (uint64_t)25);
+
+    linkedhashmap_stats_reset(map);
+    linkedhashmap_stats_set_sample_rate(map, 4);
+
+    for (int i = 0; i < 8; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(indices[i]), sizeof(indices[i])));
+
+    linkedhashmap_stats(map, &stats);
+    hits = 0;
+
+    for (size_t i = 0; i < LINKEDHASHMAP_STATS_PROBE_BUCKETS; i++)
+        hits += stats.hit_probe_lengths[i];
+
+    TEST_ASSERT_EQ(hits, (uint64_t)2);
+
+    linkedhashmap_free(map);
+}
+
+#endif
+
+#ifdef LINKEDHASHMAP_LATENCY
+
+void test_latency_callback(LinkedHashMap* map, int operation, uint64_t nanoseconds, void* arg)
+{
+    (void)map;
+    (void)nanoseconds;
+
+    if (operation == LINKEDHASHMAP_OP_GET)
+        (*(int*)arg)++;
+}
+
+// test latency histograms
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_latency(void)
+{
+    for (uint64_t i = 0; i < 100000; i += 7)
+    {
+        size_t bucket = linkedhashmap_latency_bucket(i);
+        TEST_ASSERT(bucket < LINKEDHASHMAP_LATENCY_BUCKETS);
+        TEST_ASSERT(linkedhashmap_latency_bucket_value(bucket) >= i);
+        TEST_ASSERT(bucket == 0 || linkedhashmap_latency_bucket_value(bucket - 1) < i);
+    }
+
+    TEST_ASSERT(linkedhashmap_latency_bucket(~(uint64_t)0) < LINKEDHASHMAP_LATENCY_BUCKETS);
+
+    INIT_SQUARES();
+
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_SET), (uint64_t)0);
+    TEST_ASSERT_EQ(linkedhashmap_latency_percentile(map, LINKEDHASHMAP_OP_GET, 50.0), (uint64_t)0);
+
+    linkedhashmap_latency_enable(map);
+
+    for (int i = 0; i < 16; i++)
+        free(linkedhashmap_get(map, &(indices[i]), sizeof(indices[i])));
+
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+
+    // popping down to a quarter full halves the table
+    for (int i = 16; i >= 8; i--)
+        free(linkedhashmap_pop(map, &(indices[i]), sizeof(indices[i])));
+
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_GET), (uint64_t)16);
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_SET), (uint64_t)1);
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_POP), (uint64_t)9);
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_RESIZE), (uint64_t)1);
+
+    uint64_t p50 = linkedhashmap_latency_percentile(map, LINKEDHASHMAP_OP_GET, 50.0);
+    uint64_t p99 = linkedhashmap_latency_percentile(map, LINKEDHASHMAP_OP_GET, 99.0);
+    TEST_ASSERT(p50 <= p99);
+    TEST_ASSERT(p99 <= linkedhashmap_latency_max(map, LINKEDHASHMAP_OP_GET));
+
+    int slow_gets = 0;
+    linkedhashmap_latency_reset(map);
+    linkedhashmap_latency_set_callback(map, test_latency_callback, &slow_gets);
+    linkedhashmap_latency_set_threshold(map, LINKEDHASHMAP_OP_GET, 1);
+
+    for (int i = 0; i < 16; i++)
+        free(linkedhashmap_get(map, &(indices[i]), sizeof(indices[i])));
+
+    // every lookup takes at least a nanosecond, so all of them exceed the threshold
+    TEST_ASSERT_EQ((size_t)slow_gets, (size_t)16);
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_GET), (uint64_t)16);
+
+    linkedhashmap_latency_disable(map);
+    free(linkedhashmap_get(map, &(indices[0]), sizeof(indices[0])));
+    TEST_ASSERT_EQ((size_t)slow_gets, (size_t)16);
+    TEST_ASSERT_EQ(linkedhashmap_latency_count(map, LINKEDHASHMAP_OP_GET), (uint64_t)0);
+
+    linkedhashmap_free(map);
+}
+
+#endif
+
+// test huge page allocation of the node table
+void test_huge_pages(void)
+{
+    size_t count = 1000;
+    size_t capacity = LINKEDHASHMAP_HUGE_PAGE_SIZE / sizeof(LinkedHashMapNode) * 2;
+    size_t* keys = (size_t*)malloc(count * sizeof(size_t));
+    LinkedHashMap* map = linkedhashmap_new();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = i * 7;
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+    }
+
+    LinkedHashMap* expected = linkedhashmap_copy(map);
+
+    // small tables keep using the heap
+    linkedhashmap_set_huge_pages(map, true, LINKEDHASHMAP_NUMA_DEFAULT);
+    TEST_ASSERT(!map->nodes_mapped);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    linkedhashmap_reserve(map, capacity);
+
+#ifdef __linux__
+    TEST_ASSERT(map->nodes_mapped);
+    TEST_ASSERT_EQ((size_t)((uintptr_t)map->nodes % LINKEDHASHMAP_HUGE_PAGE_SIZE), (size_t)0);
+#endif
+
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    // binding to a node falls back to the default placement where there is no NUMA support
+    linkedhashmap_set_huge_pages(map, true, 0);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+    linkedhashmap_set_huge_pages(map, true, LINKEDHASHMAP_NUMA_INTERLEAVE);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    // copies and snapshots allocate the same way as the map they come from
+    LinkedHashMap* copy = linkedhashmap_copy(map);
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(map);
+    TEST_ASSERT(copy->nodes_mapped == map->nodes_mapped);
+    linkedhashmap_delete(map, &(keys[0]), sizeof(keys[0]));
+    TEST_ASSERT(map->nodes_mapped == snapshot->nodes_mapped);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(snapshot, expected));
+    linkedhashmap_free(snapshot);
+    linkedhashmap_free(copy);
+
+    for (size_t i = 1; i < count; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(keys[i]), sizeof(keys[i])));
+
+    linkedhashmap_shrink_to_fit(map);
+    TEST_ASSERT(!map->nodes_mapped);
+
+    linkedhashmap_set_huge_pages(map, false, LINKEDHASHMAP_NUMA_DEFAULT);
+    linkedhashmap_reserve(map, capacity);
+    TEST_ASSERT(!map->nodes_mapped);
+    TEST_ASSERT_EQ(map->length, count - 1);
+
+    linkedhashmap_free(expected);
+    linkedhashmap_free(map);
+    free(keys);
+}
+
+// test multi-threaded resizing
+void test_resize_parallel(void)
+{
+    size_t count = LINKEDHASHMAP_PARALLEL_RESIZE_MIN_LENGTH + 1000;
+    size_t* keys = (size_t*)malloc(count * sizeof(size_t));
+    LinkedHashMap* map = linkedhashmap_new_with_capacity(count * 2);
+    linkedhashmap_enable_digests(map);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = i * 31;
+        LinkedHashMapNode* node = linkedhashmap_insert_new(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i]));
+        TEST_ASSERT(node != NULL);
+        linkedhashmap_digest_link(map, node);
+    }
+
+    LinkedHashMap* expected = linkedhashmap_copy(map);
+    uint64_t digest = linkedhashmap_digest(map);
+    uint64_t order_digest = linkedhashmap_order_digest(map);
+
+    linkedhashmap_set_resize_threads(map, 4);
+    TEST_ASSERT(linkedhashmap_reserve(map, count * 4));
+    TEST_ASSERT_EQ(map->capacity, (size_t)524288);
+    TEST_ASSERT_EQ(map->length, count);
+
+    // shrink back down with as many threads as there are processors
+    linkedhashmap_set_resize_threads(map, 0);
+    linkedhashmap_shrink_to_fit(map);
+    TEST_ASSERT_EQ(map->capacity, (size_t)131072);
+
+    TEST_ASSERT(linkedhashmap_node(map, map->head)->prev == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(linkedhashmap_node(map, map->tail)->next == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+    TEST_ASSERT_EQ(linkedhashmap_digest(map), digest);
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), order_digest);
+
+    for (size_t i = 0; i < count; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(keys[i]), sizeof(keys[i])));
+
+    linkedhashmap_free(expected);
+    linkedhashmap_free(map);
+    free(keys);
+}
+
+// test reordering entries in place
+// { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
+void test_reorder(void)
+{
+    INIT_SQUARES();
+
+    linkedhashmap_enable_digests(map);
+
+    TEST_ASSERT(linkedhashmap_move_to_end(map, &(indices[0]), sizeof(indices[0])));
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->head)->key), 1);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->tail)->key), 0);
+    TEST_ASSERT(linkedhashmap_node(map, map->tail)->next == LINKEDHASHMAP_NO_NODE);
+
+    TEST_ASSERT(linkedhashmap_move_to_front(map, &(indices[0]), sizeof(indices[0])));
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->head)->key), 0);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->tail)->key), 15);
+    TEST_ASSERT(linkedhashmap_node(map, map->head)->prev == LINKEDHASHMAP_NO_NODE);
+
+    TEST_ASSERT(!linkedhashmap_move_to_end(map, &(indices[16]), sizeof(indices[16])));
+    TEST_ASSERT(!linkedhashmap_move_to_front(map, &(indices[16]), sizeof(indices[16])));
+
+    TEST_ASSERT(linkedhashmap_insert_after(map, &(indices[5]), sizeof(indices[5]), &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])));
+    TEST_ASSERT_EQ(map->length, (size_t)17);
+    TEST_ASSERT_EQ(linkedhashmap_get_index(map, &(indices[16]), sizeof(indices[16])), (size_t)6);
+
+    // a table at its maximum load has to resize before inserting a new key next to the anchor
+    LinkedHashMap* full = linkedhashmap_new_with_capacity(LINKEDHASHMAP_MIN_SIZE);
+
+    for (int i = 0; i < LINKEDHASHMAP_MIN_SIZE - (LINKEDHASHMAP_MIN_SIZE >> 3); i++)
+        TEST_ASSERT(linkedhashmap_set(full, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+
+    TEST_ASSERT_EQ(full->capacity, (size_t)LINKEDHASHMAP_MIN_SIZE);
+    TEST_ASSERT(linkedhashmap_insert_after(full, &(indices[5]), sizeof(indices[5]), &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])));
+    TEST_ASSERT_EQ(full->capacity, (size_t)LINKEDHASHMAP_MIN_SIZE * 2);
+    TEST_ASSERT_EQ(linkedhashmap_get_index(full, &(indices[16]), sizeof(indices[16])), (size_t)6);
+    linkedhashmap_free(full);
+
+    // existing keys are moved rather than duplicated
+    TEST_ASSERT(linkedhashmap_insert_before(map, &(indices[0]), sizeof(indices[0]), &(indices[3]), sizeof(indices[3]), &(squares[4]), sizeof(squares[4])));
+    TEST_ASSERT_EQ(map->length, (size_t)17);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->head)->key), 3);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->head)->value), 16);
+
+    TEST_ASSERT(linkedhashmap_insert_after(map, &(indices[15]), sizeof(indices[15]), &(indices[15]), sizeof(indices[15]), &(squares[15]), sizeof(squares[15])));
+    TEST_ASSERT(!linkedhashmap_insert_before(map, &(squares[15]), sizeof(squares[15]), &(indices[1]), sizeof(indices[1]), &(squares[1]), sizeof(squares[1])));
+
+    int expected_order[] = { 3, 0, 1, 2, 4, 5, 16, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+    LinkedHashMapKey* map_keys = linkedhashmap_keys(map);
+
+    for (int i = 0; i < 17; i++)
+        TEST_ASSERT_INT_EQ(*(int*)(map_keys[i].key), expected_order[i]);
+
+    free(map_keys);
+
+    // the incrementally maintained digests match ones computed from scratch
+    uint64_t digest = linkedhashmap_digest(map);
+    uint64_t order_digest = linkedhashmap_order_digest(map);
+    linkedhashmap_enable_digests(map);
+    TEST_ASSERT_EQ(linkedhashmap_digest(map), digest);
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), order_digest);
+
+    linkedhashmap_free(map);
+}
+
+bool keep_multiples(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key_size;
+    (void)value;
+    (void)value_size;
+
+    return *(size_t*)key % *(size_t*)arg == 0;
+}
+
+// test bulk removal
+void test_retain(void)
+{
+    size_t count = 1000;
+    size_t divisor = 10;
+    size_t* keys = (size_t*)malloc(count * sizeof(size_t));
+    LinkedHashMap* map = linkedhashmap_new();
+    LinkedHashMap* expected = linkedhashmap_new();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = i;
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+
+        if (i % divisor == 0)
+            TEST_ASSERT(linkedhashmap_set(expected, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+    }
+
+    linkedhashmap_enable_digests(map);
+    linkedhashmap_enable_digests(expected);
+    TEST_ASSERT_EQ(map->capacity, (size_t)2048);
+
+    // a snapshot keeps the entries that are removed from the map
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(map);
+
+    TEST_ASSERT_EQ(linkedhashmap_retain(map, keep_multiples, &divisor), count - count / divisor);
+    TEST_ASSERT_EQ(map->length, count / divisor);
+    TEST_ASSERT_EQ(map->capacity, (size_t)256);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+    TEST_ASSERT_EQ(linkedhashmap_digest(map), linkedhashmap_digest(expected));
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), linkedhashmap_order_digest(expected));
+    TEST_ASSERT_EQ(snapshot->length, count);
+    TEST_ASSERT(linkedhashmap_contains(snapshot, &(keys[1]), sizeof(keys[1])));
+    linkedhashmap_free(snapshot);
+
+    // removing nothing leaves the table alone
+    LinkedHashMapNode* nodes = map->nodes;
+    TEST_ASSERT_EQ(linkedhashmap_retain(map, keep_multiples, &divisor), (size_t)0);
+    TEST_ASSERT(map->nodes == nodes);
+
+    // remove { 20, 30, 40 }, then everything past the tenth entry
+    TEST_ASSERT_EQ(linkedhashmap_remove_range(map, 2, 3), (size_t)3);
+    TEST_ASSERT_EQ(map->length, count / divisor - 3);
+
+    for (size_t i = 0; i < 3; i++)
+        linkedhashmap_delete(expected, &(keys[(i + 2) * divisor]), sizeof(keys[0]));
+
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), linkedhashmap_order_digest(expected));
 
-    TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)17);
-    TEST_ASSERT_EQ(map->length, (size_t)17);
+    TEST_ASSERT_EQ(linkedhashmap_remove_range(map, 10, count), count / divisor - 13);
+    TEST_ASSERT_EQ(map->length, (size_t)10);
     TEST_ASSERT_EQ(map->capacity, (size_t)32);
+    TEST_ASSERT_INT_EQ((int)*(size_t*)(linkedhashmap_node(map, map->tail)->key), 120);
+    TEST_ASSERT(linkedhashmap_node(map, map->tail)->next == LINKEDHASHMAP_NO_NODE);
 
-    for (int i = 0; i < 17; i++)
+    for (size_t i = 0; i < count; i++)
     {
-        LinkedHashMapEntry* res = linkedhashmap_get(map, &(indices[i]), sizeof(indices[i]));
-        TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[i]);
-        free(res);
+        bool kept = i % divisor == 0 && (i < 20 || i > 40) && i <= 120;
+        TEST_ASSERT(linkedhashmap_contains(map, &(keys[i]), sizeof(keys[i])) == kept);
     }
 
+    TEST_ASSERT_EQ(linkedhashmap_remove_range(map, 10, 5), (size_t)0);
+    TEST_ASSERT_EQ(linkedhashmap_remove_range(map, 0, 10), (size_t)10);
+    TEST_ASSERT(linkedhashmap_is_empty(map));
+    TEST_ASSERT(map->head == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(map->tail == LINKEDHASHMAP_NO_NODE);
+
+    linkedhashmap_free(expected);
     linkedhashmap_free(map);
+    free(keys);
 }
 
-// test pop and resize_down
+// test queue-style access at both ends
 // { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
-void test_pop_resize_down(void)
+void test_queue(void)
 {
     INIT_SQUARES();
 
-    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
-
-    LinkedHashMapEntry* res1 = linkedhashmap_pop(map, &(indices[16]), sizeof(indices[16]));
+    LinkedHashMapEntry entry;
+    linkedhashmap_enable_digests(map);
 
-    TEST_ASSERT_INT_EQ(*(int*)(res1->value), squares[16]);
-    TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)16);
+    TEST_ASSERT(linkedhashmap_peek_front(map, &entry));
+    TEST_ASSERT_INT_EQ(*(int*)(entry.key), 0);
+    TEST_ASSERT(linkedhashmap_peek_back(map, &entry));
+    TEST_ASSERT_INT_EQ(*(int*)(entry.key), 15);
+    TEST_ASSERT_INT_EQ(*(int*)(entry.value), 225);
     TEST_ASSERT_EQ(map->length, (size_t)16);
-    TEST_ASSERT_EQ(map->capacity, (size_t)16);
 
-    free(res1);
+    TEST_ASSERT(linkedhashmap_pop_front(map, &entry));
+    TEST_ASSERT_INT_EQ(*(int*)(entry.key), 0);
+    TEST_ASSERT(linkedhashmap_pop_back(map, &entry));
+    TEST_ASSERT_INT_EQ(*(int*)(entry.key), 15);
+    TEST_ASSERT(linkedhashmap_pop_back(map, NULL));
+    TEST_ASSERT_EQ(map->length, (size_t)13);
+    TEST_ASSERT(!linkedhashmap_contains(map, &(indices[0]), sizeof(indices[0])));
+    TEST_ASSERT(!linkedhashmap_contains(map, &(indices[14]), sizeof(indices[14])));
 
-    for (int i = 0; i < 16; i++)
+    LinkedHashMapEntry entries[4];
+    TEST_ASSERT_EQ(linkedhashmap_drain_front(map, entries, 4), (size_t)4);
+
+    for (int i = 0; i < 4; i++)
+        TEST_ASSERT_INT_EQ(*(int*)(entries[i].key), i + 1);
+
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->head)->key), 5);
+    TEST_ASSERT(linkedhashmap_node(map, map->head)->prev == LINKEDHASHMAP_NO_NODE);
+
+    uint64_t order_digest = linkedhashmap_order_digest(map);
+    linkedhashmap_enable_digests(map);
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), order_digest);
+
+    // the table keeps its capacity, so the freed slots can be reused without resizing
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[0]), sizeof(indices[0]), &(squares[0]), sizeof(squares[0])) == NULL);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->tail)->key), 0);
+
+    TEST_ASSERT_EQ(linkedhashmap_drain_front(map, NULL, 100), (size_t)10);
+    TEST_ASSERT(linkedhashmap_is_empty(map));
+    TEST_ASSERT(map->head == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(map->tail == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(!linkedhashmap_pop_front(map, &entry));
+    TEST_ASSERT(!linkedhashmap_pop_back(map, &entry));
+    TEST_ASSERT(!linkedhashmap_peek_front(map, &entry));
+    TEST_ASSERT(!linkedhashmap_peek_back(map, &entry));
+
+    linkedhashmap_free(map);
+}
+
+void increment_count(void* key, size_t key_size, void** value, size_t* value_size, bool inserted, void* arg)
+{
+    (void)key;
+    (void)key_size;
+
+    if (inserted)
     {
-        LinkedHashMapEntry* res2 = linkedhashmap_get(map, &(indices[i]), sizeof(indices[i]));
-        TEST_ASSERT_INT_EQ(*(int*)(res2->value), squares[i]);
-        free(res2);
+        *value = arg;
+        *value_size = sizeof(int);
     }
 
-    linkedhashmap_free(map);
+    (*(int*)*value)++;
 }
 
-// test copy, equal, and equal with insertion order
+// test single-probe entry and upsert
 // { 0: 0, 1: 1, 2: 4, 3: 9, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225 }
-void test_copy_equal(void)
+void test_entry_upsert(void)
 {
     INIT_SQUARES();
 
-    LinkedHashMap* map2 = linkedhashmap_copy(map);
+    bool inserted;
+    void** value = linkedhashmap_entry(map, &(indices[3]), sizeof(indices[3]), &(squares[16]), sizeof(squares[16]), &inserted);
+    TEST_ASSERT(!inserted);
+    TEST_ASSERT_INT_EQ(*(int*)*value, 9);
 
-    for (int i = 0; i < 16; i++)
-    {
-        LinkedHashMapEntry* res = linkedhashmap_get(map2, &(indices[i]), sizeof(indices[i]));
-        TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[i]);
-        free(res);
-    }
+    *value = &(squares[4]);
+    LinkedHashMapEntry* res = linkedhashmap_get(map, &(indices[3]), sizeof(indices[3]));
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 16);
+    free(res);
 
-    TEST_ASSERT(linkedhashmap_equal(map, map2));
-    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+    // the map is full, so this has to resize before inserting
+    value = linkedhashmap_entry(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16]), &inserted);
+    TEST_ASSERT(inserted);
+    TEST_ASSERT_INT_EQ(*(int*)*value, 256);
+    TEST_ASSERT_EQ(map->length, (size_t)17);
+    TEST_ASSERT_INT_EQ(*(int*)(linkedhashmap_node(map, map->tail)->key), 16);
 
-    LinkedHashMapEntry* res = linkedhashmap_set(map2, &(indices[3]), sizeof(indices[3]), &(squares[3]), sizeof(squares[3]));
-    free(res);
+    linkedhashmap_free(map);
 
-    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, map2));
+    map = linkedhashmap_new();
+    linkedhashmap_enable_digests(map);
 
-    LinkedHashMap* map3 = linkedhashmap_new();
+    // the digest could not follow writes through the pointer, so entry leaves the map alone and upsert is used instead
+    int word = 7;
+    TEST_ASSERT(linkedhashmap_entry(map, &word, sizeof(word), &word, sizeof(word), &inserted) == NULL);
+    TEST_ASSERT(!inserted);
+    TEST_ASSERT(linkedhashmap_is_empty(map));
 
-    for (int i = 1; i < 16; i++)
-        TEST_ASSERT(linkedhashmap_set(map3, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+    int counts[3] = { 0, 0, 0 };
+    int words[] = { 7, 8, 7, 9, 7, 8 };
 
-    TEST_ASSERT(linkedhashmap_set(map3, &(indices[0]), sizeof(indices[0]), &(squares[0]), sizeof(squares[0])) == NULL);
+    for (int i = 0; i < 6; i++)
+        linkedhashmap_upsert(map, &(words[i]), sizeof(words[i]), increment_count, &(counts[map->length]));
 
-    TEST_ASSERT(linkedhashmap_equal(map, map3));
-    TEST_ASSERT(!linkedhashmap_equal_with_insertion_order(map, map3));
+    TEST_ASSERT_EQ(map->length, (size_t)3);
+    TEST_ASSERT_INT_EQ(counts[0], 3);
+    TEST_ASSERT_INT_EQ(counts[1], 2);
+    TEST_ASSERT_INT_EQ(counts[2], 1);
+
+    uint64_t digest = linkedhashmap_digest(map);
+    TEST_ASSERT(!linkedhashmap_upsert(map, &(words[0]), sizeof(words[0]), increment_count, NULL));
+    TEST_ASSERT(linkedhashmap_digest(map) != digest);
+
+    digest = linkedhashmap_digest(map);
+    linkedhashmap_enable_digests(map);
+    TEST_ASSERT_EQ(linkedhashmap_digest(map), digest);
 
     linkedhashmap_free(map);
-    linkedhashmap_free(map2);
-    linkedhashmap_free(map3);
 }
 
-// test extend
-// { 0: 0, 1: 1, 2: 4, 3: 21, 4: 16, 5: 25, 6: 36, 7: 49, 8: 64, 9: 81, 10: 100, 11: 121, 12: 144, 13: 169, 14: 196, 15: 225, 16: 37 }
-void test_extend(void)
+// test that deleting from the middle of a cluster keeps every other key reachable
+void test_delete_shift(void)
 {
-    INIT_SQUARES();
+    LinkedHashMap* map = linkedhashmap_new_with_capacity(64);
+    int keys[56];
 
-    LinkedHashMap* map2 = linkedhashmap_copy(map);
-    int map3value1 = 21;
-    int map3value2 = 37;
-    LinkedHashMap* map3 = linkedhashmap_new();
-    LinkedHashMapEntry* res1 = linkedhashmap_set(map3, &(indices[3]), sizeof(indices[3]), &(map3value1), sizeof(map3value1));
-    LinkedHashMapEntry* res2 = linkedhashmap_set(map3, &(indices[16]), sizeof(indices[16]), &(map3value2), sizeof(map3value2));
-    linkedhashmap_extend(map2, map3);
-    LinkedHashMapEntry* res3 = linkedhashmap_get(map2, &(indices[3]), sizeof(indices[3]));
-    LinkedHashMapEntry* res4 = linkedhashmap_get(map2, &(indices[16]), sizeof(indices[16]));
+    for (int i = 0; i < 56; i++)
+    {
+        keys[i] = i;
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+    }
 
-    TEST_ASSERT(!linkedhashmap_equal(map, map2));
-    TEST_ASSERT(!linkedhashmap_equal(map, map3));
-    TEST_ASSERT(!linkedhashmap_equal(map2, map3));
-    TEST_ASSERT_INT_EQ(*(int*)(res3->value), map3value1);
-    TEST_ASSERT_INT_EQ(*(int*)(res4->value), map3value2);
-    TEST_ASSERT_EQ(linkedhashmap_length(map2), (size_t)17);
+    linkedhashmap_enable_digests(map);
+    TEST_ASSERT_EQ(map->capacity, (size_t)64);
+
+    // the table is nearly full, so removals land in the middle of long clusters
+    for (int i = 0; i < 36; i += 3)
+    {
+        linkedhashmap_delete(map, &(keys[i]), sizeof(keys[i]));
+        TEST_ASSERT(linkedhashmap_pop_back(map, NULL));
+    }
+
+    TEST_ASSERT_EQ(map->length, (size_t)32);
+    TEST_ASSERT_EQ(map->capacity, (size_t)64);
+
+    size_t remaining = 0;
+
+    for (int i = 0; i < 56; i++)
+    {
+        LinkedHashMapEntry* res = linkedhashmap_get(map, &(keys[i]), sizeof(keys[i]));
+
+        if (res != NULL)
+        {
+            TEST_ASSERT_INT_EQ(*(int*)(res->value), i);
+            remaining++;
+            free(res);
+        }
+    }
+
+    TEST_ASSERT_EQ(remaining, map->length);
+
+    size_t current = map->head;
+    size_t walked = 0;
+
+    while (current != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* node = linkedhashmap_node(map, current);
+        TEST_ASSERT(node->is_allocated);
+        TEST_ASSERT_EQ(linkedhashmap_find_key(map, node->key, node->key_size), current);
+        TEST_ASSERT(node->next == LINKEDHASHMAP_NO_NODE || linkedhashmap_node(map, node->next)->prev == current);
+        current = node->next;
+        walked++;
+    }
+
+    TEST_ASSERT_EQ(walked, map->length);
+
+    uint64_t order_digest = linkedhashmap_order_digest(map);
+    linkedhashmap_enable_digests(map);
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), order_digest);
 
-    free(res1);
-    free(res2);
-    free(res3);
-    free(res4);
     linkedhashmap_free(map);
-    linkedhashmap_free(map2);
-    linkedhashmap_free(map3);
 }
 
 // test keys, values, and entries
@@ -508,7 +2234,7 @@ void test_delete(void)
 
     TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)16);
     TEST_ASSERT_EQ(map->length, (size_t)16);
-    TEST_ASSERT_EQ(map->capacity, (size_t)16);
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
 
     for (int i = 0; i < 16; i++)
     {
@@ -540,15 +2266,33 @@ void test_clear(void)
 {
     INIT_SQUARES();
 
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(map);
+
     linkedhashmap_clear(map);
 
     TEST_ASSERT_EQ(linkedhashmap_length(map), (size_t)0);
     TEST_ASSERT(linkedhashmap_is_empty(map));
     TEST_ASSERT_EQ(map->length, (size_t)0);
-    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_MIN_SIZE);
-    TEST_ASSERT(map->head == NULL);
-    TEST_ASSERT(map->tail == NULL);
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+    TEST_ASSERT(map->head == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(map->tail == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT_EQ(snapshot->length, (size_t)16);
+
+    // the capacity is kept, so refilling the map doesn't resize it
+    for (int i = 0; i < 16; i++)
+        TEST_ASSERT(linkedhashmap_set(map, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+
+    TEST_ASSERT_EQ(map->capacity, (size_t)32);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, snapshot));
+    LinkedHashMapNode* nodes = map->nodes;
+
+    linkedhashmap_clear(map);
+    TEST_ASSERT(map->nodes == nodes);
+
+    for (size_t i = 0; i < map->capacity; i++)
+        TEST_ASSERT(!map->nodes[i].is_allocated);
 
+    linkedhashmap_free(snapshot);
     linkedhashmap_free(map);
 }
 
@@ -577,6 +2321,436 @@ void test_foreach(void)
     linkedhashmap_free(map);
 }
 
+typedef struct _ParallelRange
+{
+    size_t first;
+    size_t last;
+    size_t count;
+    bool ordered;
+} ParallelRange;
+
+void count_parallel(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key;
+    (void)key_size;
+    (void)value_size;
+
+    atomic_fetch_add((atomic_size_t*)arg, *(size_t*)value);
+}
+
+void* map_parallel_range(void* key, size_t key_size, void* value, size_t value_size, void* arg)
+{
+    (void)key_size;
+    (void)value;
+    (void)value_size;
+    (void)arg;
+
+    ParallelRange* range = (ParallelRange*)malloc(sizeof(ParallelRange));
+    range->first = *(size_t*)key;
+    range->last = *(size_t*)key;
+    range->count = 1;
+    range->ordered = true;
+    return range;
+}
+
+void* reduce_parallel_range(void* left, void* right, void* arg)
+{
+    (void)arg;
+
+    ParallelRange* left_range = (ParallelRange*)left;
+    ParallelRange* right_range = (ParallelRange*)right;
+    left_range->ordered = left_range->ordered && right_range->ordered && left_range->last + 1 == right_range->first;
+    left_range->last = right_range->last;
+    left_range->count += right_range->count;
+    free(right_range);
+    return left_range;
+}
+
+// test parallel foreach and map-reduce
+void test_foreach_parallel(void)
+{
+    size_t count = 10000;
+    size_t* keys = (size_t*)malloc(count * sizeof(size_t));
+    LinkedHashMap* map = linkedhashmap_new();
+
+    TEST_ASSERT(linkedhashmap_map_reduce_parallel(map, map_parallel_range, reduce_parallel_range, NULL, 4) == NULL);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = i;
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+    }
+
+    atomic_size_t total;
+    atomic_init(&total, 0);
+    linkedhashmap_foreach_parallel(map, count_parallel, &total, 4);
+    TEST_ASSERT_EQ((size_t)atomic_load(&total), count * (count - 1) / 2);
+
+    // the reduction only stays ordered if every chunk is combined in insertion order
+    for (size_t nthreads = 0; nthreads <= 8; nthreads += 4)
+    {
+        ParallelRange* range = (ParallelRange*)linkedhashmap_map_reduce_parallel(map, map_parallel_range, reduce_parallel_range, NULL, nthreads);
+        TEST_ASSERT(range->ordered);
+        TEST_ASSERT_EQ(range->first, (size_t)0);
+        TEST_ASSERT_EQ(range->last, count - 1);
+        TEST_ASSERT_EQ(range->count, count);
+        free(range);
+    }
+
+    // on a table only 1% full, sampling inspects a bounded prefix of each region instead of scanning to the next entry
+    LinkedHashMap* sparse = linkedhashmap_new_with_capacity(count * 100);
+
+    for (size_t i = 0; i < count; i++)
+        TEST_ASSERT(linkedhashmap_set(sparse, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])) == NULL);
+
+    size_t max_chunks = 8 * LINKEDHASHMAP_PARALLEL_CHUNKS_PER_THREAD + 1;
+    size_t slots[8 * LINKEDHASHMAP_PARALLEL_CHUNKS_PER_THREAD + 1];
+    size_t sampled = linkedhashmap_parallel_sample(sparse, slots, max_chunks);
+    TEST_ASSERT(sampled > 1 && sampled <= max_chunks);
+    TEST_ASSERT_EQ(slots[0], linkedhashmap_find_key(sparse, &(keys[0]), sizeof(keys[0])));
+
+    for (size_t i = 1; i < sampled; i++)
+    {
+        size_t region = slots[i] * (max_chunks - 1) / sparse->capacity;
+        TEST_ASSERT(sparse->nodes[slots[i]].is_allocated);
+        TEST_ASSERT(slots[i] - region * sparse->capacity / (max_chunks - 1) < LINKEDHASHMAP_PARALLEL_SAMPLE_PROBES);
+    }
+
+    ParallelRange* range = (ParallelRange*)linkedhashmap_map_reduce_parallel(sparse, map_parallel_range, reduce_parallel_range, NULL, 8);
+    TEST_ASSERT(range->ordered);
+    TEST_ASSERT_EQ(range->count, count);
+    free(range);
+
+    linkedhashmap_free(sparse);
+    linkedhashmap_free(map);
+    free(keys);
+}
+
+int compare_values_descending(LinkedHashMapNode* a, LinkedHashMapNode* b, void* arg)
+{
+    (void)arg;
+
+    size_t x = *(size_t*)(a->value);
+    size_t y = *(size_t*)(b->value);
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+// test sorting the insertion order
+void test_sort(void)
+{
+    size_t count = 10000;
+    size_t* keys = (size_t*)malloc(count * sizeof(size_t));
+    size_t* values = (size_t*)malloc(count * sizeof(size_t));
+    LinkedHashMap* map = linkedhashmap_new();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = i;
+        values[i] = (i * 7919) % 100;
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(values[i]), sizeof(values[i])) == NULL);
+    }
+
+    linkedhashmap_enable_digests(map);
+
+    LinkedHashMap* serial = linkedhashmap_copy(map);
+    size_t slot = linkedhashmap_find_key(map, &(keys[1234]), sizeof(keys[1234]));
+
+    linkedhashmap_sort_parallel(map, compare_values_descending, NULL, 4);
+    linkedhashmap_sort(serial, compare_values_descending, NULL);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, serial));
+
+    // values descend, and keys with equal values keep their insertion order
+    size_t current = map->head;
+    TEST_ASSERT(linkedhashmap_node(map, current)->prev == LINKEDHASHMAP_NO_NODE);
+
+    while (linkedhashmap_node(map, current)->next != LINKEDHASHMAP_NO_NODE)
+    {
+        LinkedHashMapNode* node = linkedhashmap_node(map, current);
+        LinkedHashMapNode* next = linkedhashmap_node(map, node->next);
+        size_t value = *(size_t*)(node->value);
+        size_t next_value = *(size_t*)(next->value);
+        TEST_ASSERT(value > next_value || (value == next_value && *(size_t*)(node->key) < *(size_t*)(next->key)));
+        TEST_ASSERT(next->prev == current);
+        current = node->next;
+    }
+
+    TEST_ASSERT(current == map->tail);
+    TEST_ASSERT_EQ(linkedhashmap_find_key(map, &(keys[1234]), sizeof(keys[1234])), slot);
+
+    LinkedHashMap* expected = linkedhashmap_new();
+
+    for (current = map->head; current != LINKEDHASHMAP_NO_NODE; current = linkedhashmap_node(map, current)->next)
+    {
+        LinkedHashMapNode* node = linkedhashmap_node(map, current);
+        TEST_ASSERT(linkedhashmap_set(expected, node->key, node->key_size, node->value, node->value_size) == NULL);
+    }
+
+    linkedhashmap_enable_digests(expected);
+    TEST_ASSERT_EQ(linkedhashmap_order_digest(map), linkedhashmap_order_digest(expected));
+
+    // sorting a sorted map changes nothing
+    linkedhashmap_sort_parallel(map, compare_values_descending, NULL, 0);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, expected));
+
+    linkedhashmap_free(expected);
+    linkedhashmap_free(serial);
+    linkedhashmap_free(map);
+    free(values);
+    free(keys);
+}
+
+// test maps small enough to stay in their inline table
+void test_small_map(void)
+{
+    size_t keys[LINKEDHASHMAP_SMALL_SIZE + 1];
+    size_t values[LINKEDHASHMAP_SMALL_SIZE + 1];
+    LinkedHashMap* map = linkedhashmap_new();
+
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
+    TEST_ASSERT(map->nodes == map->small_nodes);
+
+    for (size_t i = 0; i <= LINKEDHASHMAP_SMALL_SIZE; i++)
+    {
+        keys[i] = i * 3;
+        values[i] = i * i;
+    }
+
+    for (size_t i = 0; i < LINKEDHASHMAP_SMALL_SIZE; i++)
+        TEST_ASSERT(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(values[i]), sizeof(values[i])) == NULL);
+
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
+    TEST_ASSERT(map->nodes == map->small_nodes);
+    TEST_ASSERT(!linkedhashmap_contains(map, &(keys[LINKEDHASHMAP_SMALL_SIZE]), sizeof(keys[0])));
+
+    for (size_t i = 0; i < LINKEDHASHMAP_SMALL_SIZE; i++)
+    {
+        LinkedHashMapEntry* res = linkedhashmap_get(map, &(keys[i]), sizeof(keys[i]));
+        TEST_ASSERT_EQ(*(size_t*)(res->value), values[i]);
+        free(res);
+    }
+
+    // reordering only touches the order links, and removal keeps the table packed
+    TEST_ASSERT(linkedhashmap_move_to_front(map, &(keys[5]), sizeof(keys[5])));
+    TEST_ASSERT(linkedhashmap_move_to_end(map, &(keys[0]), sizeof(keys[0])));
+    linkedhashmap_delete(map, &(keys[2]), sizeof(keys[2]));
+
+    size_t order[] = { 15, 3, 9, 12, 18, 21, 0 };
+    size_t current = map->head;
+
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+    {
+        TEST_ASSERT(map->nodes[i].is_allocated);
+        TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, current)->key), order[i]);
+        TEST_ASSERT(linkedhashmap_contains(map, &(order[i]), sizeof(order[i])));
+        current = linkedhashmap_node(map, current)->next;
+    }
+
+    TEST_ASSERT(current == LINKEDHASHMAP_NO_NODE);
+    TEST_ASSERT(!map->nodes[LINKEDHASHMAP_SMALL_SIZE - 1].is_allocated);
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
+
+    // a snapshot of a small map is a copy, so the two don't affect each other
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(map);
+    TEST_ASSERT(snapshot->nodes == snapshot->small_nodes);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, snapshot));
+
+    // outgrowing the inline table moves the map to a hashed table
+    TEST_ASSERT(linkedhashmap_set(map, &(keys[2]), sizeof(keys[2]), &(values[2]), sizeof(values[2])) == NULL);
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
+    TEST_ASSERT(linkedhashmap_set(map, &(keys[LINKEDHASHMAP_SMALL_SIZE]), sizeof(keys[0]), &(values[LINKEDHASHMAP_SMALL_SIZE]), sizeof(values[0])) == NULL);
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_MIN_SIZE);
+    TEST_ASSERT(map->nodes != map->small_nodes);
+    TEST_ASSERT_EQ(map->length, (size_t)LINKEDHASHMAP_SMALL_SIZE + 1);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->head)->key), (size_t)15);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->tail)->key), keys[LINKEDHASHMAP_SMALL_SIZE]);
+    TEST_ASSERT_EQ(snapshot->length, (size_t)LINKEDHASHMAP_SMALL_SIZE - 1);
+
+    for (size_t i = 0; i <= LINKEDHASHMAP_SMALL_SIZE; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(keys[i]), sizeof(keys[i])));
+
+    // the map only moves back once half of the inline table would be free
+    for (size_t i = 0; i < LINKEDHASHMAP_SMALL_SIZE / 2; i++)
+    {
+        linkedhashmap_delete(map, &(keys[i]), sizeof(keys[i]));
+        TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_MIN_SIZE);
+    }
+
+    linkedhashmap_delete(map, &(keys[LINKEDHASHMAP_SMALL_SIZE / 2]), sizeof(keys[0]));
+    TEST_ASSERT_EQ(map->capacity, (size_t)LINKEDHASHMAP_SMALL_SIZE);
+    TEST_ASSERT(map->nodes == map->small_nodes);
+    TEST_ASSERT_EQ(map->length, (size_t)LINKEDHASHMAP_SMALL_SIZE / 2);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->head)->key), (size_t)15);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->tail)->key), keys[LINKEDHASHMAP_SMALL_SIZE]);
+
+    // bulk operations rebuild the inline table in place
+    size_t divisor = 2;
+    linkedhashmap_use_strong_hash(map);
+    TEST_ASSERT_EQ(linkedhashmap_retain(map, keep_multiples, &divisor), (size_t)2);
+    TEST_ASSERT(map->nodes == map->small_nodes);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->head)->key), (size_t)18);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->tail)->key), (size_t)24);
+
+    linkedhashmap_sort(map, compare_values_descending, NULL);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->head)->key), (size_t)24);
+    TEST_ASSERT_EQ(*(size_t*)(linkedhashmap_node(map, map->tail)->key), (size_t)18);
+    TEST_ASSERT(linkedhashmap_contains(map, &(keys[6]), sizeof(keys[6])));
+    TEST_ASSERT(linkedhashmap_contains(map, &(keys[8]), sizeof(keys[8])));
+
+    // the seed and key share the inline table's memory, so a strong hash requested while inline is keyed once the map moves out
+    for (size_t i = 0; i <= LINKEDHASHMAP_SMALL_SIZE; i++)
+        free(linkedhashmap_set(map, &(keys[i]), sizeof(keys[i]), &(keys[i]), sizeof(keys[i])));
+
+    TEST_ASSERT(map->nodes != map->small_nodes);
+    TEST_ASSERT(map->strong_hash);
+    TEST_ASSERT(map->strong_hash_key[0] != 0 || map->strong_hash_key[1] != 0);
+    TEST_ASSERT_EQ(map->hash_seed, linkedhashmap_process_seed());
+
+    for (size_t i = 0; i <= LINKEDHASHMAP_SMALL_SIZE; i++)
+        TEST_ASSERT(linkedhashmap_contains(map, &(keys[i]), sizeof(keys[i])));
+
+    linkedhashmap_free(snapshot);
+    linkedhashmap_free(map);
+}
+
+// test the mutation journal
+void test_journal(void)
+{
+    INIT_SQUARES();
+
+    LinkedHashMap* follower = linkedhashmap_copy(map);
+    unsigned char buffer[256];
+    uint64_t cursor;
+    size_t size;
+
+    TEST_ASSERT_EQ(linkedhashmap_journal_sequence(map), (uint64_t)0);
+    linkedhashmap_journal_enable(map, 4096);
+    cursor = linkedhashmap_journal_sequence(map);
+
+    // every kind of change, including ones made in bulk
+    int value = 1000;
+    free(linkedhashmap_set(map, &(indices[3]), sizeof(indices[3]), &value, sizeof(value)));
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[16]), sizeof(indices[16]), &(squares[16]), sizeof(squares[16])) == NULL);
+    linkedhashmap_delete(map, &(indices[5]), sizeof(indices[5]));
+    TEST_ASSERT(linkedhashmap_pop_front(map, NULL));
+    TEST_ASSERT(linkedhashmap_move_to_end(map, &(indices[7]), sizeof(indices[7])));
+    TEST_ASSERT(linkedhashmap_move_to_front(map, &(indices[9]), sizeof(indices[9])));
+    TEST_ASSERT(linkedhashmap_insert_before(map, &(indices[9]), sizeof(indices[9]), &(indices[5]), sizeof(indices[5]), &(squares[5]), sizeof(squares[5])));
+    TEST_ASSERT(linkedhashmap_insert_after(map, &(indices[2]), sizeof(indices[2]), &(indices[12]), sizeof(indices[12]), &value, sizeof(value)));
+    TEST_ASSERT_EQ(linkedhashmap_remove_range(map, 3, 2), (size_t)2);
+    int count = 5;
+    TEST_ASSERT(linkedhashmap_upsert(map, &(indices[0]), sizeof(indices[0]), increment_count, &count));
+
+    // misses aren't changes, and neither is an entry call the journal can't follow
+    uint64_t sequence = linkedhashmap_journal_sequence(map);
+    TEST_ASSERT(linkedhashmap_entry(map, &(indices[3]), sizeof(indices[3]), &value, sizeof(value), NULL) == NULL);
+    linkedhashmap_delete(map, &(indices[5]), sizeof(indices[5]));
+    linkedhashmap_delete(map, &(indices[5]), sizeof(indices[5]));
+    TEST_ASSERT_EQ(linkedhashmap_journal_sequence(map), sequence + 1);
+
+    // the follower catches up in several reads
+    size_t reads = 0;
+
+    while ((size = linkedhashmap_journal_read(map, &cursor, buffer, 64)) > 0)
+    {
+        TEST_ASSERT(size != ~(size_t)0);
+        TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+        reads++;
+    }
+
+    TEST_ASSERT(reads > 1);
+    TEST_ASSERT_EQ(cursor, linkedhashmap_journal_sequence(map));
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, follower));
+
+    // the keys and values of the follower are its own copies
+    LinkedHashMapEntry* res = linkedhashmap_get(follower, &(indices[3]), sizeof(indices[3]));
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), 1000);
+    TEST_ASSERT(res->value != &value);
+    free(res);
+
+    // a sort is recorded as a single change holding the new order, which has to name every key of the follower
+    sequence = linkedhashmap_journal_sequence(map);
+    linkedhashmap_sort(map, compare_int_values_descending, NULL);
+    TEST_ASSERT_EQ(linkedhashmap_journal_sequence(map), sequence + 1);
+    size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+    LinkedHashMap* stranger = linkedhashmap_new();
+    TEST_ASSERT(linkedhashmap_set(stranger, &(indices[0]), sizeof(indices[0]), &(squares[0]), sizeof(squares[0])) == NULL);
+    TEST_ASSERT(!linkedhashmap_journal_apply(stranger, buffer, size));
+    linkedhashmap_free(stranger);
+    TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, follower));
+
+    linkedhashmap_clear(map);
+    TEST_ASSERT(linkedhashmap_set(map, &(indices[1]), sizeof(indices[1]), &(squares[1]), sizeof(squares[1])) == NULL);
+    size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+    TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+    size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+    TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+    TEST_ASSERT_EQ(follower->length, (size_t)1);
+    TEST_ASSERT(linkedhashmap_equal_with_insertion_order(map, follower));
+
+    // records that don't apply or are cut short are rejected
+    TEST_ASSERT(linkedhashmap_move_to_end(map, &(indices[1]), sizeof(indices[1])));
+    linkedhashmap_delete(map, &(indices[1]), sizeof(indices[1]));
+    size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+    TEST_ASSERT(!linkedhashmap_journal_apply(follower, buffer, size - 1));
+    TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+    TEST_ASSERT(!linkedhashmap_journal_apply(follower, buffer, size));
+    TEST_ASSERT(linkedhashmap_is_empty(follower));
+
+    // replayed overwrites free the copies they replace, so the follower's storage stays flat
+    for (int i = 0; i < 1000; i++)
+    {
+        free(linkedhashmap_set(map, &(indices[1]), sizeof(indices[1]), &(squares[i % 16]), sizeof(squares[i % 16])));
+        size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+        TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+        TEST_ASSERT_EQ(linkedhashmap_length(follower->owned_storage), (size_t)2);
+    }
+
+    // unless a snapshot may still point at them
+    LinkedHashMap* snapshot = linkedhashmap_snapshot(follower);
+
+    for (int i = 0; i < 10; i++)
+    {
+        free(linkedhashmap_set(map, &(indices[1]), sizeof(indices[1]), &(squares[i]), sizeof(squares[i])));
+        size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+        TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+    }
+
+    TEST_ASSERT_EQ(linkedhashmap_length(follower->owned_storage), (size_t)12);
+    res = linkedhashmap_get(snapshot, &(indices[1]), sizeof(indices[1]));
+    TEST_ASSERT_INT_EQ(*(int*)(res->value), squares[999 % 16]);
+    free(res);
+    linkedhashmap_free(snapshot);
+
+    // popping frees the key too
+    linkedhashmap_delete(map, &(indices[1]), sizeof(indices[1]));
+    size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+    TEST_ASSERT(linkedhashmap_journal_apply(follower, buffer, size));
+    TEST_ASSERT_EQ(linkedhashmap_length(follower->owned_storage), (size_t)10);
+    TEST_ASSERT(linkedhashmap_is_empty(follower));
+
+    // a consumer that falls too far behind has to start over
+    linkedhashmap_journal_disable(map);
+    linkedhashmap_journal_enable(map, 64);
+    cursor = linkedhashmap_journal_sequence(map);
+
+    for (int i = 0; i < 16; i++)
+        TEST_ASSERT(linkedhashmap_set(map, &(indices[i]), sizeof(indices[i]), &(squares[i]), sizeof(squares[i])) == NULL);
+
+    TEST_ASSERT_EQ(linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer)), ~(size_t)0);
+    TEST_ASSERT_EQ(map->journal->next_sequence, (uint64_t)16);
+    TEST_ASSERT(map->journal->first_sequence > 0);
+    TEST_ASSERT(map->journal->size <= map->journal->capacity);
+
+    cursor = map->journal->first_sequence;
+    size = linkedhashmap_journal_read(map, &cursor, buffer, sizeof(buffer));
+    TEST_ASSERT(size > 0 && size <= 64);
+    TEST_ASSERT_EQ(cursor, (uint64_t)16);
+
+    linkedhashmap_free(follower);
+    linkedhashmap_free(map);
+}
+
 // test order is preserved in keys
 void test_order_keys(void)
 {
@@ -893,8 +3067,14 @@ int main(void)
     test_init();
     printf("\nTesting initialization with capacity...\n");
     test_init_with_capacity();
+    printf("\nTesting initialization in caller memory...\n");
+    test_init_destroy();
     printf("\nTesting hash function...\n");
     test_hash();
+    printf("\nTesting hash flooding...\n");
+    test_hash_flooding();
+    printf("\nTesting precomputed hashes...\n");
+    test_hashed();
     printf("\nTesting set...\n");
     test_set();
     printf("\nTesting get...\n");
@@ -909,8 +3089,50 @@ int main(void)
     test_pop_resize_down();
     printf("\nTesting copy, equal, and equal with insertion order...\n");
     test_copy_equal();
+    printf("\nTesting snapshots...\n");
+    test_snapshot();
+    printf("\nTesting digests...\n");
+    test_digests();
+    printf("\nTesting diff...\n");
+    test_diff();
     printf("\nTesting extend...\n");
     test_extend();
+    printf("\nTesting set algebra...\n");
+    test_set_algebra();
+    printf("\nTesting reserve and shrink to fit...\n");
+    test_reserve_shrink_to_fit();
+    printf("\nTesting parallel resize...\n");
+    test_resize_parallel();
+    printf("\nTesting huge pages...\n");
+    test_huge_pages();
+    printf("\nTesting save and load...\n");
+    test_save_load();
+#ifndef _WIN32
+    printf("\nTesting freeze...\n");
+    test_freeze();
+    printf("\nTesting load delimited...\n");
+    test_load_delimited();
+    printf("\nTesting write-ahead logging...\n");
+    test_wal();
+#endif
+#ifdef LINKEDHASHMAP_STATS
+    printf("\nTesting statistics...\n");
+    test_stats();
+#endif
+#ifdef LINKEDHASHMAP_LATENCY
+    printf("\nTesting latency...\n");
+    test_latency();
+#endif
+    printf("\nTesting reordering...\n");
+    test_reorder();
+    printf("\nTesting queue operations...\n");
+    test_queue();
+    printf("\nTesting retain and remove range...\n");
+    test_retain();
+    printf("\nTesting entry and upsert...\n");
+    test_entry_upsert();
+    printf("\nTesting deletion within clusters...\n");
+    test_delete_shift();
     printf("\nTesting keys, values, and entries...\n");
     test_keys_values_entries();
     printf("\nTesting delete...\n");
@@ -921,6 +3143,14 @@ int main(void)
     test_clear();
     printf("\nTesting foreach...\n");
     test_foreach();
+    printf("\nTesting parallel foreach...\n");
+    test_foreach_parallel();
+    printf("\nTesting sort...\n");
+    test_sort();
+    printf("\nTesting small maps...\n");
+    test_small_map();
+    printf("\nTesting journal...\n");
+    test_journal();
     printf("\nTesting that order is preserved in keys...\n");
     test_order_keys();
     printf("\nTesting that order is preserved in values...\n");